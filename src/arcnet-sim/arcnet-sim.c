@@ -4,6 +4,7 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <assert.h>
+#include <unistd.h>
 
 #include "chime.h"
 #include "debug.h"
@@ -163,6 +164,7 @@ void arcnet_drv_tx_enable(void)
 void arcnet_drv_mcast_enqueue(uint8_t dst[], uint8_t pri,
 							  uint8_t retry, struct arcnet_pkt * pkt)
 {
+	int cnt = 0;
 	int i;
 
 	for (i = 0; dst[i] != 0; ++i) {
@@ -175,8 +177,7 @@ void arcnet_drv_mcast_enqueue(uint8_t dst[], uint8_t pri,
 
 		/* Insert into priority queue */
 		if (fx_pkt_heap_insert(&arcnet_drv.tx.heap, e)) {
-			/* Increment packet reference count */
-			fx_pkt_incref(pkt);
+			cnt++;
 		} else {
 			/* Insertion failed. Update statistics */
 			ERR("fx_pkt_heap_insert() failed!");
@@ -184,12 +185,16 @@ void arcnet_drv_mcast_enqueue(uint8_t dst[], uint8_t pri,
 		}
 	}
 
-	/* Decrement packet reference count.
-	   When the packet was allocated the reference count was set to 1. For
-	   each insertion into the queue the reference count was increased by one.
-	   We need to decrement the reference once, to discount the initial
-	   allocation, keeping the packet usage sane. */
-	fx_pkt_decref(pkt);
+	/* Update the packet reference count in one step.
+	   When the packet was allocated the reference count was set to 1. Each
+	   insertion into the queue holds one reference, so we add the number
+	   of insertions minus one, to discount the initial allocation.
+	   The queue is only drained by this CPU, no entry can be released
+	   before this point. */
+	if (cnt > 1)
+		fx_pkt_addref(pkt, cnt - 1);
+	else if (cnt == 0)
+		fx_pkt_decref(pkt);
 }
 
 /* allocate a packet buffer, and enqueue */
@@ -285,6 +290,8 @@ void timer0_isr(void)
 	msg.seq++;
 	arcnet_drv_send(4, msg.pri, 0, &msg, sizeof(msg));
 	msg.seq++;
+
+	arcnet_drv_tx_enable();
 }
 
 void arcnet_drv_tx_flush(FILE* f)
@@ -372,9 +379,24 @@ void cpu1_reset(void)
 
 int main(int argc, char *argv[])
 {
+	struct fx_pkt_pool_stat pool;
 	int cpu[NODE_COUNT];
+	bool srv_mac = false;
+	int c;
 	int i;
 
+	while ((c = getopt(argc, argv, "s")) > 0) {
+		switch (c) {
+		case 's':
+			/* token passing modeled by the server */
+			srv_mac = true;
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-s]\n", argv[0]);
+			return 1;
+		}
+	}
+
 	printf("\n==== ARCnet simulation! ====\n");
 	fflush(stdout);
 
@@ -387,7 +409,7 @@ int main(int argc, char *argv[])
 	chime_app_init((void (*)(void))chime_client_stop);
 
 	fx_pkt_pool_init();
-	fx_arcnet_sim_init();
+	fx_arcnet_sim_init(srv_mac);
 
 	cpu[0] = chime_cpu_create(0, 0, cpu0_reset);
 
@@ -406,6 +428,12 @@ int main(int argc, char *argv[])
 
 	while (chime_except_catch(NULL));
 
+	fx_pkt_pool_stat(&pool);
+	printf("packet pool: %u/%u free, %u cached, min=%u refills=%u "
+		   "flushes=%u errors=%u\n", pool.free, pool.size, pool.cached,
+		   pool.free_min, pool.refill_cnt, pool.flush_cnt, pool.error);
+	fflush(stdout);
+
 	chime_client_stop();
 
 	return 0;
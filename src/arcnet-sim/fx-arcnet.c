@@ -13,6 +13,7 @@
 #include "chime.h"
 #include "debug.h"
 #include "fx-arcnet.h"
+#include "fx-net.h"
 
 #define ARCNET_SPEED_BPS (2500000 / 8)
 #define ARCNET_NODES_MAX 8
@@ -111,6 +112,14 @@ struct arcnet_frm {
 
 #define ARCNET_COMM 0
 
+/* ARCnet frames in COMM bits (11 bits per ISU, 6 bits SD) */
+#define ARCNET_ITT_BITS (6 + 3 * 11)
+#define ARCNET_FBE_BITS (6 + 3 * 11)
+#define ARCNET_ACK_BITS (6 + 1 * 11)
+
+/* Use the server token MAC model, set once by fx_arcnet_sim_init() */
+static bool arcnet_srv_mac;
+
 enum {
 	ARCNET_RESET      =  0, /* Reset */
 	ARCNET_WT_IDLE    =  1, /* Wait for Quiescent Medium */
@@ -398,52 +407,9 @@ static void __tmr_stop(int tmr_id)
  * CRC-16
  ****************************************************************************/
 
-static const uint16_t crc16lut[256] = {
-    0x0000, 0x1189, 0x2312, 0x329b, 0x4624, 0x57ad, 0x6536, 0x74bf,
-    0x8c48, 0x9dc1, 0xaf5a, 0xbed3, 0xca6c, 0xdbe5, 0xe97e, 0xf8f7,
-    0x1081, 0x0108, 0x3393, 0x221a, 0x56a5, 0x472c, 0x75b7, 0x643e,
-    0x9cc9, 0x8d40, 0xbfdb, 0xae52, 0xdaed, 0xcb64, 0xf9ff, 0xe876,
-    0x2102, 0x308b, 0x0210, 0x1399, 0x6726, 0x76af, 0x4434, 0x55bd,
-    0xad4a, 0xbcc3, 0x8e58, 0x9fd1, 0xeb6e, 0xfae7, 0xc87c, 0xd9f5,
-    0x3183, 0x200a, 0x1291, 0x0318, 0x77a7, 0x662e, 0x54b5, 0x453c,
-    0xbdcb, 0xac42, 0x9ed9, 0x8f50, 0xfbef, 0xea66, 0xd8fd, 0xc974,
-    0x4204, 0x538d, 0x6116, 0x709f, 0x0420, 0x15a9, 0x2732, 0x36bb,
-    0xce4c, 0xdfc5, 0xed5e, 0xfcd7, 0x8868, 0x99e1, 0xab7a, 0xbaf3,
-    0x5285, 0x430c, 0x7197, 0x601e, 0x14a1, 0x0528, 0x37b3, 0x263a,
-    0xdecd, 0xcf44, 0xfddf, 0xec56, 0x98e9, 0x8960, 0xbbfb, 0xaa72,
-    0x6306, 0x728f, 0x4014, 0x519d, 0x2522, 0x34ab, 0x0630, 0x17b9,
-    0xef4e, 0xfec7, 0xcc5c, 0xddd5, 0xa96a, 0xb8e3, 0x8a78, 0x9bf1,
-    0x7387, 0x620e, 0x5095, 0x411c, 0x35a3, 0x242a, 0x16b1, 0x0738,
-    0xffcf, 0xee46, 0xdcdd, 0xcd54, 0xb9eb, 0xa862, 0x9af9, 0x8b70,
-    0x8408, 0x9581, 0xa71a, 0xb693, 0xc22c, 0xd3a5, 0xe13e, 0xf0b7,
-    0x0840, 0x19c9, 0x2b52, 0x3adb, 0x4e64, 0x5fed, 0x6d76, 0x7cff,
-    0x9489, 0x8500, 0xb79b, 0xa612, 0xd2ad, 0xc324, 0xf1bf, 0xe036,
-    0x18c1, 0x0948, 0x3bd3, 0x2a5a, 0x5ee5, 0x4f6c, 0x7df7, 0x6c7e,
-    0xa50a, 0xb483, 0x8618, 0x9791, 0xe32e, 0xf2a7, 0xc03c, 0xd1b5,
-    0x2942, 0x38cb, 0x0a50, 0x1bd9, 0x6f66, 0x7eef, 0x4c74, 0x5dfd,
-    0xb58b, 0xa402, 0x9699, 0x8710, 0xf3af, 0xe226, 0xd0bd, 0xc134,
-    0x39c3, 0x284a, 0x1ad1, 0x0b58, 0x7fe7, 0x6e6e, 0x5cf5, 0x4d7c,
-    0xc60c, 0xd785, 0xe51e, 0xf497, 0x8028, 0x91a1, 0xa33a, 0xb2b3,
-    0x4a44, 0x5bcd, 0x6956, 0x78df, 0x0c60, 0x1de9, 0x2f72, 0x3efb,
-    0xd68d, 0xc704, 0xf59f, 0xe416, 0x90a9, 0x8120, 0xb3bb, 0xa232,
-    0x5ac5, 0x4b4c, 0x79d7, 0x685e, 0x1ce1, 0x0d68, 0x3ff3, 0x2e7a,
-    0xe70e, 0xf687, 0xc41c, 0xd595, 0xa12a, 0xb0a3, 0x8238, 0x93b1,
-    0x6b46, 0x7acf, 0x4854, 0x59dd, 0x2d62, 0x3ceb, 0x0e70, 0x1ff9,
-    0xf78f, 0xe606, 0xd49d, 0xc514, 0xb1ab, 0xa022, 0x92b9, 0x8330,
-    0x7bc7, 0x6a4e, 0x58d5, 0x495c, 0x3de3, 0x2c6a, 0x1ef1, 0x0f78
-};
-
-static unsigned int __crc16(const uint8_t * data, size_t len)
+static inline unsigned int __crc16(const uint8_t * data, size_t len)
 {
-	unsigned int crc = 0xffff;
-	unsigned int idx;
-
-    while (len--) {
-        idx = (crc ^ *data) & 0xff;
-        crc = crc16lut[idx] ^ (crc >> 8);
-		data++;
-    }
-    return crc ^ 0xffff;
+	return fx_crc16(data, len);
 }
 
 /****************************************************************************
@@ -839,6 +805,57 @@ void arcnet_mac_rcv_isr(void)
 	}
 }
 
+/****************************************************************************
+ * Server MAC. 
+ * The token rotation, FBE and ACK frames are modeled by the server, 
+ * only data frames and the acknowledge outcome reach the CPU.
+ ****************************************************************************/
+
+void arcnet_srv_rcv_isr(void)
+{
+	struct arcnet_pac_frm * frm = &arcnet_mac.rx_frm.pac;
+	uint16_t fsc;
+	int len;
+
+	chime_comm_read(ARCNET_COMM, frm, sizeof(struct arcnet_frm));
+
+	if (frm->pac != ARCNET_FRM_PAC)
+		return;
+
+	arcnet_mac.reg.rxd = frm->did[0];
+	if ((arcnet_mac.reg.rxd != arcnet_mac.reg.myid) &&
+		((arcnet_mac.reg.rxd != ARCNET_BCAST_ADDR) || !arcnet_mac.flag.be))
+		return;
+
+	if (arcnet_mac.flag.ri) {
+		DBG1("<%d> receiver inhibited, frame lost!", chime_cpu_id());
+		return;
+	}
+
+	len = frm->il;
+	fsc = frm->info_fsc[len] | (frm->info_fsc[len + 1] << 8);
+	if (fsc != __crc16(frm->info_fsc, len)) {
+		WARN("<%d> FSC error", chime_cpu_id());
+		return;
+	}
+
+	arcnet_mac.flag.ri = 1;
+	arcnet_mac.rcv_isr();
+}
+
+void arcnet_srv_eot_isr(void)
+{
+	DBG2("<%d> EOT: %d us", chime_cpu_id(), chime_cpu_cycles() - xmt_clk);
+
+	arcnet_mac.flag.ta = 1;
+	/* broadcast frames are not acknowledged */
+	if ((arcnet_mac.reg.txd != ARCNET_BCAST_ADDR) &&
+		chime_comm_tx_ack(ARCNET_COMM))
+		arcnet_mac.flag.tma = 1;
+
+	arcnet_mac.eot_isr();
+}
+
 void arcnet_mac_eot_isr(void)
 {
 	DBG2("<%d> EOT: %d us", chime_cpu_id(), chime_cpu_cycles() - xmt_clk);
@@ -1031,6 +1048,13 @@ void arcnet_pkt_write(const struct arcnet_pkt * pkt)
 
 	arcnet_mac.flag.ta = 0;
 	arcnet_mac.flag.tma = 0;
+
+	if (arcnet_srv_mac) {
+		/* the server passes the token, transmit right away */
+		arcnet_mac.reg.txd = frm->did[0];
+		chime_comm_write_to(ARCNET_COMM, arcnet_mac.reg.txd, frm, len + 8);
+		xmt_clk = chime_cpu_cycles();
+	}
 }
 
 void arcnet_mac_open(int addr, void (* rcv_isr)(void), void (* eot_isr)(void))
@@ -1056,6 +1080,15 @@ void arcnet_mac_open(int addr, void (* rcv_isr)(void), void (* eot_isr)(void))
 
 	arcnet_mac.flag.be = 1;
 
+	if (arcnet_srv_mac) {
+		/* no MAC timers, the server delivers only data frames */
+		chime_comm_attach(ARCNET_COMM, "ARCnet",
+						  arcnet_srv_rcv_isr, arcnet_srv_eot_isr, NULL);
+		/* receive only the frames addressed to this station */
+		chime_comm_addr_set(ARCNET_COMM, arcnet_mac.reg.myid);
+		return;
+	}
+
 	/* TLT = 820 ms */
 	arcnet_mac.delay.tlt = (2100000LL * 1000000LL) / arcnet_mac.speed_bps;
 	chime_tmr_init(ARCNET_TLT, arcnet_mac_tlt_isr, 0, 0);
@@ -1083,7 +1116,7 @@ void arcnet_mac_open(int addr, void (* rcv_isr)(void), void (* eot_isr)(void))
 	arcnet_fsm_reset();
 }
 
-int fx_arcnet_sim_init(void)
+int fx_arcnet_sim_init(bool srv_mac)
 {
 	struct comm_attr attr = {
 		.wr_cyc_per_byte = 0,
@@ -1100,9 +1133,16 @@ int fx_arcnet_sim_init(void)
 		.hist_en = false,
 		.txbuf_en = false,
 		.dcd_en = true, /* enable data carrier detect */
-		.exp_en = false /* enable exponential distribution */
+		.exp_en = false, /* enable exponential distribution */
+		.mac = COMM_MAC_RANDOM,
+		.tok_bits = ARCNET_ITT_BITS, /* token MAC: ITT frame */
+		.ack_bits = ARCNET_FBE_BITS + 2 * ARCNET_ACK_BITS /* FBE/ACK, ACK */
 	};
 
+	arcnet_srv_mac = srv_mac;
+	if (srv_mac)
+		attr.mac = COMM_MAC_TOKEN;
+
 
 	/* create an arcnet communication simulation */
 	if (chime_comm_create("ARCnet", &attr) < 0) {
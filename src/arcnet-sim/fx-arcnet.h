@@ -47,7 +47,9 @@ struct arcnet_pkt {
 extern "C" {
 #endif
 
-int fx_arcnet_sim_init(void);
+/* Create the ARCnet COMM. If 'srv_mac' is set the token passing is
+   modeled by the server and the CPUs exchange only data frames. */
+int fx_arcnet_sim_init(bool srv_mac);
 
 void arcnet_mac_open(int addr, void (* rcv_isr)(void), 
 					 void (* eot_isr)(void));
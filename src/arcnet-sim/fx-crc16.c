@@ -0,0 +1,256 @@
+/*
+ * @file	fx-crc16.c
+ * @brief	CRC-16 (X.25) kernels
+ * @author	Robinson Mittmann (bobmittmann@gmail.com)
+ *
+ */
+
+/*
+   Three implementations of the same CRC (reflected 0x8408, init and
+   final xor 0xffff):
+
+   - lut: byte at a time, one 256 entries table;
+   - sb8: slice-by-8, eight tables, 8 bytes per iteration;
+   - clmul: carry-less multiply (PCLMULQDQ), folds 16 bytes per
+     iteration, the remainder goes through slice-by-8, x86-64 only.
+
+   fx_crc16() calls the fastest one supported by the host, selected
+   on the first call.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "fx-net.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define CRC16_CLMUL 1
+#include <wmmintrin.h>
+#endif
+
+static const uint16_t crc16lut[256] = {
+    0x0000, 0x1189, 0x2312, 0x329b, 0x4624, 0x57ad, 0x6536, 0x74bf,
+    0x8c48, 0x9dc1, 0xaf5a, 0xbed3, 0xca6c, 0xdbe5, 0xe97e, 0xf8f7,
+    0x1081, 0x0108, 0x3393, 0x221a, 0x56a5, 0x472c, 0x75b7, 0x643e,
+    0x9cc9, 0x8d40, 0xbfdb, 0xae52, 0xdaed, 0xcb64, 0xf9ff, 0xe876,
+    0x2102, 0x308b, 0x0210, 0x1399, 0x6726, 0x76af, 0x4434, 0x55bd,
+    0xad4a, 0xbcc3, 0x8e58, 0x9fd1, 0xeb6e, 0xfae7, 0xc87c, 0xd9f5,
+    0x3183, 0x200a, 0x1291, 0x0318, 0x77a7, 0x662e, 0x54b5, 0x453c,
+    0xbdcb, 0xac42, 0x9ed9, 0x8f50, 0xfbef, 0xea66, 0xd8fd, 0xc974,
+    0x4204, 0x538d, 0x6116, 0x709f, 0x0420, 0x15a9, 0x2732, 0x36bb,
+    0xce4c, 0xdfc5, 0xed5e, 0xfcd7, 0x8868, 0x99e1, 0xab7a, 0xbaf3,
+    0x5285, 0x430c, 0x7197, 0x601e, 0x14a1, 0x0528, 0x37b3, 0x263a,
+    0xdecd, 0xcf44, 0xfddf, 0xec56, 0x98e9, 0x8960, 0xbbfb, 0xaa72,
+    0x6306, 0x728f, 0x4014, 0x519d, 0x2522, 0x34ab, 0x0630, 0x17b9,
+    0xef4e, 0xfec7, 0xcc5c, 0xddd5, 0xa96a, 0xb8e3, 0x8a78, 0x9bf1,
+    0x7387, 0x620e, 0x5095, 0x411c, 0x35a3, 0x242a, 0x16b1, 0x0738,
+    0xffcf, 0xee46, 0xdcdd, 0xcd54, 0xb9eb, 0xa862, 0x9af9, 0x8b70,
+    0x8408, 0x9581, 0xa71a, 0xb693, 0xc22c, 0xd3a5, 0xe13e, 0xf0b7,
+    0x0840, 0x19c9, 0x2b52, 0x3adb, 0x4e64, 0x5fed, 0x6d76, 0x7cff,
+    0x9489, 0x8500, 0xb79b, 0xa612, 0xd2ad, 0xc324, 0xf1bf, 0xe036,
+    0x18c1, 0x0948, 0x3bd3, 0x2a5a, 0x5ee5, 0x4f6c, 0x7df7, 0x6c7e,
+    0xa50a, 0xb483, 0x8618, 0x9791, 0xe32e, 0xf2a7, 0xc03c, 0xd1b5,
+    0x2942, 0x38cb, 0x0a50, 0x1bd9, 0x6f66, 0x7eef, 0x4c74, 0x5dfd,
+    0xb58b, 0xa402, 0x9699, 0x8710, 0xf3af, 0xe226, 0xd0bd, 0xc134,
+    0x39c3, 0x284a, 0x1ad1, 0x0b58, 0x7fe7, 0x6e6e, 0x5cf5, 0x4d7c,
+    0xc60c, 0xd785, 0xe51e, 0xf497, 0x8028, 0x91a1, 0xa33a, 0xb2b3,
+    0x4a44, 0x5bcd, 0x6956, 0x78df, 0x0c60, 0x1de9, 0x2f72, 0x3efb,
+    0xd68d, 0xc704, 0xf59f, 0xe416, 0x90a9, 0x8120, 0xb3bb, 0xa232,
+    0x5ac5, 0x4b4c, 0x79d7, 0x685e, 0x1ce1, 0x0d68, 0x3ff3, 0x2e7a,
+    0xe70e, 0xf687, 0xc41c, 0xd595, 0xa12a, 0xb0a3, 0x8238, 0x93b1,
+    0x6b46, 0x7acf, 0x4854, 0x59dd, 0x2d62, 0x3ceb, 0x0e70, 0x1ff9,
+    0xf78f, 0xe606, 0xd49d, 0xc514, 0xb1ab, 0xa022, 0x92b9, 0x8330,
+    0x7bc7, 0x6a4e, 0x58d5, 0x495c, 0x3de3, 0x2c6a, 0x1ef1, 0x0f78
+};
+
+/* slice-by-8 tables, crc16sb8[0] is the same as crc16lut */
+static uint16_t crc16sb8[8][256];
+static bool crc16sb8_ready = false;
+
+unsigned int fx_crc16_lut(const void * buf, size_t len)
+{
+	const uint8_t * data = (const uint8_t *)buf;
+	unsigned int crc = 0xffff;
+	unsigned int idx;
+
+    while (len--) {
+        idx = (crc ^ *data) & 0xff;
+        crc = crc16lut[idx] ^ (crc >> 8);
+		data++;
+    }
+    return crc ^ 0xffff;
+}
+
+static void __crc16_sb8_init(void)
+{
+	unsigned int crc;
+	int i;
+	int k;
+
+	for (i = 0; i < 256; ++i) {
+		crc = crc16lut[i];
+		crc16sb8[0][i] = crc;
+		for (k = 1; k < 8; ++k) {
+			crc = crc16lut[crc & 0xff] ^ (crc >> 8);
+			crc16sb8[k][i] = crc;
+		}
+	}
+
+	crc16sb8_ready = true;
+}
+
+/* update the register 'crc' with 'len' bytes */
+static inline unsigned int __crc16_sb8(unsigned int crc, 
+									   const uint8_t * data, size_t len)
+{
+	while (len >= 8) {
+		crc = crc16sb8[7][(data[0] ^ crc) & 0xff] ^
+			crc16sb8[6][(data[1] ^ (crc >> 8)) & 0xff] ^
+			crc16sb8[5][data[2]] ^ crc16sb8[4][data[3]] ^
+			crc16sb8[3][data[4]] ^ crc16sb8[2][data[5]] ^
+			crc16sb8[1][data[6]] ^ crc16sb8[0][data[7]];
+		data += 8;
+		len -= 8;
+	}
+
+	while (len--) {
+		crc = crc16lut[(crc ^ *data) & 0xff] ^ (crc >> 8);
+		data++;
+	}
+
+	return crc;
+}
+
+unsigned int fx_crc16_sb8(const void * buf, size_t len)
+{
+	if (!crc16sb8_ready)
+		__crc16_sb8_init();
+
+	return __crc16_sb8(0xffff, (const uint8_t *)buf, len) ^ 0xffff;
+}
+
+#ifdef CRC16_CLMUL
+
+/* Fold constants, bit reflected, P = 0x11021: x^191 mod P and 
+   x^127 mod P (the reflected product is one bit short, hence the -1) */
+#define CRC16_K191 0xa95d000000000000ULL
+#define CRC16_K127 0x7eea000000000000ULL
+
+__attribute__((target("pclmul")))
+unsigned int fx_crc16_clmul(const void * buf, size_t len)
+{
+	const __m128i k = _mm_set_epi64x(CRC16_K127, CRC16_K191);
+	const uint8_t * data = (const uint8_t *)buf;
+	uint8_t rem[16];
+	__m128i x;
+
+	if (!crc16sb8_ready)
+		__crc16_sb8_init();
+
+	/* short buffers are not worth the setup */
+	if (len < 32)
+		return __crc16_sb8(0xffff, data, len) ^ 0xffff;
+
+	/* fold 16 bytes per iteration, one multiply per half */
+	x = _mm_loadu_si128((const __m128i *)data);
+	x = _mm_xor_si128(x, _mm_cvtsi32_si128(0xffff));
+	data += 16;
+	len -= 16;
+	do {
+		x = _mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x00),
+						  _mm_clmulepi64_si128(x, k, 0x11));
+		x = _mm_xor_si128(x, _mm_loadu_si128((const __m128i *)data));
+		data += 16;
+		len -= 16;
+	} while (len >= 16);
+
+	/* The 128 bits left are congruent to the message so far. Reduce them
+	   as message bytes with a zero register, then the tail. */
+	_mm_storeu_si128((__m128i *)rem, x);
+
+	return __crc16_sb8(__crc16_sb8(0, rem, 16), data, len) ^ 0xffff;
+}
+
+#else
+
+/* not available on this host, see fx_crc16_supported() */
+unsigned int fx_crc16_clmul(const void * buf, size_t len)
+{
+	return fx_crc16_sb8(buf, len);
+}
+
+#endif /* CRC16_CLMUL */
+
+static const char * const crc16_nm[] = {
+	[FX_CRC16_LUT] = "lut",
+	[FX_CRC16_SB8] = "sb8",
+	[FX_CRC16_CLMUL] = "clmul"
+};
+
+static unsigned int __crc16_resolve(const void * buf, size_t len);
+
+static unsigned int (* crc16_fn)(const void *, size_t) = __crc16_resolve;
+
+bool fx_crc16_supported(int impl)
+{
+	switch (impl) {
+	case FX_CRC16_LUT:
+	case FX_CRC16_SB8:
+		return true;
+#ifdef CRC16_CLMUL
+	case FX_CRC16_CLMUL:
+		return __builtin_cpu_supports("pclmul");
+#endif
+	}
+
+	return false;
+}
+
+const char * fx_crc16_name(int impl)
+{
+	if ((impl < 0) || (impl >= FX_CRC16_IMPL_CNT))
+		return "?";
+
+	return crc16_nm[impl];
+}
+
+bool fx_crc16_select(int impl)
+{
+	if (!fx_crc16_supported(impl))
+		return false;
+
+	switch (impl) {
+	case FX_CRC16_LUT:
+		crc16_fn = fx_crc16_lut;
+		break;
+	case FX_CRC16_SB8:
+		__crc16_sb8_init();
+		crc16_fn = fx_crc16_sb8;
+		break;
+#ifdef CRC16_CLMUL
+	case FX_CRC16_CLMUL:
+		crc16_fn = fx_crc16_clmul;
+		break;
+#endif
+	}
+
+	return true;
+}
+
+/* Select the best implementation for this host. Concurrent first 
+   calls all store the same pointer. */
+static unsigned int __crc16_resolve(const void * buf, size_t len)
+{
+	if (!fx_crc16_select(FX_CRC16_CLMUL))
+		fx_crc16_select(FX_CRC16_SB8);
+
+	return crc16_fn(buf, len);
+}
+
+unsigned int fx_crc16(const void * buf, size_t len)
+{
+	return crc16_fn(buf, len);
+}
+
@@ -7,6 +7,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 struct heap_entry {
 	uint16_t ord; /* entry order */
@@ -15,6 +16,17 @@ struct heap_entry {
 	void * pkt;   /* packet buffer */
 };
 
+/* packet pool statistics */
+struct fx_pkt_pool_stat {
+	uint32_t size;
+	uint32_t free; /* objects in the global pool */
+	uint32_t cached; /* objects in the per thread magazines */
+	uint32_t free_min; /* global pool low water mark */
+	uint32_t refill_cnt; /* magazine refills */
+	uint32_t flush_cnt; /* magazine flushes */
+	uint32_t error; /* allocations failed, pool exhausted */
+};
+
 #define RETRY_BITS 3 
 #define RETRY_MAX ((1 << RETRY_BITS) - 1) /* must be power of 2 */
 #define RETRY_MASK (RETRY_MAX)
@@ -85,12 +97,43 @@ void * fx_pkt_alloc(void);
 
 int fx_pkt_incref(void * pkt);
 
+int fx_pkt_addref(void * pkt, int n);
+
 int fx_pkt_decref(void * pkt);
 
 void fx_pkt_free(void * pkt);
 
 void fx_pkt_pool_init(void);
 
+void fx_pkt_pool_stat(struct fx_pkt_pool_stat * stat);
+
+/*****************************************************************************
+ * CRC-16
+ *****************************************************************************/
+
+enum {
+	FX_CRC16_LUT = 0,
+	FX_CRC16_SB8 = 1,
+	FX_CRC16_CLMUL = 2,
+	FX_CRC16_IMPL_CNT
+};
+
+/* CRC-16 with the fastest implementation supported by the host */
+unsigned int fx_crc16(const void * buf, size_t len);
+
+unsigned int fx_crc16_lut(const void * buf, size_t len);
+
+unsigned int fx_crc16_sb8(const void * buf, size_t len);
+
+unsigned int fx_crc16_clmul(const void * buf, size_t len);
+
+bool fx_crc16_supported(int impl);
+
+/* Force the implementation used by fx_crc16() */
+bool fx_crc16_select(int impl);
+
+const char * fx_crc16_name(int impl);
+
 
 #ifdef __cplusplus
 extern "C" {
@@ -26,9 +26,12 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <stdbool.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include "fx-spinlock.h"
+#include "fx-net.h"
 
 #ifndef PKT_SIZE_MAX 
 #define PKT_SIZE_MAX 256
@@ -38,6 +41,19 @@
 #define PKT_POOL_LEN 1024
 #endif /* PKT_POOL_LEN */
 
+/* Per thread magazine (cache) length. The magazine is refilled from,
+   and flushed into, the global pool in batches of half its size. */
+#ifndef PKT_MAG_LEN 
+#define PKT_MAG_LEN 16
+#endif /* PKT_MAG_LEN */
+
+#define PKT_MAG_BATCH (PKT_MAG_LEN / 2)
+
+/* Threads whose magazines are accounted for in the pool statistics */
+#ifndef PKT_MAG_MAX
+#define PKT_MAG_MAX 64
+#endif /* PKT_MAG_MAX */
+
 #define __OID_VOID -1
 
 /* object container */
@@ -54,22 +70,41 @@ struct obj {
     };
 } __attribute__((aligned(4)));
 
+struct pkt_mag {
+	int cnt;
+	int16_t oid[PKT_MAG_LEN];
+};
+
 struct {
 	uint32_t error; /* allocation fail errors */
 	int32_t head;
 	int32_t tail;
+	int32_t free_cnt; /* objects in the global list */
+	int32_t free_min; /* low water mark */
+	uint32_t refill_cnt;
+	uint32_t flush_cnt;
 	__spinlock_t spinlock;
+	pthread_key_t mag_key; /* flushes the magazine on thread exit */
+	int mag_cnt;
+	struct pkt_mag * mag[PKT_MAG_MAX];
 	struct obj obj[PKT_POOL_LEN];
 } pkt_pool;
 
-void * fx_pkt_alloc(void)
+/* Thread local magazine. Objects cached here are not in the global
+   list, the spinlock is taken only to refill or flush a batch. */
+static __thread struct pkt_mag pkt_mag;
+static __thread bool pkt_mag_bound;
+
+/* move up to 'n' objects from the global pool into the magazine,
+   return the number of objects moved */
+static int __pool_refill(int n)
 {
-	void * ret = NULL;
 	int oid;
+	int i;
 
 	__spin_lock(pkt_pool.spinlock);
 
-	if ((oid = pkt_pool.head) != __OID_VOID) {
+	for (i = 0; (i < n) && ((oid = pkt_pool.head) != __OID_VOID); ++i) {
 		struct obj * obj = &pkt_pool.obj[oid];
 
 		/* sanity check */
@@ -80,98 +115,182 @@ void * fx_pkt_alloc(void)
 			pkt_pool.head = pkt_pool.tail = __OID_VOID; /* Pool is empty */
 		else
 			pkt_pool.head = obj->next;
-		
-		obj->meta.ref = 1; /* initialize reference counter */
 
-		ret = (void *)obj->data;
-	} else {
-		pkt_pool.error++;
+		pkt_mag.oid[pkt_mag.cnt++] = oid;
 	}
 
+	pkt_pool.free_cnt -= i;
+	if (pkt_pool.free_cnt < pkt_pool.free_min)
+		pkt_pool.free_min = pkt_pool.free_cnt;
+
+	if (i > 0)
+		pkt_pool.refill_cnt++;
+	else
+		pkt_pool.error++;
+
 	__spin_unlock(pkt_pool.spinlock);
 
-	return ret;
+	return i;
 }
 
-int fx_pkt_incref(void * ptr)
+/* return 'n' objects from the magazine into the global pool */
+static void __pool_flush(int n)
 {
-	struct obj * obj = (struct obj *)((uint32_t *)ptr - META_OFFS);
-	int ret;
+	int oid;
+	int i;
 
-	assert(ptr != NULL);
+	__spin_lock(pkt_pool.spinlock);
+
+	for (i = 0; i < n; ++i) {
+		oid = pkt_mag.oid[--pkt_mag.cnt];
+		if (pkt_pool.head == __OID_VOID) 
+			pkt_pool.head = oid;
+		else {
+			pkt_pool.obj[pkt_pool.tail].next = oid;
+		}
+		pkt_pool.tail = oid;
+	}
+
+	pkt_pool.free_cnt += n;
+	pkt_pool.flush_cnt++;
+
+	__spin_unlock(pkt_pool.spinlock);
+}
+
+/* thread exit, return the cached objects to the global pool */
+static void __mag_unbind(void * arg)
+{
+	struct pkt_mag * mag = (struct pkt_mag *)arg;
+	int i;
+
+	assert(mag == &pkt_mag);
+
+	if (pkt_mag.cnt > 0)
+		__pool_flush(pkt_mag.cnt);
 
 	__spin_lock(pkt_pool.spinlock);
 
-	assert(obj->meta.ref > 0);
+	for (i = 0; i < pkt_pool.mag_cnt; ++i) {
+		if (pkt_pool.mag[i] == mag) {
+			pkt_pool.mag[i] = pkt_pool.mag[--pkt_pool.mag_cnt];
+			break;
+		}
+	}
+
+	__spin_unlock(pkt_pool.spinlock);
+}
+
+/* first use of the magazine in this thread */
+static void __mag_bind(void)
+{
+	pkt_mag_bound = true;
+	pthread_setspecific(pkt_pool.mag_key, &pkt_mag);
+
+	__spin_lock(pkt_pool.spinlock);
 
-	ret = obj->meta.ref++;
+	if (pkt_pool.mag_cnt < PKT_MAG_MAX)
+		pkt_pool.mag[pkt_pool.mag_cnt++] = &pkt_mag;
 
 	__spin_unlock(pkt_pool.spinlock);
+}
+
+static inline void __pkt_release(struct obj * obj)
+{
+	if (!pkt_mag_bound)
+		__mag_bind();
+
+	if (pkt_mag.cnt == PKT_MAG_LEN)
+		__pool_flush(PKT_MAG_BATCH);
 
-	return ret;
+	pkt_mag.oid[pkt_mag.cnt++] = obj->meta.oid;
 }
 
-int fx_pkt_decref(void * ptr)
+void * fx_pkt_alloc(void)
 {
-	struct obj * obj = (struct obj *)((uint32_t *)ptr - META_OFFS);
+	struct obj * obj;
 	int oid;
-	int ret;
-	int ref;
 
-	assert(ptr != NULL);
+	if (!pkt_mag_bound)
+		__mag_bind();
 
-	__spin_lock(pkt_pool.spinlock);
+	if ((pkt_mag.cnt == 0) && (__pool_refill(PKT_MAG_BATCH) == 0))
+		return NULL;
+
+	oid = pkt_mag.oid[--pkt_mag.cnt];
+	obj = &pkt_pool.obj[oid];
+
+	/* sanity check */
+	assert(obj->meta.oid == oid);
+	assert(obj->meta.ref == 0);
+
+	obj->meta.ref = 1; /* initialize reference counter */
 
-	oid = obj->meta.oid;
+	return (void *)obj->data;
+}
 
-	assert(obj == &pkt_pool.obj[oid]);
+/* Add 'n' references at once, return the previous count */
+int fx_pkt_addref(void * ptr, int n)
+{
+	struct obj * obj = (struct obj *)((uint32_t *)ptr - META_OFFS);
+
+	assert(ptr != NULL);
 	assert(obj->meta.ref > 0);
 
-	ref = obj->meta.ref ;
-	if (ref > 0) {
-		if (--ref == 0) { 
-			if ((ret = --obj->meta.ref) == 0) { 
-				if (pkt_pool.head == __OID_VOID) 
-					pkt_pool.head = oid;
-				else {
-					pkt_pool.obj[pkt_pool.tail].next = oid;
-				}
-				pkt_pool.tail = oid;
-			}
-		}
-		/* write back */
-		obj->meta.ref = ref;
-		ret = ref;
-	} else {
+	return __sync_fetch_and_add(&obj->meta.ref, n);
+}
+
+int fx_pkt_incref(void * ptr)
+{
+	return fx_pkt_addref(ptr, 1);
+}
+
+int fx_pkt_decref(void * ptr)
+{
+	struct obj * obj = (struct obj *)((uint32_t *)ptr - META_OFFS);
+	int ref;
+
+	assert(ptr != NULL);
+	assert(obj == &pkt_pool.obj[obj->meta.oid]);
+
+	if (obj->meta.ref == 0) {
 		/* this object is gone already!!! */
-		ret = -1;
+		return -1;
 	}
 
-	__spin_unlock(pkt_pool.spinlock);
+	/* the last reference puts the object back into the local magazine */
+	if ((ref = __sync_sub_and_fetch(&obj->meta.ref, 1)) == 0)
+		__pkt_release(obj);
 
-	return ret;
+	return ref;
 }
 
 void fx_pkt_free(void * ptr)
 {
 	struct obj * obj = (struct obj *)((uint32_t *)ptr - META_OFFS);
-	int oid;
 
 	assert(ptr != NULL);
+	assert(obj->meta.ref == 1);
 
-	__spin_lock(pkt_pool.spinlock);
+	obj->meta.ref = 0;
+	__pkt_release(obj);
+}
 
-	oid = obj->meta.oid;
+void fx_pkt_pool_stat(struct fx_pkt_pool_stat * stat)
+{
+	int i;
 
-	assert(obj->meta.ref == 1);
+	__spin_lock(pkt_pool.spinlock);
 
-	obj->meta.ref = 0;
-	if (pkt_pool.head == __OID_VOID) 
-		pkt_pool.head = oid;
-	else {
-		pkt_pool.obj[pkt_pool.tail].next = oid;
-	}
-	pkt_pool.tail = oid;
+	stat->size = PKT_POOL_LEN;
+	stat->free = pkt_pool.free_cnt;
+	/* a snapshot, the other threads don't lock to use their magazines */
+	stat->cached = 0;
+	for (i = 0; i < pkt_pool.mag_cnt; ++i)
+		stat->cached += pkt_pool.mag[i]->cnt;
+	stat->free_min = pkt_pool.free_min;
+	stat->refill_cnt = pkt_pool.refill_cnt;
+	stat->flush_cnt = pkt_pool.flush_cnt;
+	stat->error = pkt_pool.error;
 
 	__spin_unlock(pkt_pool.spinlock);
 }
@@ -183,6 +302,8 @@ void fx_pkt_pool_init(void)
 	int oid;
 
 	__spinlock_create(&pkt_pool.spinlock);
+	pthread_key_create(&pkt_pool.mag_key, __mag_unbind);
+	pkt_pool.mag_cnt = 0;
 
 	for (oid = 0; oid < nmemb; ++oid) {
 		obj = &pkt_pool.obj[oid];
@@ -193,6 +314,10 @@ void fx_pkt_pool_init(void)
 
 	pkt_pool.head = 0;
 	pkt_pool.tail = oid - 1;
+	pkt_pool.free_cnt = nmemb;
+	pkt_pool.free_min = nmemb;
+	pkt_pool.refill_cnt = 0;
+	pkt_pool.flush_cnt = 0;
 	pkt_pool.error = 0;
 
 }
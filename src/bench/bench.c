@@ -0,0 +1,543 @@
+/*
+   bench.c
+   libchime data structures microbenchmarks
+   Copyright(C) 2013 Robinson Mittmann.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+   Results are printed as CSV, one line per case:
+
+     name,param,threads,ops,ns_per_op,mops
+
+   Lines starting with '#' are comments. The output of two releases
+   can be joined on the (name, param, threads) columns.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <time.h>
+#include <pthread.h>
+
+#define __CLK_HEAP__
+#include "clk-heap.h"
+#include "objpool.h"
+#include "mempool.h"
+#include "list.h"
+
+#define THREADS_MAX 16
+
+static uint64_t ops_scale = 1;
+static int threads_max = 4;
+static const char * filter = NULL;
+
+/* keep the compiler from discarding results */
+static volatile double sink;
+
+static inline uint64_t clock_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static bool bench_enabled(const char * name)
+{
+	return (filter == NULL) || (strstr(name, filter) != NULL);
+}
+
+static void report(const char * name, const char * param, int threads,
+				   uint64_t ops, uint64_t dt)
+{
+	double ns = (double)dt / ops;
+
+	printf("%s,%s,%d,%" PRIu64 ",%.2f,%.3f\n", name, param, threads,
+		   ops, ns, 1000.0 / ns);
+	fflush(stdout);
+}
+
+/* ---------------------------------------------------------------------------
+   Multithreaded runner
+   -------------------------------------------------------------------------- */
+
+struct mt_bench {
+	void (* run)(void * arg, uint64_t ops);
+	void * arg;
+	uint64_t ops;
+	pthread_barrier_t barrier;
+};
+
+static void * mt_task(struct mt_bench * mt)
+{
+	pthread_barrier_wait(&mt->barrier);
+	mt->run(mt->arg, mt->ops);
+
+	return NULL;
+}
+
+/* Run 'ops' operations on each thread. Returns the elapsed time. */
+static uint64_t mt_run(struct mt_bench * mt, int threads)
+{
+	pthread_t thread[THREADS_MAX];
+	uint64_t t0;
+	int i;
+
+	pthread_barrier_init(&mt->barrier, NULL, threads + 1);
+
+	for (i = 0; i < threads; ++i)
+		pthread_create(&thread[i], NULL, (void * (*)(void *))mt_task,
+					   (void *)mt);
+
+	pthread_barrier_wait(&mt->barrier);
+	t0 = clock_ns();
+
+	for (i = 0; i < threads; ++i)
+		pthread_join(thread[i], NULL);
+
+	t0 = clock_ns() - t0;
+	pthread_barrier_destroy(&mt->barrier);
+
+	return t0;
+}
+
+/* ---------------------------------------------------------------------------
+   Clock heap
+   -------------------------------------------------------------------------- */
+
+enum {
+	CLK_UNIFORM, /* independent events spread over a window */
+	CLK_PERIODIC, /* nodes ticking at slightly different rates */
+	CLK_EXP /* Poisson arrivals, bursts of near simultaneous events */
+};
+
+static const char * clk_dist_nm[] = { "uniform", "periodic", "exp" };
+
+static uint64_t clk_next(int dist, int node, uint64_t clk, uint64_t * seed,
+						 struct exp_rand_state * exprnd)
+{
+	switch (dist) {
+	case CLK_UNIFORM:
+		return clk + (uint64_t)(unif_rand(seed) * 2 * MSEC);
+	case CLK_PERIODIC:
+		/* 1ms period, node dependent offset of up to 100ppm */
+		return clk + MSEC + (MSEC / 10000) * (node % 100) / 100;
+	case CLK_EXP:
+	default:
+		return clk + (uint64_t)(exp_rand(exprnd) * MSEC);
+	}
+}
+
+/* Hold model: each operation removes the earliest event and schedules
+   the next one for the same node, like the dispatcher does. */
+static void bench_heap(int dist, int size)
+{
+	struct exp_rand_state exprnd;
+	struct clk_heap * heap;
+	struct chime_event evt;
+	uint64_t seed = 1;
+	uint64_t ops = 1000000 * ops_scale;
+	uint64_t clk;
+	uint64_t t0;
+	char param[32];
+	uint64_t i;
+
+	heap = clk_heap_alloc(size + 1);
+	heap->clk = 0;
+	exp_rand_init(&exprnd, 1.0, 1);
+
+	memset(&evt, 0, sizeof(evt));
+	evt.opc = CHIME_EVT_TMR0;
+	for (i = 0; i < size; ++i) {
+		evt.node_id = i;
+		heap_insert_min(heap, clk_next(dist, i, 0, &seed, &exprnd), &evt);
+	}
+
+	t0 = clock_ns();
+	for (i = 0; i < ops; ++i) {
+		heap_minimum(heap, &clk, &evt);
+		heap_delete_min(heap);
+		heap->clk = clk;
+		heap_insert_min(heap, clk_next(dist, evt.node_id, clk, &seed,
+										&exprnd), &evt);
+	}
+	t0 = clock_ns() - t0;
+
+	sprintf(param, "%s/%d", clk_dist_nm[dist], size);
+	report("heap_hold", param, 1, ops, t0);
+
+	free(heap);
+}
+
+/* ---------------------------------------------------------------------------
+   Object pool
+   -------------------------------------------------------------------------- */
+
+static void obj_alloc_run(void * arg, uint64_t ops)
+{
+	uint64_t i;
+
+	for (i = 0; i < ops; ++i) {
+		void * obj = obj_alloc();
+
+		obj_incref(obj);
+		obj_decref(obj);
+		obj_decref(obj);
+	}
+}
+
+static void obj_shared_run(void * obj, uint64_t ops)
+{
+	uint64_t i;
+
+	for (i = 0; i < ops; ++i) {
+		obj_incref(obj);
+		obj_decref(obj);
+	}
+}
+
+static void bench_objpool(int threads)
+{
+	struct mt_bench mt;
+	char param[32];
+	void * obj;
+	uint64_t dt;
+
+	mt.ops = 200000 * ops_scale;
+
+	mt.run = obj_alloc_run;
+	mt.arg = NULL;
+	dt = mt_run(&mt, threads);
+	sprintf(param, "alloc_ref_free");
+	report("objpool", param, threads, mt.ops * threads, dt);
+
+	/* all threads hammering the same object */
+	obj = obj_alloc();
+	mt.run = obj_shared_run;
+	mt.arg = obj;
+	dt = mt_run(&mt, threads);
+	sprintf(param, "ref_shared");
+	report("objpool", param, threads, mt.ops * threads, dt);
+	obj_decref(obj);
+}
+
+/* ---------------------------------------------------------------------------
+   Memory block pool
+   -------------------------------------------------------------------------- */
+
+#define MEMBLK_BATCH 32
+
+static void memblk_run(struct mempool * pool, uint64_t ops)
+{
+	uint64_t i;
+
+	for (i = 0; i < ops; ++i)
+		memblk_free(pool, memblk_alloc(pool));
+}
+
+static void memblk_batch_run(struct mempool * pool, uint64_t ops)
+{
+	void * blk[MEMBLK_BATCH];
+	uint64_t i;
+	int j;
+
+	for (i = 0; i < ops; i += MEMBLK_BATCH) {
+		for (j = 0; j < MEMBLK_BATCH; ++j)
+			blk[j] = memblk_alloc(pool);
+		for (j = 0; j < MEMBLK_BATCH; ++j)
+			memblk_free(pool, blk[j]);
+	}
+}
+
+static void bench_mempool(int threads)
+{
+	struct mempool * pool;
+	struct mt_bench mt;
+	uint64_t dt;
+
+	pool = mempool_alloc(MEMBLK_BATCH * THREADS_MAX, 64);
+	mt.arg = pool;
+	mt.ops = 1000000 * ops_scale;
+
+	mt.run = (void (*)(void *, uint64_t))memblk_run;
+	dt = mt_run(&mt, threads);
+	report("mempool", "alloc_free", threads, mt.ops * threads, dt);
+
+	mt.run = (void (*)(void *, uint64_t))memblk_batch_run;
+	dt = mt_run(&mt, threads);
+	report("mempool", "batch32", threads, mt.ops * threads, dt);
+
+	mempool_free(pool);
+	free(pool);
+}
+
+/* ---------------------------------------------------------------------------
+   Random numbers
+   -------------------------------------------------------------------------- */
+
+static void bench_rand(void)
+{
+	struct exp_rand_state exprnd;
+	uint64_t ops = 5000000 * ops_scale;
+	uint64_t seed = 1;
+	double sum = 0;
+	uint64_t t0;
+	uint64_t i;
+
+	t0 = clock_ns();
+	for (i = 0; i < ops; ++i)
+		sum += unif_rand(&seed);
+	report("rand", "unif", 1, ops, clock_ns() - t0);
+
+	t0 = clock_ns();
+	for (i = 0; i < ops; ++i)
+		sum += norm_rand(&seed);
+	report("rand", "norm", 1, ops, clock_ns() - t0);
+
+	exp_rand_init(&exprnd, 1.0, 1);
+	t0 = clock_ns();
+	for (i = 0; i < ops; ++i)
+		sum += exp_rand(&exprnd);
+	report("rand", "exp", 1, ops, clock_ns() - t0);
+
+	sink = sum;
+}
+
+/* ---------------------------------------------------------------------------
+   Directory
+   -------------------------------------------------------------------------- */
+
+static void bench_dir(int cnt)
+{
+	uint64_t ops = 1000000 * ops_scale;
+	char (* hit)[ENTRY_NAME_MAX];
+	char (* miss)[ENTRY_NAME_MAX];
+	char param[32];
+	uint64_t t0;
+	uint64_t i;
+	int sum = 0;
+
+	/* format the names ahead, only the lookup is timed */
+	hit = malloc(cnt * ENTRY_NAME_MAX);
+	miss = malloc(cnt * ENTRY_NAME_MAX);
+
+	__dir_clear();
+	for (i = 0; i < cnt; ++i) {
+		sprintf(hit[i], "COMM%d", (int)i);
+		sprintf(miss[i], "VAR%d", (int)i);
+		__dir_insert(hit[i], i + 1);
+	}
+
+	t0 = clock_ns();
+	for (i = 0; i < ops; ++i)
+		sum += __dir_lookup(hit[i % cnt]);
+	t0 = clock_ns() - t0;
+	sprintf(param, "hit/%d", cnt);
+	report("dir_lookup", param, 1, ops, t0);
+
+	t0 = clock_ns();
+	for (i = 0; i < ops; ++i)
+		sum += __dir_lookup(miss[i % cnt]);
+	t0 = clock_ns() - t0;
+	sprintf(param, "miss/%d", cnt);
+	report("dir_lookup", param, 1, ops, t0);
+
+	free(hit);
+	free(miss);
+	sink = sum;
+}
+
+/* ---------------------------------------------------------------------------
+   Sorted lists
+   -------------------------------------------------------------------------- */
+
+static void bench_u8_list(int cnt)
+{
+	uint64_t ops = 2000000 * ops_scale;
+	uint8_t lst[256];
+	char param[32];
+	uint64_t t0;
+	uint64_t i;
+	int sum = 0;
+
+	/* even keys in the list, odd keys for insertion */
+	u8_list_init(lst);
+	for (i = 0; i < cnt; ++i)
+		u8_list_insert(lst, i * 2);
+
+	t0 = clock_ns();
+	for (i = 0; i < ops; ++i)
+		sum += u8_list_contains(lst, (i * 7) % (cnt * 2));
+	t0 = clock_ns() - t0;
+	sprintf(param, "contains/%d", cnt);
+	report("u8_list", param, 1, ops, t0);
+
+	t0 = clock_ns();
+	for (i = 0; i < ops; ++i) {
+		unsigned int key = ((i * 2) % cnt) * 2 + 1;
+
+		u8_list_insert(lst, key);
+		u8_list_remove(lst, key);
+	}
+	t0 = clock_ns() - t0;
+	sprintf(param, "insert_remove/%d", cnt);
+	report("u8_list", param, 1, ops, t0);
+
+	sink = sum;
+}
+
+static void bench_u16_list(int cnt)
+{
+	uint64_t ops = 2000000 * ops_scale;
+	uint16_t * lst;
+	char param[32];
+	uint64_t t0;
+	uint64_t i;
+	int sum = 0;
+
+	lst = malloc((cnt + 2) * sizeof(uint16_t));
+	u16_list_init(lst);
+	for (i = 0; i < cnt; ++i)
+		u16_list_insert(lst, i * 2);
+
+	t0 = clock_ns();
+	for (i = 0; i < ops; ++i)
+		sum += u16_list_contains(lst, (i * 7) % (cnt * 2));
+	t0 = clock_ns() - t0;
+	sprintf(param, "contains/%d", cnt);
+	report("u16_list", param, 1, ops, t0);
+
+	t0 = clock_ns();
+	for (i = 0; i < ops; ++i) {
+		unsigned int key = ((i * 2) % cnt) * 2 + 1;
+
+		u16_list_insert(lst, key);
+		u16_list_remove(lst, key);
+	}
+	t0 = clock_ns() - t0;
+	sprintf(param, "insert_remove/%d", cnt);
+	report("u16_list", param, 1, ops, t0);
+
+	free(lst);
+	sink = sum;
+}
+
+/* ---------------------------------------------------------------------------
+   Main
+   -------------------------------------------------------------------------- */
+
+static void show_usage(const char * prog)
+{
+	fprintf(stderr, "Usage: %s [-n SCALE] [-t THREADS] [-f FILTER]\n", prog);
+	fprintf(stderr, "  -n SCALE    multiply the operations count\n");
+	fprintf(stderr, "  -t THREADS  maximum number of threads (default 4)\n");
+	fprintf(stderr, "  -f FILTER   run only the benchmarks containing FILTER\n");
+	fprintf(stderr, "\n");
+}
+
+int main(int argc, char *argv[])
+{
+	static const int heap_size[] = { 16, 64, 256, 1024 };
+	static const int dir_cnt[] = { 16, 256, 2048 };
+	static const int u8_cnt[] = { 8, 64, 200 };
+	static const int u16_cnt[] = { 8, 256, 4096 };
+	char name[64];
+	int threads;
+	int dist;
+	int i;
+	int c;
+
+	while ((c = getopt(argc, argv, "n:t:f:h")) > 0) {
+		switch (c) {
+		case 'n':
+			ops_scale = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			threads_max = strtoul(optarg, NULL, 0);
+			break;
+		case 'f':
+			filter = optarg;
+			break;
+		default:
+			show_usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if ((ops_scale < 1) || (threads_max < 1) || (threads_max > THREADS_MAX)) {
+		show_usage(argv[0]);
+		return 1;
+	}
+
+	printf("# libchime microbenchmarks\n");
+	printf("name,param,threads,ops,ns_per_op,mops\n");
+
+	if (bench_enabled("heap_hold")) {
+		for (dist = CLK_UNIFORM; dist <= CLK_EXP; ++dist) {
+			for (i = 0; i < sizeof(heap_size) / sizeof(int); ++i)
+				bench_heap(dist, heap_size[i]);
+		}
+	}
+
+	if (bench_enabled("objpool") || bench_enabled("dir_lookup")) {
+		sprintf(name, "chime-bench.%d", getpid());
+		if ((objpool_create(name, 256) < 0) || (__dir_create(name) < 0)) {
+			fprintf(stderr, "shared memory setup failed!\n");
+			return 2;
+		}
+
+		if (bench_enabled("objpool")) {
+			for (threads = 1; threads <= threads_max; threads *= 2)
+				bench_objpool(threads);
+		}
+
+		if (bench_enabled("dir_lookup")) {
+			for (i = 0; i < sizeof(dir_cnt) / sizeof(int); ++i)
+				bench_dir(dir_cnt[i]);
+		}
+
+		__dir_close();
+		__dir_destroy();
+		objpool_close();
+		objpool_destroy();
+	}
+
+	if (bench_enabled("mempool")) {
+		for (threads = 1; threads <= threads_max; threads *= 2)
+			bench_mempool(threads);
+	}
+
+	if (bench_enabled("rand"))
+		bench_rand();
+
+	if (bench_enabled("u8_list")) {
+		for (i = 0; i < sizeof(u8_cnt) / sizeof(int); ++i)
+			bench_u8_list(u8_cnt[i]);
+	}
+
+	if (bench_enabled("u16_list")) {
+		for (i = 0; i < sizeof(u16_cnt) / sizeof(int); ++i)
+			bench_u16_list(u16_cnt[i]);
+	}
+
+	return 0;
+}
+
@@ -51,6 +51,7 @@ void show_help(void)
 	printf("  [p] - pause simulation\n");
 	printf("  [q] - quit\n");
 	printf("  [r] - resume simulation\n");
+	printf("  [s] - slowest CPUs\n");
 	printf("  [v] - dump variables\n");
 	printf("  [y] - reset all CPUs and COMMs\n");
 	printf("\n");
@@ -163,6 +164,11 @@ int main(int argc, char *argv[])
 			chime_server_info(stdout);
 			break;
 
+		case 's':
+			printf("--- Slowest CPUs ---\n");
+			chime_server_cpu_prof(stdout, 10);
+			break;
+
 		case 'h':
 			show_help();
 			break;
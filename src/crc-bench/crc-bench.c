@@ -0,0 +1,211 @@
+/*
+   crc-bench.c
+   ARCnet CRC-16 kernels check and microbenchmark
+   Copyright(C) 2013 Robinson Mittmann.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+   First every CRC-16 implementation supported by the host is checked
+   bit for bit against the byte-wise table (fx_crc16_lut()), for all
+   the lengths of a PAC frame at every alignment. The program exits
+   with an error on any mismatch.
+
+   Then each implementation is timed over PAC info field sizes. Results
+   are printed as CSV, in the same format as the bench program:
+
+     name,param,threads,ops,ns_per_op,mops
+
+   where param is the buffer length in bytes.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <time.h>
+
+#include "fx-net.h"
+
+/* PAC info field plus FCS */
+#define PAC_LEN_MAX (252 + 2)
+
+#define SIZES_MAX 16
+
+static unsigned int (* const crc16_impl[FX_CRC16_IMPL_CNT])
+	(const void *, size_t) = {
+	[FX_CRC16_LUT] = fx_crc16_lut,
+	[FX_CRC16_SB8] = fx_crc16_sb8,
+	[FX_CRC16_CLMUL] = fx_crc16_clmul
+};
+
+static uint64_t ops_scale = 1;
+
+/* keep the compiler from discarding results */
+static volatile unsigned int sink;
+
+static inline uint64_t clock_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static bool crc16_check(int impl)
+{
+	uint8_t buf[PAC_LEN_MAX + 8];
+	unsigned int ref;
+	unsigned int crc;
+	int round;
+	int offs;
+	int len;
+	int i;
+
+	for (round = 0; round < 16; ++round) {
+		for (i = 0; i < sizeof(buf); ++i)
+			buf[i] = (round == 0) ? 0xff : rand();
+
+		for (offs = 0; offs < 8; ++offs) {
+			for (len = 0; len <= PAC_LEN_MAX; ++len) {
+				ref = fx_crc16_lut(&buf[offs], len);
+				crc = crc16_impl[impl](&buf[offs], len);
+				if (crc != ref) {
+					fprintf(stderr, "%s: len=%d offs=%d: 0x%04x != 0x%04x\n",
+							fx_crc16_name(impl), len, offs, crc, ref);
+					return false;
+				}
+			}
+		}
+	}
+
+	/* the dispatcher must agree as well */
+	if (fx_crc16(buf, PAC_LEN_MAX) != fx_crc16_lut(buf, PAC_LEN_MAX)) {
+		fprintf(stderr, "fx_crc16(): mismatch\n");
+		return false;
+	}
+
+	return true;
+}
+
+static void bench_crc16(int impl, int len)
+{
+	uint8_t buf[PAC_LEN_MAX];
+	uint64_t ops = 2000000 * ops_scale;
+	unsigned int crc = 0;
+	uint64_t t0;
+	uint64_t dt;
+	uint64_t i;
+	char name[64];
+
+	for (i = 0; i < len; ++i)
+		buf[i] = rand();
+
+	/* warm up */
+	for (i = 0; i < 1000; ++i)
+		crc += crc16_impl[impl](buf, len);
+
+	t0 = clock_ns();
+	for (i = 0; i < ops; ++i) {
+		/* chain the results so the calls can't be hoisted */
+		buf[0] ^= crc;
+		crc = crc16_impl[impl](buf, len);
+	}
+	dt = clock_ns() - t0;
+	sink = crc;
+
+	sprintf(name, "crc16_%s", fx_crc16_name(impl));
+	printf("%s,%d,1,%" PRIu64 ",%.2f,%.2f\n", name, len, ops,
+		   (double)dt / ops, (ops * 1000.0) / dt);
+	fflush(stdout);
+}
+
+static void show_usage(const char * prog)
+{
+	fprintf(stderr, "Usage: %s [-n SCALE] [-l LIST]\n", prog);
+	fprintf(stderr, "  -n SCALE    multiply the operations count\n");
+	fprintf(stderr, "  -l LIST     buffer lengths (default 4,8,16,32,64,128,"
+			"252,254)\n");
+	fprintf(stderr, "\n");
+}
+
+int main(int argc, char *argv[])
+{
+	int size[SIZES_MAX] = { 4, 8, 16, 32, 64, 128, 252, 254 };
+	int size_cnt = 8;
+	char * tok;
+	int impl;
+	int c;
+	int i;
+
+	while ((c = getopt(argc, argv, "n:l:h")) > 0) {
+		switch (c) {
+		case 'n':
+			ops_scale = strtoul(optarg, NULL, 0);
+			break;
+		case 'l':
+			size_cnt = 0;
+			for (tok = strtok(optarg, ","); tok && size_cnt < SIZES_MAX;
+				 tok = strtok(NULL, ","))
+				size[size_cnt++] = strtoul(tok, NULL, 0);
+			break;
+		default:
+			show_usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (ops_scale < 1) {
+		show_usage(argv[0]);
+		return 1;
+	}
+
+	for (i = 0; i < size_cnt; ++i) {
+		if ((size[i] < 1) || (size[i] > PAC_LEN_MAX)) {
+			fprintf(stderr, "invalid length: %d\n", size[i]);
+			return 1;
+		}
+	}
+
+	srand(1);
+
+	printf("# ARCnet CRC-16 microbenchmarks\n");
+
+	for (impl = 0; impl < FX_CRC16_IMPL_CNT; ++impl) {
+		if (!fx_crc16_supported(impl)) {
+			printf("# %s: not supported\n", fx_crc16_name(impl));
+			continue;
+		}
+		if (!crc16_check(impl))
+			return 2;
+		printf("# %s: ok\n", fx_crc16_name(impl));
+	}
+
+	printf("name,param,threads,ops,ns_per_op,mops\n");
+
+	for (impl = 0; impl < FX_CRC16_IMPL_CNT; ++impl) {
+		if (!fx_crc16_supported(impl))
+			continue;
+		for (i = 0; i < size_cnt; ++i)
+			bench_crc16(impl, size[i]);
+	}
+
+	return 0;
+}
+
@@ -33,6 +33,15 @@ struct trace_entry {
  * Chime communication channels 
  *****************************************************************************/
 
+/* COMM broadcast address */
+#define COMM_ADDR_BCAST 0
+
+/* COMM medium access models */
+enum {
+	COMM_MAC_RANDOM = 0, /* random delay: min_delay, max_jitter, nod_delay */
+	COMM_MAC_TOKEN = 1 /* token passing logical ring, ordered by node id */
+};
+
 struct comm_attr {
 	uint32_t wr_cyc_per_byte;
 	uint32_t wr_cyc_overhead;
@@ -50,6 +59,20 @@ struct comm_attr {
 	bool txbuf_en; /* enable buffering for transmission */
 	bool dcd_en; /* enable data carrier detect */
 	bool exp_en; /* enable exponential distribution */
+	uint8_t mac; /* medium access model */
+	uint16_t tok_bits; /* token MAC: bits to pass the token */
+	uint16_t ack_bits; /* token MAC: handshake bits for each frame */
+};
+
+/* COMM live counters */
+struct chime_comm_stat {
+	uint64_t frames;
+	uint64_t bytes;
+	double busy; /* seconds the medium was busy */
+	float util; /* utilization over the last second (percent) */
+	float util_peak;
+	uint32_t inflight_max; /* frames in flight at the same time */
+	uint32_t drops; /* frames rejected with the transmitter busy */
 };
 
 /*****************************************************************************
@@ -112,6 +135,30 @@ void chime_msleep(unsigned int ms);
 
 void chime_app_init(void (* on_cleanup)(void));
 
+/* Select the IPC transport: "mq" (POSIX message queues) or "unix" 
+   (Unix domain datagram sockets). Must be called before starting the
+   server or client, all the processes must use the same transport.
+   The default comes from the CHIME_TRANSPORT environment variable. */
+int chime_transport_set(const char * name);
+
+/* Thread placement policies */
+enum {
+	CHIME_AFFINITY_NONE = 0, /* let the OS scheduler decide */
+	CHIME_AFFINITY_ROUND_ROBIN, /* spread CPU threads across NUMA nodes */
+	CHIME_AFFINITY_PACKED /* fill one NUMA node before the next */
+};
+
+/* Set this process' thread placement. The server dispatcher is pinned
+   to 'ctrl_core' (-1 to leave it free), which is then not used for CPU 
+   threads. Must be called before starting the server or client. */
+int chime_affinity_set(int policy, int ctrl_core);
+
+/* Run this process' CPUs as coroutines over 'workers' threads instead 
+   of one thread per CPU (0: disabled, -1: one per processor). The CPU 
+   code must not keep its state in thread local variables. Must be called
+   before creating the CPUs. */
+int chime_executor_set(int workers);
+
 /*****************************************************************************
  * Chime CPU
  *****************************************************************************/
@@ -145,6 +192,17 @@ bool chime_cpu_temp_set(float temp);
 
 float chime_cpu_temp_get(void);
 
+/* Temperature profiles. The server changes the CPU temperature as the 
+   simulation runs, re-timing the pending events only at the profile
+   breakpoints. Times are in seconds from the call. A profile is 
+   cancelled by chime_cpu_temp_set() or by a CPU reset. */
+bool chime_cpu_temp_piecewise(const float time[], const float temp[], 
+							  int cnt, bool repeat);
+
+bool chime_cpu_temp_sine(float mean, float ampl, float period);
+
+bool chime_cpu_temp_table(const char * path, bool repeat);
+
 int chime_cpu_var_open(const char * name);
 
 float chime_cpu_freq_get(void);
@@ -169,6 +227,18 @@ void chime_tmr_stop(int tmr_id);
 
 uint32_t chime_tmr_count(int tmr_id);
 
+/* Server managed timers. Unlike the hardware timers above their 
+   number is not limited, they are created by the reset handler and 
+   identified by the returned handle. The ISR is called with 'arg'. */
+
+int chime_timer_create(void (* isr)(void *), void * arg);
+
+/* Arm a timer to expire in 'timeout' CPU cycles, then every 'period' 
+   cycles if not 0. Re-arming a pending timer restarts it. */
+void chime_timer_arm(int handle, uint32_t timeout, uint32_t period);
+
+void chime_timer_cancel(int handle);
+
 /*****************************************************************************
  * Communications API
  *****************************************************************************/
@@ -179,15 +249,28 @@ int chime_comm_attach(int chan, const char * name,
 					  void (* rcv_isr)(void), void (* eot_isr)(void),
 					  void (* dcd_isr)(void));
 
+/* broadcast a frame */
 int chime_comm_write(int chan, const void * buf, size_t len);
 
+/* send a frame to the nodes with address 'dst' */
+int chime_comm_write_to(int chan, int dst, const void * buf, size_t len);
+
+/* set the address of this node, by default the CPU id */
+int chime_comm_addr_set(int chan, int addr);
+
 int chime_comm_read(int chan, void * buf, size_t len);
 
 int chime_comm_close(int chan);
 
+/* return false if the last frame transmitted was not acknowledged */
+bool chime_comm_tx_ack(int chan);
+
 /* return the number of nodes connected to the COMM channel */
 int chime_comm_nodes(int chan);
 
+/* read the live counters of a COMM */
+int chime_comm_stat(const char * name, struct chime_comm_stat * stat);
+
 /*****************************************************************************
  * Variables
  *****************************************************************************/
@@ -202,12 +285,26 @@ bool chime_var_rec(int oid, double value);
  * Chime Server
  *****************************************************************************/
 
+/* Simulation progress counters */
+struct chime_sim_stat {
+	double time; /* simulation time in seconds */
+	uint64_t evt_cnt; /* events dispatched */
+	uint32_t step_cnt; /* dispatcher steps */
+	float heap_avg; /* average clock heap length per step */
+	uint32_t heap_peak; /* longest clock heap */
+	bool paused;
+};
+
 int chime_server_start(const char * ctrl_fifo);
 
 int chime_server_stop(void);
 
 void chime_server_info(FILE * f);
 
+/* List the CPUs with the highest wall time per simulated second. 
+   Up to 'max' nodes are listed, all of them if 'max' is zero. */
+void chime_server_cpu_prof(FILE * f, int max);
+
 void chime_server_resume(void);
 
 void chime_server_pause(void);
@@ -224,12 +321,88 @@ void chime_trace_dump(struct trace_entry * entry);
 
 void chime_server_comm_stat(void);
 
-void chime_server_var_dump(void);
+/* read the live counters of a node on a COMM */
+int chime_server_comm_node_stat(const char * name, int node_id, 
+								struct chime_comm_stat * stat);
+
+/* Write all the variable recorders to files and wait for completion,
+   -1 if the server doesn't respond within 'CHIME_VAR_DUMP_TMO_MS' */
+#define CHIME_VAR_DUMP_TMO_MS 10000
+
+int chime_server_var_dump(void);
+
+/* Sample the simulation progress, can be called while running */
+void chime_server_stat(struct chime_sim_stat * stat);
+
+/* Pause the simulation when it reaches the given time (seconds) or 
+   the given number of events. Zero disables the condition. */
+void chime_server_stop_at(double time, uint64_t events);
 
 int chime_trace_dump_start(void);
 
 int chime_trace_dump_stop(void);
 
+/*****************************************************************************
+ * Live state
+ *****************************************************************************/
+
+enum chime_node_state {
+	CHIME_NODE_NONE = 0, /* no node */
+	CHIME_NODE_WAIT, /* checked in, waiting for an event */
+	CHIME_NODE_RUN /* dispatched, running */
+};
+
+#define CHIME_LIVE_NODE_MAX 256
+#define CHIME_LIVE_COMM_MAX 32
+#define CHIME_LIVE_NAME_MAX 32
+
+struct chime_live_node {
+	uint8_t id;
+	uint8_t state;
+	float temperature;
+	uint64_t ticks; /* CPU cycles */
+	double time; /* node clock in seconds */
+	uint32_t evt_cnt; /* events handled */
+	float load; /* wall time per simulated second */
+	char name[CHIME_LIVE_NAME_MAX];
+};
+
+struct chime_live_comm {
+	char name[CHIME_LIVE_NAME_MAX];
+	float util; /* utilization over the last second (percent) */
+	float util_peak;
+	uint64_t frm_cnt;
+	uint32_t drop_cnt;
+};
+
+struct chime_live {
+	double time; /* simulation time in seconds */
+	uint64_t evt_cnt; /* events dispatched */
+	uint32_t step_cnt; /* dispatcher steps */
+	uint32_t heap_len; /* clock heap length */
+	uint32_t heap_peak;
+	float speed; /* simulated over wall time */
+	float speed_set; /* requested speed */
+	uint32_t tick_lost; /* simulation lagging the timer */
+	bool paused;
+	uint32_t pool_alloc; /* shared objects in use */
+	uint32_t pool_size;
+	int comm_cnt;
+	struct chime_live_comm comm[CHIME_LIVE_COMM_MAX];
+	int node_cnt;
+	struct chime_live_node node[CHIME_LIVE_NODE_MAX];
+};
+
+/* Attach to the live state page of a running server. Reading it 
+   sends no requests to the server and doesn't pause the simulation. */
+int chime_live_open(const char * name);
+
+void chime_live_close(void);
+
+/* Take a consistent snapshot of the live state. Only the existing 
+   nodes are copied. */
+int chime_live_read(struct chime_live * live);
+
 /*****************************************************************************
  * Chime Management
  *****************************************************************************/
@@ -37,6 +37,30 @@
 /* Q1.31 division */
 #define Q31_DIV(NUM, DEN) ((int32_t)(((int64_t)(NUM) << 31) / (int32_t)(DEN)))
 
+#ifndef CLOCK_DRIFT_MAX
+//#define CLOCK_DRIFT_MAX FLOAT_Q31(0.000200)
+/* FIXME: change the max drift to 200ppm */
+#define CLOCK_DRIFT_MAX FLOAT_Q31(0.000500)
+#endif
+
+/* Structure of arrays clock. Each lane is an independent local clock 
+   driven by the same tick timer, used to evaluate many loop 
+   configurations in lockstep. */
+
+#define CLOCK_SOA_MAX 64
+
+struct clock_soa {
+	int n; /* number of lanes */
+	uint32_t resolution;
+	int32_t n_freq;
+	int32_t q_freq;
+	float tmr_fk;
+	uint64_t ts[CLOCK_SOA_MAX] __attribute__((aligned(32)));
+	uint64_t offset[CLOCK_SOA_MAX] __attribute__((aligned(32)));
+	uint32_t increment[CLOCK_SOA_MAX] __attribute__((aligned(32)));
+	int32_t drift_comp[CLOCK_SOA_MAX] __attribute__((aligned(32)));
+};
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -70,6 +94,54 @@ int32_t clock_drift_comp(int32_t drift, int32_t est_err);
 /* Initialize the clock */ 
 void clock_init(uint32_t tick_itvl, unsigned int hw_tmr);
 
+/****************************************************************************
+ * Structure of arrays clock functions. The hardware timer count 'cnt'
+ * is passed by the caller.
+ ****************************************************************************/
+
+void clock_soa_init(struct clock_soa * clk, int n, uint32_t tick_itvl);
+
+uint64_t clock_soa_tick(struct clock_soa * clk);
+
+static inline uint64_t clock_soa_monotonic_get(struct clock_soa * clk, 
+											   int i, uint32_t cnt) {
+	uint32_t dt = (float)cnt * clk->increment[i] * clk->tmr_fk;
+	return clk->ts[i] + dt;
+}
+
+static inline uint64_t clock_soa_realtime_get(struct clock_soa * clk, 
+											  int i, uint32_t cnt) {
+	return clock_soa_monotonic_get(clk, i, cnt) + clk->offset[i];
+}
+
+static inline void clock_soa_time_set(struct clock_soa * clk, int i, 
+									  uint64_t ts, uint32_t cnt) {
+	clk->offset[i] = (int64_t)(ts - clock_soa_monotonic_get(clk, i, cnt));
+}
+
+static inline void clock_soa_step(struct clock_soa * clk, int i, int64_t dt) {
+	clk->offset[i] += dt;
+}
+
+/* Same as clock_drift_comp() for lane 'i' */
+static inline int32_t clock_soa_drift_comp(struct clock_soa * clk, int i, 
+										   int32_t drift) {
+	int32_t clk_d;
+	int32_t q31_d;
+
+	if (drift > CLOCK_DRIFT_MAX)
+		drift = CLOCK_DRIFT_MAX;
+	else if (drift < -CLOCK_DRIFT_MAX)
+		drift = -CLOCK_DRIFT_MAX;
+
+	clk_d = Q31_MUL(drift, clk->resolution);
+	q31_d = CLK_Q31(clk_d);
+	clk->drift_comp[i] = q31_d;
+	clk->increment[i] = clk->resolution + clk_d;
+
+	return q31_d * clk->n_freq + Q31_MUL(q31_d, clk->q_freq);
+}
+
 
 /****************************************************************************
  * Utility functions 
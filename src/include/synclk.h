@@ -7,7 +7,16 @@
    Clock FLL synchronization 
  */
 
+/* FLL coefficients */
+struct fll_coef {
+	int32_t kp; /* attack gain (divider) */
+	int32_t kd; /* decay gain (divider) */
+	uint32_t edge_win; /* edge filter window (seconds) */
+	uint32_t calc_win; /* initial frequency calculation window (seconds) */
+};
+
 struct clock_fll {
+	const struct fll_coef * coef;
 	int32_t clk_err[2]; /* phase error */
 	int32_t clk_acc; /* phase compensation accoumulator */
 	int32_t clk_drift;
@@ -32,7 +41,26 @@ struct clock_fll {
    Clock PLL synchronization 
  */
 
+/* PLL coefficients */
+struct pll_coef {
+	/* 1st order IIR low pass (Q1.31) */
+	int32_t a;
+	int32_t b;
+	/* 2nd order IIR low pass (Q1.31), a0 is an integer scale factor */
+	int32_t a0;
+	int32_t a1;
+	int32_t a2;
+	int32_t b0;
+	int32_t b1;
+	int32_t b2;
+	/* loop gains (dividers) */
+	int32_t kd; /* reference decay */
+	int32_t kp; /* proportional */
+	int32_t ki; /* integral */
+};
+
 struct clock_pll {
+	const struct pll_coef * coef;
 	int32_t drift;
 	int32_t err;
 	int32_t ref;
@@ -51,6 +79,27 @@ struct clock_pll {
 	} stat;
 };
 
+/* Structure of arrays PLL. Each lane runs the PLL algorithm against 
+   the same lane of a 'struct clock_soa'. The loop gains must be powers 
+   of two. */
+struct clock_pll_soa {
+	int n; /* number of lanes */
+	int32_t drift[CLOCK_SOA_MAX] __attribute__((aligned(32)));
+	int32_t ref[CLOCK_SOA_MAX] __attribute__((aligned(32)));
+	int32_t offs[CLOCK_SOA_MAX] __attribute__((aligned(32)));
+	int32_t ierr[CLOCK_SOA_MAX] __attribute__((aligned(32)));
+	/* 1st order IIR state */
+	int32_t x1[CLOCK_SOA_MAX] __attribute__((aligned(32)));
+	int32_t y1[CLOCK_SOA_MAX] __attribute__((aligned(32)));
+	/* per lane coefficients */
+	int32_t a[CLOCK_SOA_MAX] __attribute__((aligned(32)));
+	int32_t b[CLOCK_SOA_MAX] __attribute__((aligned(32)));
+	/* loop gains as shift amounts */
+	int32_t kd_s[CLOCK_SOA_MAX] __attribute__((aligned(32)));
+	int32_t kp_s[CLOCK_SOA_MAX] __attribute__((aligned(32)));
+	int32_t ki_s[CLOCK_SOA_MAX] __attribute__((aligned(32)));
+	uint32_t step_cnt[CLOCK_SOA_MAX];
+};
 
 /* 
    Clock filter 
@@ -110,6 +159,21 @@ void pll_step(struct clock_pll  * pll);
 
 void pll_phase_adjust(struct clock_pll  * pll, int64_t offs, int64_t itvl);
 
+void pll_coef_set(struct clock_pll  * pll, const struct pll_coef * coef);
+
+extern const struct pll_coef pll_coef_default;
+
+void pll_soa_init(struct clock_pll_soa * pll, int n);
+
+int pll_soa_coef_set(struct clock_pll_soa * pll, int i, 
+					 const struct pll_coef * coef);
+
+void pll_soa_step(struct clock_pll_soa * pll, struct clock_soa * clk, 
+				  uint64_t mask);
+
+void pll_soa_phase_adjust(struct clock_pll_soa * pll, struct clock_soa * clk,
+						  const int64_t offs[], uint64_t mask);
+
 /****************************************************************************
  * Clock FLL (Frequency Locked Loop) functions 
  ****************************************************************************/
@@ -120,6 +184,10 @@ void fll_reset(struct clock_fll  * fll, uint64_t ref_ts);
 
 void fll_init(struct clock_fll  * fll, int64_t err_max);
 
+void fll_coef_set(struct clock_fll  * fll, const struct fll_coef * coef);
+
+extern const struct fll_coef fll_coef_default;
+
 /****************************************************************************
  * Clock filter functions 
  ****************************************************************************/
@@ -1,13 +1,39 @@
+/*
+   ipc-benchmark.c
+   Event transport latency and throughput benchmark
+
+   Each pair is a client and a server exchanging fixed size messages in
+   ping-pong. The client timestamps every round trip, the results of all
+   pairs are merged to compute the latency percentiles. The aggregated
+   round trip rate of the pairs gives the throughput.
+
+   Transports:
+     mq     - POSIX message queues (libchime __mq_xxx())
+     unix   - Unix domain datagram sockets (libchime __mq_xxx())
+     pipe   - anonymous pipes
+     eventfd - shared memory slot, eventfd notification
+     futex  - shared memory slot, futex notification on every message
+     ring   - shared memory SPSC ring, spin then block on a futex
+     mutex  - shared memory slot, pthread mutex and condition variable
+ */
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <errno.h>
-#include <sys/time.h>
+#include <time.h>
 #include <signal.h>
 #include <unistd.h>
 #include <pthread.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
 
 #include "debug.h"
 
@@ -15,299 +41,547 @@
 #include "chime-i.h"
 
 #define MSG_EVENT 0
-#define MSG_START 1
-#define MSG_SYNC  2
-#define MSG_STOP  3
+#define MSG_STOP  1
+
+#define MSG_SIZE_MAX 1024
+
+#define PAIRS_MAX 64
+
+/* Ring buffer slots */
+#define RING_SLOTS 16
+/* Polls before blocking on an empty ring */
+#define RING_SPIN_MAX 4000
 
-#define MSG_SIZE 8
+/* Spinning only burns the peer's time slice on a single processor */
+static int ring_spin = RING_SPIN_MAX;
 
 #ifndef ENABLE_SERVER_THREAD
 #define ENABLE_SERVER_THREAD 1
 #endif
 
-void print_stats(struct timeval * start, struct timeval * end, 
-				 int count, int msg_size)
+/* ---------------------------------------------------------------------------
+   Channels
+   -------------------------------------------------------------------------- */
+
+/* Single message slot */
+struct mbox {
+	volatile uint32_t seq; /* futex word */
+	uint32_t len;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	uint8_t buf[MSG_SIZE_MAX];
+};
+
+/* Single producer, single consumer ring */
+struct ring {
+	volatile uint32_t head; /* futex word */
+	uint8_t pad0[60];
+	volatile uint32_t tail;
+	volatile uint32_t waiting;
+	uint8_t pad1[56];
+	struct {
+		uint32_t len;
+		uint8_t buf[MSG_SIZE_MAX];
+	} slot[RING_SLOTS];
+};
+
+/* One direction of a pair */
+struct chan {
+	char name[32];
+	__mq_t rd;
+	__mq_t wr;
+	int fd[2];
+	uint32_t seq; /* last slot sequence received */
+	struct mbox * mbox;
+	struct ring * ring;
+};
+
+struct transport {
+	const char * name;
+	int (* open)(struct chan * ch, int size);
+	void (* close)(struct chan * ch);
+	int (* send)(struct chan * ch, const void * msg, int len);
+	int (* recv)(struct chan * ch, void * msg, int len);
+};
+
+/* Allocate memory that survives a fork() */
+static void * shared_alloc(size_t size)
 {
-	unsigned int size;
-	double dt;
+	void * ptr;
 
-	dt = (double)(end->tv_sec - start->tv_sec) + 
-		((double)(end->tv_usec - start->tv_usec) / 1000000.0);
+	ptr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+			   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
 
-	size = count * msg_size;
+	return (ptr == MAP_FAILED) ? NULL : ptr;
+}
 
-	printf("   %7.2f secs, %7.1f Msgs/s, %7.1f KiB/s\n", dt, 
-		   count / dt, (size / dt) / 1024);
-	fflush(stdout);
+static void shared_free(void * ptr, size_t size)
+{
+	if (ptr != NULL)
+		munmap(ptr, size);
 }
 
 /* ---------------------------------------------------------------------------
-   Message queue
+   Message queue (POSIX mq or Unix sockets, see __mq_transport_set())
    -------------------------------------------------------------------------- */
 
-const char * mq_req_name = "mq_request";
-const char * mq_rep_name = "mq_reply";
-
-int mq_client(int cnt)
+static int mq_open_(struct chan * ch, int size)
 {
-	struct timeval start;
-	struct timeval end;
-	__mq_t mq_req;
-	__mq_t mq_rep;
-	uint32_t msg[MSG_SIZE / 2 + 1];
-	int i;
-
-	printf(" - Message queue client...\n");
-	fflush(stdout);
-
-	INF("creating reply message queue ...");
-	__mq_unlink(mq_rep_name);
-	if (__mq_create(&mq_rep, mq_rep_name, MSG_SIZE) < 0) {
-		ERR("__mq_create(\"%s\") failed: %s.", mq_rep_name, __strerr());
+	__mq_unlink(ch->name);
+	if (__mq_create(&ch->rd, ch->name, size) < 0) {
+		ERR("__mq_create(\"%s\") failed: %s.", ch->name, __strerr());
 		return -1;
 	}
 
-	INF("Openning request message queue...");
-	if (__mq_open(&mq_req, mq_req_name) < 0) {
-		ERR("__mq_open(\"%s\") failed: %s.", mq_req_name, __strerr());
+	if (__mq_open(&ch->wr, ch->name) < 0) {
+		ERR("__mq_open(\"%s\") failed: %s.", ch->name, __strerr());
+		__mq_close(ch->rd);
+		__mq_unlink(ch->name);
 		return -1;
 	}
 
-	msg[0] = MSG_START;
-	msg[1] = 0;
+	return 0;
+}
+
+static void mq_close_(struct chan * ch)
+{
+	__mq_close(ch->wr);
+	__mq_close(ch->rd);
+	__mq_unlink(ch->name);
+}
 
-	INF("Start handshake...");
-	if (__mq_send(mq_req, msg, MSG_SIZE) < 0) {
-		ERR("__mq_send() failed: %s.", __strerr());
-		return -1;
-	}
+static int mq_send_(struct chan * ch, const void * msg, int len)
+{
+	return __mq_send(ch->wr, msg, len);
+}
+
+static int mq_recv_(struct chan * ch, void * msg, int len)
+{
+	return __mq_recv(ch->rd, msg, len);
+}
+
+/* ---------------------------------------------------------------------------
+   Pipe
+   -------------------------------------------------------------------------- */
 
-	if (__mq_recv(mq_rep, msg, MSG_SIZE) < 0) {
-		ERR("__mq_recv() failed: %s.", __strerr());
+static int pipe_open(struct chan * ch, int size)
+{
+	if (pipe(ch->fd) < 0) {
+		ERR("pipe() failed: %s.", __strerr());
 		return -1;
 	}
 
-	gettimeofday(&start, NULL);
-	for (i = 0; i < cnt; i++) {
-		msg[0] = MSG_EVENT;
-		msg[1] = i;
+	return 0;
+}
 
-		if (__mq_send(mq_req, msg, MSG_SIZE) < 0) {
-			ERR("__mq_send() failed: %s.", __strerr());
-			return -1;
-		}
+static void pipe_close(struct chan * ch)
+{
+	close(ch->fd[0]);
+	close(ch->fd[1]);
+}
+
+static int pipe_send(struct chan * ch, const void * msg, int len)
+{
+	/* writes up to PIPE_BUF are atomic */
+	return write(ch->fd[1], msg, len);
+}
+
+static int pipe_recv(struct chan * ch, void * msg, int len)
+{
+	uint8_t * cp = (uint8_t *)msg;
+	int cnt = 0;
+	int n;
 
-		if (__mq_recv(mq_rep, msg, MSG_SIZE) < 0) {
-			ERR("__mq_recv() failed: %s.", __strerr());
+	while (cnt < len) {
+		if ((n = read(ch->fd[0], &cp[cnt], len - cnt)) <= 0)
 			return -1;
-		}
+		cnt += n;
 	}
 
-	msg[0] = MSG_STOP;
-	msg[1] = 0;
+	return cnt;
+}
 
-	if (__mq_send(mq_req, msg, MSG_SIZE) < 0) {
-		ERR("__mq_send() failed: %s.", __strerr());
+/* ---------------------------------------------------------------------------
+   Shared memory slot helpers
+   -------------------------------------------------------------------------- */
+
+static int mbox_open(struct chan * ch)
+{
+	if ((ch->mbox = shared_alloc(sizeof(struct mbox))) == NULL) {
+		ERR("mmap() failed: %s.", __strerr());
 		return -1;
 	}
 
-	if (__mq_recv(mq_rep, msg, MSG_SIZE) < 0) {
-		ERR("__mq_recv() failed: %s.", __strerr());
+	ch->seq = 0;
+	return 0;
+}
+
+static void mbox_close(struct chan * ch)
+{
+	shared_free(ch->mbox, sizeof(struct mbox));
+	ch->mbox = NULL;
+}
+
+static void mbox_put(struct mbox * mbox, const void * msg, int len)
+{
+	memcpy(mbox->buf, msg, len);
+	mbox->len = len;
+	__atomic_store_n(&mbox->seq, mbox->seq + 1, __ATOMIC_RELEASE);
+}
+
+static int mbox_get(struct mbox * mbox, void * msg, int len)
+{
+	if (len > mbox->len)
+		len = mbox->len;
+	memcpy(msg, mbox->buf, len);
+	return len;
+}
+
+#ifdef __linux__
+
+static inline int futex_wait(volatile uint32_t * addr, uint32_t val)
+{
+	return syscall(SYS_futex, addr, FUTEX_WAIT, val, NULL, NULL, 0);
+}
+
+static inline int futex_wake(volatile uint32_t * addr, int cnt)
+{
+	return syscall(SYS_futex, addr, FUTEX_WAKE, cnt, NULL, NULL, 0);
+}
+
+static inline void cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__)
+	__asm__ volatile ("yield");
+#endif
+}
+
+/* ---------------------------------------------------------------------------
+   eventfd
+   -------------------------------------------------------------------------- */
+
+static int evfd_open(struct chan * ch, int size)
+{
+	if (mbox_open(ch) < 0)
 		return -1;
-	}
 
-	gettimeofday(&end, NULL);
-	print_stats(&start, &end, cnt, MSG_SIZE);
+	if ((ch->fd[0] = eventfd(0, 0)) < 0) {
+		ERR("eventfd() failed: %s.", __strerr());
+		mbox_close(ch);
+		return -1;
+	}
 
-	__mq_close(mq_req);
-	__mq_close(mq_rep);
 	return 0;
 }
 
-int mq_server(void) 
+static void evfd_close(struct chan * ch)
 {
-	uint32_t msg[MSG_SIZE / 2 + 1];
-	__mq_t mq_req;
-	__mq_t mq_rep;
+	close(ch->fd[0]);
+	mbox_close(ch);
+}
 
-	printf(" - Message queue server...\n");
-	fflush(stdout);
+static int evfd_send(struct chan * ch, const void * msg, int len)
+{
+	uint64_t val = 1;
 
-	INF("creating request message queue ...");
-	__mq_unlink(mq_req_name);
-	if (__mq_create(&mq_req, mq_req_name, MSG_SIZE) < 0) {
-		ERR("__mq_create(\"%s\") failed: %s.", mq_req_name, __strerr());
+	mbox_put(ch->mbox, msg, len);
+	if (write(ch->fd[0], &val, sizeof(val)) != sizeof(val))
 		return -1;
-	}
 
-	INF("Waiting for start...");
-	do {
-		if (__mq_recv(mq_req, msg, MSG_SIZE) < 0) {
-			ERR("__mq_recv() failed: %s.", __strerr());
-			return -1;
-		}
-	} while (msg[0] != MSG_START);  
+	return len;
+}
+
+static int evfd_recv(struct chan * ch, void * msg, int len)
+{
+	uint64_t val;
 
-	INF("Openning reply message queue...");
-	if (__mq_open(&mq_rep, mq_rep_name) < 0) {
-		ERR("__mq_open(\"%s\") failed: %s.", mq_rep_name, __strerr());
+	if (read(ch->fd[0], &val, sizeof(val)) != sizeof(val))
 		return -1;
-	}
 
-	INF("End of handshake...");
-	if (__mq_send(mq_rep, msg, MSG_SIZE) < 0) {
-		ERR("__mq_send() failed: %s.", __strerr());
+	return mbox_get(ch->mbox, msg, len);
+}
+
+/* ---------------------------------------------------------------------------
+   futex
+   -------------------------------------------------------------------------- */
+
+static int ftx_open(struct chan * ch, int size)
+{
+	return mbox_open(ch);
+}
+
+static void ftx_close(struct chan * ch)
+{
+	mbox_close(ch);
+}
+
+static int ftx_send(struct chan * ch, const void * msg, int len)
+{
+	mbox_put(ch->mbox, msg, len);
+	futex_wake(&ch->mbox->seq, 1);
+
+	return len;
+}
+
+static int ftx_recv(struct chan * ch, void * msg, int len)
+{
+	struct mbox * mbox = ch->mbox;
+
+	while (__atomic_load_n(&mbox->seq, __ATOMIC_ACQUIRE) == ch->seq)
+		futex_wait(&mbox->seq, ch->seq);
+	ch->seq++;
+
+	return mbox_get(mbox, msg, len);
+}
+
+/* ---------------------------------------------------------------------------
+   SPSC ring, spin then block
+   -------------------------------------------------------------------------- */
+
+static int ring_open(struct chan * ch, int size)
+{
+	if ((ch->ring = shared_alloc(sizeof(struct ring))) == NULL) {
+		ERR("mmap() failed: %s.", __strerr());
 		return -1;
 	}
 
-	do {
-		if (__mq_recv(mq_req, msg, MSG_SIZE) < 0) {
-			ERR("__mq_recv() failed: %s.", __strerr());
-			return -1;
-		}
+	return 0;
+}
 
-		if (__mq_send(mq_rep, msg, MSG_SIZE) < 0) {
-			ERR("__mq_send() failed: %s.", __strerr());
-			return -1;
+static void ring_close(struct chan * ch)
+{
+	shared_free(ch->ring, sizeof(struct ring));
+	ch->ring = NULL;
+}
+
+static int ring_send(struct chan * ch, const void * msg, int len)
+{
+	struct ring * ring = ch->ring;
+	uint32_t head = ring->head;
+	int i;
+
+	/* full, wait for the consumer */
+	while ((head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE)) ==
+		   RING_SLOTS)
+		sched_yield();
+
+	i = head % RING_SLOTS;
+	memcpy(ring->slot[i].buf, msg, len);
+	ring->slot[i].len = len;
+
+	/* The head store and the waiting load must not be reordered,
+	   pairs with the consumer's waiting store and head load. */
+	__atomic_store_n(&ring->head, head + 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&ring->waiting, __ATOMIC_SEQ_CST))
+		futex_wake(&ring->head, 1);
+
+	return len;
+}
+
+static int ring_recv(struct chan * ch, void * msg, int len)
+{
+	struct ring * ring = ch->ring;
+	uint32_t tail = ring->tail;
+	int spin = ring_spin;
+	int i;
+
+	while (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == tail) {
+		if (spin > 0) {
+			spin--;
+			cpu_relax();
+			continue;
 		}
-	} while (msg[0] != MSG_STOP);
 
-	__mq_close(mq_req);
-	__mq_close(mq_rep);
+		__atomic_store_n(&ring->waiting, 1, __ATOMIC_SEQ_CST);
+		if (__atomic_load_n(&ring->head, __ATOMIC_SEQ_CST) == tail)
+			futex_wait(&ring->head, tail);
+		__atomic_store_n(&ring->waiting, 0, __ATOMIC_RELAXED);
+	}
 
-	return 0;
+	i = tail % RING_SLOTS;
+	if (len > ring->slot[i].len)
+		len = ring->slot[i].len;
+	memcpy(msg, ring->slot[i].buf, len);
+
+	__atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+
+	return len;
 }
 
+#endif /* __linux__ */
+
 /* ---------------------------------------------------------------------------
-   Pthread Mutex
+   Pthread mutex and condition variable
    -------------------------------------------------------------------------- */
 
-#if ENABLE_SERVER_THREAD
-pthread_mutex_t  g_req_mutex = PTHREAD_MUTEX_INITIALIZER;
-pthread_mutex_t  g_rep_mutex = PTHREAD_MUTEX_INITIALIZER;
-pthread_cond_t g_req_cond = PTHREAD_COND_INITIALIZER;
-pthread_cond_t g_rep_cond = PTHREAD_COND_INITIALIZER;
-uint32_t g_req_buf[MSG_SIZE / 2 + 1];
-uint32_t g_rep_buf[MSG_SIZE / 2 + 1];
-
-int mutex_client(int cnt)
-{
-	uint32_t * req = g_req_buf;
-	uint32_t * rep = g_rep_buf;
-	struct timeval start;
-	struct timeval end;
-	uint32_t seq;
-
-	printf(" - Pthread Mutex client...\n");
-
-	gettimeofday(&start, NULL);
-	for (seq = 0; seq < cnt; seq++) {
-		pthread_mutex_lock(&g_req_mutex);
-		req[0] = seq;
-		req[1] = MSG_EVENT;
-		pthread_mutex_unlock(&g_req_mutex);
-		pthread_cond_signal(&g_req_cond);
-
-	//	printf(".");
-	//	fflush(stdout);
-
-		pthread_mutex_lock(&g_rep_mutex);
-		while (rep[0] != seq) {
-			pthread_cond_wait(&g_rep_cond, &g_rep_mutex);
-		}
-		pthread_mutex_unlock(&g_rep_mutex);
-	}
+static int mtx_open(struct chan * ch, int size)
+{
+	pthread_mutexattr_t mattr;
+	pthread_condattr_t cattr;
 
-	/* flush */
-	pthread_mutex_lock(&g_req_mutex);
-	req[0] = seq;
-	req[1] = MSG_SYNC;
-	pthread_mutex_unlock(&g_req_mutex);
-	pthread_cond_signal(&g_req_cond);
+	if (mbox_open(ch) < 0)
+		return -1;
 
-	pthread_mutex_lock(&g_rep_mutex);
-	while (rep[0] != seq) {
-		pthread_cond_wait(&g_rep_cond, &g_rep_mutex);
-	}
-	pthread_mutex_unlock(&g_rep_mutex);
+	/* the slot may be shared with a forked server */
+	pthread_mutexattr_init(&mattr);
+	pthread_mutexattr_setpshared(&mattr, PTHREAD_PROCESS_SHARED);
+	pthread_mutex_init(&ch->mbox->mutex, &mattr);
+	pthread_mutexattr_destroy(&mattr);
 
-	gettimeofday(&end, NULL);
-	print_stats(&start, &end, cnt, MSG_SIZE);
+	pthread_condattr_init(&cattr);
+	pthread_condattr_setpshared(&cattr, PTHREAD_PROCESS_SHARED);
+	pthread_cond_init(&ch->mbox->cond, &cattr);
+	pthread_condattr_destroy(&cattr);
 
 	return 0;
 }
 
-int mutex_server(void) 
+static void mtx_close(struct chan * ch)
+{
+	pthread_cond_destroy(&ch->mbox->cond);
+	pthread_mutex_destroy(&ch->mbox->mutex);
+	mbox_close(ch);
+}
+
+static int mtx_send(struct chan * ch, const void * msg, int len)
 {
-	volatile uint32_t * req = g_req_buf;
-	volatile uint32_t * rep = g_rep_buf;
-	uint32_t msg;
-	int seq = 0;
+	struct mbox * mbox = ch->mbox;
 
-	printf(" - Pthread Mutex Server...\n");
-	req[0] = -1;
-	rep[0] = -1;
+	pthread_mutex_lock(&mbox->mutex);
+	mbox_put(mbox, msg, len);
+	pthread_cond_signal(&mbox->cond);
+	pthread_mutex_unlock(&mbox->mutex);
 
-	for (;;) {
-		pthread_mutex_lock(&g_req_mutex);
-		while (req[0] != seq) {
-			pthread_cond_wait(&g_req_cond, &g_req_mutex);
-		}
-		msg = req[1];
-		pthread_mutex_unlock(&g_req_mutex);
-	//	printf("+");
-	//	fflush(stdout);
-
-		switch (msg) {
-		case MSG_EVENT:
-			pthread_mutex_lock(&g_rep_mutex);
-			rep[0] = seq;
-			pthread_cond_signal(&g_rep_cond);
-			pthread_mutex_unlock(&g_rep_mutex);
-			break;
-		case MSG_SYNC:
-			pthread_mutex_lock(&g_rep_mutex);
-			rep[0] = seq;
-			pthread_cond_signal(&g_rep_cond);
-			pthread_mutex_unlock(&g_rep_mutex);
-			return 0;
-		}
+	return len;
+}
 
-		seq++;
-	}
+static int mtx_recv(struct chan * ch, void * msg, int len)
+{
+	struct mbox * mbox = ch->mbox;
 
-	return 0;
+	pthread_mutex_lock(&mbox->mutex);
+	while (mbox->seq == ch->seq)
+		pthread_cond_wait(&mbox->cond, &mbox->mutex);
+	ch->seq++;
+	len = mbox_get(mbox, msg, len);
+	pthread_mutex_unlock(&mbox->mutex);
+
+	return len;
 }
-#else
+
+static const struct transport transport_tab[] = {
+	{ "mq", mq_open_, mq_close_, mq_send_, mq_recv_ },
+	{ "unix", mq_open_, mq_close_, mq_send_, mq_recv_ },
+	{ "pipe", pipe_open, pipe_close, pipe_send, pipe_recv },
+#ifdef __linux__
+	{ "eventfd", evfd_open, evfd_close, evfd_send, evfd_recv },
+	{ "futex", ftx_open, ftx_close, ftx_send, ftx_recv },
+	{ "ring", ring_open, ring_close, ring_send, ring_recv },
 #endif
+	{ "mutex", mtx_open, mtx_close, mtx_send, mtx_recv },
+	{ NULL, NULL, NULL, NULL, NULL }
+};
 
 /* ---------------------------------------------------------------------------
-   Server Task
+   Client and server
    -------------------------------------------------------------------------- */
 
-int server_task(void)
-{
-	mq_server(); 
-//	shm_server(); 
+struct pair {
+	const struct transport * tp;
+	struct chan req;
+	struct chan rep;
+	int size;
+	int cnt;
+	uint32_t * lat; /* round trip times in nanoseconds */
+	pthread_t client;
 #if ENABLE_SERVER_THREAD
-	mutex_server();
+	pthread_t server;
+#else
+	int pid;
 #endif
+};
+
+static pthread_barrier_t start_barrier;
+
+static inline uint64_t clock_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int server_task(struct pair * p)
+{
+	uint32_t msg[MSG_SIZE_MAX / 4];
+
+	do {
+		if (p->tp->recv(&p->req, msg, p->size) < 0) {
+			ERR("recv() failed: %s.", __strerr());
+			return -1;
+		}
+
+		if (p->tp->send(&p->rep, msg, p->size) < 0) {
+			ERR("send() failed: %s.", __strerr());
+			return -1;
+		}
+	} while (msg[0] != MSG_STOP);
 
 	return 0;
 }
 
-int server_start(void)
+static void * client_task(struct pair * p)
+{
+	uint32_t msg[MSG_SIZE_MAX / 4];
+	uint64_t t0;
+	int i;
+
+	memset(msg, 0, sizeof(msg));
+
+	pthread_barrier_wait(&start_barrier);
+
+	for (i = 0; i < p->cnt; i++) {
+		msg[0] = MSG_EVENT;
+		msg[1] = i;
+
+		t0 = clock_ns();
+
+		if (p->tp->send(&p->req, msg, p->size) < 0) {
+			ERR("send() failed: %s.", __strerr());
+			break;
+		}
+
+		if (p->tp->recv(&p->rep, msg, p->size) < 0) {
+			ERR("recv() failed: %s.", __strerr());
+			break;
+		}
+
+		p->lat[i] = clock_ns() - t0;
+	}
+
+	p->cnt = i;
+
+	msg[0] = MSG_STOP;
+	if (p->tp->send(&p->req, msg, p->size) >= 0)
+		p->tp->recv(&p->rep, msg, p->size);
+
+	return NULL;
+}
+
+static int server_start(struct pair * p)
 {
 #if ENABLE_SERVER_THREAD
-	pthread_t thread;
 	int ret;
 
-	if ((ret = pthread_create(&thread, NULL, 
-							  (void * (*)(void *))server_task, 
-							  (void *)NULL)) < 0) {
+	if ((ret = pthread_create(&p->server, NULL,
+							  (void * (*)(void *))server_task,
+							  (void *)p)) != 0) {
 		fprintf(stderr, "err: pthread_create() failed: %s", strerror(ret));
 		return -1;
-	} 
+	}
 
 	return 0;
 #else
@@ -318,50 +592,265 @@ int server_start(void)
 		fprintf(stderr, "err: fork() fail: %s", strerror(errno));
 		return -1;
 	}
-	
-	/* parent is the client */
+
 	if (pid == 0) {
 		/* child run as server */
-		server_task();
-		exit(1);
+		exit(server_task(p) < 0 ? 1 : 0);
 	}
 
+	p->pid = pid;
 	return pid;
 #endif
 }
 
-void server_stop(int pid)
+static void server_wait(struct pair * p)
 {
 #if ENABLE_SERVER_THREAD
+	pthread_join(p->server, NULL);
 #else
-	/* stop the server */
-	kill(pid, SIGTERM);
+	waitpid(p->pid, NULL, 0);
 #endif
 }
 
+/* ---------------------------------------------------------------------------
+   Statistics
+   -------------------------------------------------------------------------- */
 
-int main(int argc, char *argv[]) 
+static int lat_cmp(const void * a, const void * b)
 {
-	int pid;
-	int cnt = 1000000;
+	uint32_t x = *(const uint32_t *)a;
+	uint32_t y = *(const uint32_t *)b;
 
-	printf("\n* IPC Benchmark start\n");
+	return (x > y) - (x < y);
+}
 
-	pid = server_start();
+static double percentile(uint32_t * v, int n, double pct)
+{
+	int i = (int)((n - 1) * pct / 100.0 + 0.5);
 
-	/* Wait a wile to make sure the server process initializes.
-	   This is not pretty but will do for now */
-	usleep(100000);
-	mq_client(cnt); 
-//	usleep(100000);
-//	shm_client(cnt); 
-#if ENABLE_SERVER_THREAD
-	usleep(100000);
-	mutex_client(cnt);
-#endif
+	return v[i] / 1000.0;
+}
 
-	/* stop the server */
-	server_stop(pid);
+static void print_header(void)
+{
+	printf("%-9s %5s %5s %10s %9s %9s %9s %9s\n", "transport", "size",
+		   "pairs", "msgs/s", "p50(us)", "p99(us)", "p99.9(us)", "max(us)");
+	fflush(stdout);
+}
+
+static void print_stats(const char * name, int size, int pairs,
+						uint32_t * lat, int n, double dt)
+{
+	qsort(lat, n, sizeof(uint32_t), lat_cmp);
+
+	printf("%-9s %5d %5d %10.1f %9.2f %9.2f %9.2f %9.2f\n",
+		   name, size, pairs, n / dt,
+		   percentile(lat, n, 50), percentile(lat, n, 99),
+		   percentile(lat, n, 99.9), lat[n - 1] / 1000.0);
+	fflush(stdout);
+}
+
+/* ---------------------------------------------------------------------------
+   Benchmark
+   -------------------------------------------------------------------------- */
+
+static int run(const struct transport * tp, int size, int pairs, int cnt)
+{
+	struct pair pair[PAIRS_MAX];
+	uint32_t * lat;
+	uint64_t t0;
+	double dt;
+	int ret = -1;
+	int n = 0;
+	int i;
+
+	if ((strcmp(tp->name, "mq") == 0) || (strcmp(tp->name, "unix") == 0)) {
+		if (__mq_transport_set(tp->name) < 0)
+			return -1;
+	}
+
+	if ((lat = malloc((size_t)pairs * cnt * sizeof(uint32_t))) == NULL) {
+		ERR("malloc() failed!");
+		return -1;
+	}
+
+	memset(pair, 0, sizeof(pair));
+	for (i = 0; i < pairs; i++) {
+		struct pair * p = &pair[i];
+
+		p->tp = tp;
+		p->size = size;
+		p->cnt = cnt;
+		p->lat = &lat[i * cnt];
+		sprintf(p->req.name, "ipc_bm_req%d", i);
+		sprintf(p->rep.name, "ipc_bm_rep%d", i);
+
+		if (tp->open(&p->req, size) < 0) {
+			fprintf(stderr, "%s: open failed: %s\n", tp->name,
+					strerror(errno));
+			goto close;
+		}
+
+		if (tp->open(&p->rep, size) < 0) {
+			fprintf(stderr, "%s: open failed: %s\n", tp->name,
+					strerror(errno));
+			tp->close(&p->req);
+			goto close;
+		}
+	}
+
+	pthread_barrier_init(&start_barrier, NULL, pairs + 1);
+
+	for (i = 0; i < pairs; i++) {
+		server_start(&pair[i]);
+		pthread_create(&pair[i].client, NULL,
+					   (void * (*)(void *))client_task,
+					   (void *)&pair[i]);
+	}
+
+	pthread_barrier_wait(&start_barrier);
+	t0 = clock_ns();
+
+	for (i = 0; i < pairs; i++)
+		pthread_join(pair[i].client, NULL);
+
+	dt = (clock_ns() - t0) / 1e9;
+
+	for (i = 0; i < pairs; i++) {
+		server_wait(&pair[i]);
+		/* pack the samples */
+		memmove(&lat[n], pair[i].lat, pair[i].cnt * sizeof(uint32_t));
+		n += pair[i].cnt;
+	}
+
+	pthread_barrier_destroy(&start_barrier);
+
+	if (n > 0) {
+		print_stats(tp->name, size, pairs, lat, n, dt);
+		ret = 0;
+	}
+
+close:
+	while (i-- > 0) {
+		tp->close(&pair[i].req);
+		tp->close(&pair[i].rep);
+	}
+
+	free(lat);
+
+	return ret;
+}
+
+static void show_usage(const char * prog)
+{
+	int i;
+
+	fprintf(stderr, "Usage: %s [-n COUNT] [-p PAIRS] [-t TRANSPORT,...] "
+			"[-s SIZE,...] [-w SPIN]\n", prog);
+	fprintf(stderr, "  -n COUNT  round trips per pair (default 100000)\n");
+	fprintf(stderr, "  -p PAIRS  run 1, 2, 4 ... PAIRS concurrent pairs\n");
+	fprintf(stderr, "  -t LIST   transports:");
+	for (i = 0; transport_tab[i].name != NULL; i++)
+		fprintf(stderr, " %s", transport_tab[i].name);
+	fprintf(stderr, "\n");
+	fprintf(stderr, "  -s LIST   message sizes (default %d,%d)\n",
+			(int)CHIME_EVENT_LEN, (int)CHIME_REQUEST_LEN);
+	fprintf(stderr, "  -w SPIN   ring polls before blocking (default %d)\n",
+			RING_SPIN_MAX);
+	fprintf(stderr, "\n");
+}
+
+int main(int argc, char *argv[])
+{
+	const struct transport * tp_sel[16];
+	int size[16];
+	int tp_cnt = 0;
+	int size_cnt = 0;
+	int pairs_max = 1;
+	int cnt = 100000;
+	char * tok;
+	int pairs;
+	int c;
+	int i;
+	int j;
+
+	if (sysconf(_SC_NPROCESSORS_ONLN) < 2)
+		ring_spin = 0;
+
+	while ((c = getopt(argc, argv, "n:p:t:s:w:h")) > 0) {
+		switch (c) {
+		case 'n':
+			cnt = strtoul(optarg, NULL, 0);
+			break;
+		case 'p':
+			pairs_max = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			for (tok = strtok(optarg, ","); tok && tp_cnt < 16;
+				 tok = strtok(NULL, ",")) {
+				for (i = 0; transport_tab[i].name != NULL; i++) {
+					if (strcmp(transport_tab[i].name, tok) == 0)
+						break;
+				}
+				if (transport_tab[i].name == NULL) {
+					fprintf(stderr, "invalid transport: \"%s\"\n", tok);
+					return 1;
+				}
+				tp_sel[tp_cnt++] = &transport_tab[i];
+			}
+			break;
+		case 's':
+			for (tok = strtok(optarg, ","); tok && size_cnt < 16;
+				 tok = strtok(NULL, ",")) {
+				size[size_cnt++] = strtoul(tok, NULL, 0);
+			}
+			break;
+		case 'w':
+			ring_spin = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			show_usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if ((cnt <= 0) || (pairs_max < 1) || (pairs_max > PAIRS_MAX)) {
+		show_usage(argv[0]);
+		return 1;
+	}
+
+	if (tp_cnt == 0) {
+		for (i = 0; transport_tab[i].name != NULL; i++)
+			tp_sel[tp_cnt++] = &transport_tab[i];
+	}
+
+	if (size_cnt == 0) {
+		size[size_cnt++] = CHIME_EVENT_LEN;
+		size[size_cnt++] = CHIME_REQUEST_LEN;
+	}
+
+	for (i = 0; i < size_cnt; i++) {
+		/* room for the message header */
+		if (size[i] < 8)
+			size[i] = 8;
+		if (size[i] > MSG_SIZE_MAX)
+			size[i] = MSG_SIZE_MAX;
+	}
+
+	printf("\n* IPC Benchmark start\n");
+	print_header();
+
+	for (i = 0; i < tp_cnt; i++) {
+		for (j = 0; j < size_cnt; j++) {
+			/* 1, 2, 4 ... always including the upper bound */
+			for (pairs = 1; ; pairs = (pairs * 2 < pairs_max) ?
+				 pairs * 2 : pairs_max) {
+				run(tp_sel[i], size[j], pairs, cnt);
+				if (pairs == pairs_max)
+					break;
+			}
+		}
+	}
 
 	printf("* IPC Benchmark end.\n");
 	return 0;
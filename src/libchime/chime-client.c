@@ -77,11 +77,20 @@ int chime_cpu_create(float offs_ppm, float tc_ppm, void (* on_reset)(void))
 				break;
 			}
 
-			DBG1("creating CPU thread ...");
-			if ((ret = __thread_create(&node->c.thread,
+			node->c.task = NULL;
+			if (__exec_enabled()) {
+				DBG1("spawning CPU task ...");
+				node->c.thread = 0;
+				ret = __exec_spawn(node);
+			} else {
+				DBG1("creating CPU thread ...");
+				ret = __thread_create(&node->c.thread,
 									  (void * (*)(void *))__cpu_ctrl_task,
-									  (void *)node)) < 0) {
-				ERR("__thread_create() failed.");
+									  (void *)node);
+			}
+
+			if (ret < 0) {
+				ERR("CPU start failed.");
 				__mq_close(node->c.rcv_mq);
 				__mq_unlink(node->name);
 				obj_free(node);
@@ -92,13 +101,17 @@ int chime_cpu_create(float offs_ppm, float tc_ppm, void (* on_reset)(void))
 			req.hdr.node_id = 0;
 			req.hdr.opc = CHIME_REQ_JOIN;
 			req.hdr.oid = obj_oid(node);
+			req.hdr.ahead = 0;
 
 			if (__mq_send(client.mqsrv, &req, CHIME_REQ_JOIN_LEN) < 0) {
 				ERR("__mq_send() failed: %s.", __strerr());
 				__mq_close(node->c.rcv_mq);
 				__mq_unlink(node->name);
-				__thread_cancel(node->c.thread);
-				__thread_join(node->c.thread, NULL);
+				if (node->c.thread) {
+					__thread_cancel(node->c.thread);
+					__thread_join(node->c.thread, NULL);
+				}
+				__exec_cancel(node);
 				obj_free(node);
 				break;
 			}
@@ -174,6 +187,7 @@ int chime_cpu_run(float offs_ppm, float tc_ppm, void (* on_reset)(void))
 	req.hdr.node_id = 0;
 	req.hdr.opc = CHIME_REQ_JOIN;
 	req.hdr.oid = obj_oid(node);
+	req.hdr.ahead = 0;
 
 	if (__mq_send(client.mqsrv, &req, CHIME_REQ_JOIN_LEN) < 0) {
 		ERR("__mq_send() failed: %s.", __strerr());
@@ -229,6 +243,13 @@ int chime_client_start(const char * name)
 				break;
 			}
 
+			/* open the object directory */
+			DBG1("opening object directory...");
+			if (__dir_open(name) < 0) {
+				ERR("__dir_open(\"%s\") failed: %s.", name, __strerr());
+				break;
+			}
+
 			DBG1("server shared object get...");
 			client.srv_shared = obj_getinstance_incref(SRV_SHARED_OID);
 			if (client.srv_shared == NULL) {
@@ -407,7 +428,8 @@ static void __cpu_stop(struct chime_node * node)
 #ifdef _WIN32
 		if (node->c.thread != self) {
 #else
-		if (memcmp(&node->c.thread, &self, sizeof(pthread_t)) == 0) {
+		if ((node->c.thread != 0) && 
+			(memcmp(&node->c.thread, &self, sizeof(pthread_t)) != 0)) {
 #endif
 			DBG1("<%d> thread cancel...", node_id);
 			__thread_cancel(node->c.thread);
@@ -415,9 +437,14 @@ static void __cpu_stop(struct chime_node * node)
 			__thread_join(node->c.thread, NULL);
 		}
 
+		/* unschedule an executor task, its stack is released */
+		DBG1("<%d> task cancel...", node_id);
+		__exec_cancel(node);
+
 		req.node_id = node_id;
 		req.opc = CHIME_REQ_BYE;
 		req.oid = obj_oid(node);
+		req.ahead = 0;
 
 		DBG1("<%d> oid=%d says good-bye...", node_id, req.oid);
 
@@ -464,11 +491,16 @@ int chime_client_stop(void)
 			__cpu_stop(node);
 		}
 
+		/* the CPUs are gone, stop the executor workers */
+		__exec_stop();
+
 		/* close connection with server */
 		__mq_close(client.mqsrv);
 
 		/* release server shared object */
 		obj_decref(client.srv_shared);
+		/* close the object directory */
+		__dir_close();
 		/* close pool of objects */
 		objpool_close();
 		client.started = false;
@@ -12,15 +12,12 @@
 
 int chime_comm_create(const char * name, struct comm_attr * attr)
 {
-	struct srv_shared * shared = cpu.srv_shared;
 	struct chime_comm * comm;
 	int oid;
 
 	DBG1("name=%s", name);
 
-	objpool_lock();
-	oid = __dir_lst_lookup(&shared->dir, name);
-	objpool_unlock();
+	oid = __dir_lookup(name);
 
 	/* sanity check */
 	assert(attr->bytes_max > 0);
@@ -49,19 +46,41 @@ int chime_comm_create(const char * name, struct comm_attr * attr)
 	comm->attr = *attr;
 	strncpy(comm->name, name, ENTRY_NAME_MAX);
 	u8_list_init(comm->node_lst);
+	memset(comm->rcv_map, 0, sizeof(comm->rcv_map));
+	memset(comm->dcd_map, 0, sizeof(comm->dcd_map));
+	memset(comm->addr, 0, sizeof(comm->addr));
 	objpool_unlock();
 
-	if (__cpu_req_send(CHIME_REQ_COMM_CREATE, oid)) {
-		/* insert into directory */
+	__dir_lock();
+
+	/* another node may have created it in the meantime */
+	if ((oid = __dir_lookup(name)) != OID_NULL) {
+		__dir_unlock();
+		/* release our object and use the existing one */
+		obj_free(comm);
+		comm = obj_getinstance(oid);
 		objpool_lock();
-		__dir_lst_insert(&shared->dir, name, oid);
+		comm->attr = *attr; /* update attributes */
 		objpool_unlock();
-	} else {
+		return oid;
+	}
+
+	oid = obj_oid(comm);
+
+	if (!__cpu_req_send(CHIME_REQ_COMM_CREATE, oid)) {
+		__dir_unlock();
 		/* release the object */
 		obj_free(comm);
 		return -1;
 	}
 
+	/* publish the name only after the create request is queued, 
+	   the requests of other nodes will be processed after it */
+	if (!__dir_insert(name, oid))
+		ERR("COMM \"%s\" directory insert failed!", name);
+
+	__dir_unlock();
+
 	return oid;
 }
 
@@ -71,6 +90,30 @@ int chime_comm_destroy(const char * name)
 	return -1;
 }
 
+int chime_comm_stat(const char * name, struct chime_comm_stat * stat)
+{
+	struct chime_comm * comm;
+	int oid;
+
+	if ((oid = __dir_lookup(name)) == OID_NULL) {
+		ERR("COMM \"%s\" don't exist!", name);
+		return -1;
+	}
+
+	comm = obj_getinstance(oid);
+
+	/* live values, not synchronized with the server */
+	stat->frames = comm->tx.frm_cnt;
+	stat->bytes = comm->tx.byte_cnt;
+	stat->busy = (double)comm->tx.busy / (double)SEC;
+	stat->util = comm->tx.util;
+	stat->util_peak = comm->tx.util_peak;
+	stat->inflight_max = comm->tx.inflight_max;
+	stat->drops = comm->tx.drop_cnt;
+
+	return 0;
+}
+
 /****************************************************************************
   CPU scope 
  ****************************************************************************/
@@ -88,9 +131,7 @@ int chime_comm_attach(int chan, const char * name,
 	DBG1("name=%s", name);
 	DBG3("cpu.srv_shared=%p", cpu.srv_shared);
 
-	objpool_lock();
-	oid = __dir_lst_lookup(&cpu.srv_shared->dir, name);
-	objpool_unlock();
+	oid = __dir_lookup(name);
 
 	if (oid == OID_NULL) {
 		ERR("COMM \"%s\" don't exist!", name);
@@ -113,12 +154,25 @@ int chime_comm_attach(int chan, const char * name,
 	cpu.comm[chan].eot_isr = eot_isr;
 	cpu.comm[chan].dcd_isr = dcd_isr;
 	cpu.comm[chan].tx_busy = false;
+	cpu.comm[chan].tx_ack = true;
+	cpu.node->tx[chan].oid = oid;
 
 	objpool_lock();
 	if (!u8_list_contains(comm->node_lst, cpu.node_id))
 		u8_list_insert(comm->node_lst, cpu.node_id);
 	else
 		DBG("CPU is already in the list");
+	/* register the default address */
+	comm->addr[cpu.node_id] = cpu.node_id;
+	/* register the interest in RCV and DCD events */
+	if (rcv_isr != NULL)
+		NODE_MAP_SET(comm->rcv_map, cpu.node_id);
+	else
+		NODE_MAP_CLR(comm->rcv_map, cpu.node_id);
+	if (dcd_isr != NULL)
+		NODE_MAP_SET(comm->dcd_map, cpu.node_id);
+	else
+		NODE_MAP_CLR(comm->dcd_map, cpu.node_id);
 	objpool_unlock();
 
 	return 0;
@@ -136,6 +190,9 @@ int chime_comm_close(int chan)
 
 	objpool_lock();
 	u8_list_remove(comm->node_lst, cpu.node_id);
+	NODE_MAP_CLR(comm->rcv_map, cpu.node_id);
+	NODE_MAP_CLR(comm->dcd_map, cpu.node_id);
+	comm->addr[cpu.node_id] = 0;
 	objpool_unlock();
 
 	obj_decref(comm);
@@ -144,6 +201,11 @@ int chime_comm_close(int chan)
 }
 
 int chime_comm_write(int chan, const void * buf, size_t len)
+{
+	return chime_comm_write_to(chan, COMM_ADDR_BCAST, buf, len);
+}
+
+int chime_comm_write_to(int chan, int dst, const void * buf, size_t len)
 {
 	struct chime_req_comm req;
 	int comm_oid;
@@ -155,7 +217,12 @@ int chime_comm_write(int chan, const void * buf, size_t len)
 	assert(comm_oid != 0);
 
 	if (cpu.comm[chan].tx_busy) {
+		struct chime_comm * comm = obj_getinstance(comm_oid);
+
 		ERR("COMM TX busy!");
+		/* count the dropped frame */
+		cpu.node->tx[chan].drop_cnt++;
+		__sync_fetch_and_add(&comm->tx.drop_cnt, 1);
 		__cpu_except(EXCEPT_COMM_TX_BUSY);
 	}
 
@@ -172,11 +239,13 @@ int chime_comm_write(int chan, const void * buf, size_t len)
 	req.hdr.oid = comm_oid;
 	req.hdr.node_id = cpu.node_id;
 	req.hdr.opc = CHIME_REQ_XMT0 + chan;
+	req.hdr.ahead = __cpu_ahead_take();
 	req.buf_oid = obj_oid(frm);
 	req.buf_len = len;
+	req.dst = dst;
 
-	DBG1("<%d> COMM{chan=%d oid=%d} buf{oid=%d len=%d}.", 
-		 cpu.node_id, chan, comm_oid, req.buf_oid, (int)len);
+	DBG1("<%d> COMM{chan=%d oid=%d} buf{oid=%d len=%d} dst=%d.", 
+		 cpu.node_id, chan, comm_oid, req.buf_oid, (int)len, dst);
 
 	if (__mq_send(cpu.xmt_mq, &req, CHIME_REQ_COMM_LEN) < 0) {
 		ERR("__mq_send() failed: %s.", __strerr());
@@ -184,6 +253,9 @@ int chime_comm_write(int chan, const void * buf, size_t len)
 		__cpu_except(EXCEPT_MQ_SEND);
 	}
 
+	/* the EOT can come within a few cycles, stop running ahead */
+	cpu.horizon = cpu.clk;
+
 	cpu.comm[chan].tx_busy = true;
 
 	return len;
@@ -210,6 +282,30 @@ int chime_comm_read(int chan, void * buf, size_t len)
 	return len;
 }
 
+int chime_comm_addr_set(int chan, int addr)
+{
+	struct chime_comm * comm;
+
+	assert((unsigned int)chan < CHIME_CPU_COMM_MAX);  
+	assert((unsigned int)addr <= CHIME_NODE_MAX);  
+
+	comm = obj_getinstance(cpu.comm[chan].oid);
+	assert(comm != NULL);
+
+	objpool_lock();
+	comm->addr[cpu.node_id] = addr;
+	objpool_unlock();
+
+	return 0;
+}
+
+bool chime_comm_tx_ack(int chan)
+{
+	assert((unsigned int)chan < CHIME_CPU_COMM_MAX);  
+
+	return cpu.comm[chan].tx_ack;
+}
+
 int chime_comm_nodes(int chan)
 {
 	struct chime_comm * comm;
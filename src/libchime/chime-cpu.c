@@ -1,5 +1,6 @@
 #include <errno.h>
 #include <string.h>
+#include <stdlib.h>
 #include <sys/param.h>
 #include <stdio.h>
 #include <unistd.h>
@@ -21,6 +22,7 @@ bool __cpu_req_send(int opc, int oid)
 	req.node_id = cpu.node_id;
 	req.opc = opc;
 	req.oid = oid;
+	req.ahead = __cpu_ahead_take();
 
 	if ((ret = __mq_send(cpu.xmt_mq, &req, CHIME_REQ_HDR_LEN)) < 0) {
 		ERR("__mq_send() failed: %s.", __strerr());
@@ -38,6 +40,7 @@ bool __cpu_req_float_set(int opc, int oid, float val)
 	req.hdr.node_id = cpu.node_id;
 	req.hdr.opc = opc;
 	req.hdr.oid = oid;
+	req.hdr.ahead = __cpu_ahead_take();
 	req.val = val;
 
 	if ((ret = __mq_send(cpu.xmt_mq, &req, CHIME_REQ_FLOAT_SET_LEN)) < 0) {
@@ -64,6 +67,7 @@ void __chime_evt_reset(struct chime_event * ev)
 	req.hdr.node_id = cpu.node_id;
 	req.hdr.opc = CHIME_REQ_INIT;
 	req.hdr.oid = ev->oid;
+	req.hdr.ahead = __cpu_ahead_take();
 	req.sid = ev->sid;
 
 	if (__mq_send(cpu.xmt_mq, &req, CHIME_REQ_FLOAT_SET_LEN) < 0) {
@@ -76,10 +80,18 @@ void __chime_evt_reset(struct chime_event * ev)
 
 void __chime_evt_step(struct chime_event * ev)
 {
-	DBG1("cycles=%u", (uint32_t)cpu.node->ticks);
+	DBG1("cycles=%u", (uint32_t)cpu.ticks);
 	cpu.step_rcvd = true;
 }
 
+/* Don't run ahead past an event we have just scheduled */
+static inline void __cpu_horizon_clip(uint64_t clk)
+{
+	/* if (clk < cpu.horizon) */
+	if ((int64_t)(clk - cpu.horizon) < 0)
+		cpu.horizon = clk;
+}
+
 static void __timer_reload(struct cpu_tmr  * tmr, int tmr_id)
 {
 	struct chime_req_timer req;
@@ -90,6 +102,7 @@ static void __timer_reload(struct cpu_tmr  * tmr, int tmr_id)
 		req.hdr.node_id = cpu.node_id;
 		req.hdr.opc = CHIME_REQ_TMR0 + tmr_id;
 		req.hdr.oid = 0;
+		req.hdr.ahead = __cpu_ahead_take();
 		req.ticks = tmr->timeout;
 		req.seq = ++tmr->seq;
 		DBG2("tmr=%d ticks=%d.", tmr_id, req.ticks);
@@ -97,9 +110,10 @@ static void __timer_reload(struct cpu_tmr  * tmr, int tmr_id)
 			ERR("__mq_send() failed: %s.", __strerr());
 			__cpu_except(EXCEPT_MQ_SEND);
 		} 
+		__cpu_horizon_clip(cpu.clk + cpu.node->dt * req.ticks);
 	}
 
-	tmr->rst_ticks = cpu.node->ticks;
+	tmr->rst_ticks = cpu.ticks;
 	tmr->timeout = tmr->period;
 }
 
@@ -109,7 +123,7 @@ void __chime_evt_timer(struct chime_event * ev)
 	struct cpu_tmr  * tmr;
 	int tmr_id;
 
-	DBG2("%d CPU cycles.", (uint32_t)cpu.node->ticks);
+	DBG2("%d CPU cycles.", (uint32_t)cpu.ticks);
 
 	tmr_id = ev->opc - CHIME_EVT_TMR0;
 
@@ -131,6 +145,27 @@ void __chime_evt_timer(struct chime_event * ev)
 		tmr->isr();
 }
 
+void __chime_evt_handle_timer(struct chime_event * ev)
+{
+	struct cpu_timer * tmr;
+	int handle = ev->oid;
+
+	DBG2("timer %d: %d CPU cycles.", handle, (uint32_t)cpu.ticks);
+
+	if (handle >= cpu.timer_cnt)
+		return;
+
+	tmr = &cpu.timer[handle];
+
+	if (tmr->seq != ev->seq) {
+		/* old event, the timer was re-armed or canceled */
+		return;
+	}
+
+	if (tmr->isr != NULL)
+		tmr->isr(tmr->arg);
+}
+
 void __chime_evt_comm_eot(struct chime_event * ev)
 {
 	int comm_oid = ev->oid;
@@ -150,6 +185,8 @@ void __chime_evt_comm_eot(struct chime_event * ev)
 	assert(comm->tx_busy == true);
 
 	comm->tx_busy = false;
+	/* transmission outcome */
+	comm->tx_ack = (ev->u32 == 0);
 
 
 	if (comm->eot_isr != NULL)
@@ -241,7 +278,7 @@ int chime_cpu_id(void)
 
 uint32_t chime_cpu_cycles(void)
 {
-	return cpu.node->ticks;
+	return cpu.ticks;
 }
 
 void chime_tmr_init(int tmr_id, void (* isr)(void), 
@@ -310,22 +347,146 @@ uint32_t chime_tmr_count(int tmr_id)
 	tmr = &cpu.tmr[tmr_id];
 	(void)tmr;
 
-	return cpu.node->ticks - tmr->rst_ticks;
+	return cpu.ticks - tmr->rst_ticks;
+}
+
+int chime_timer_create(void (* isr)(void *), void * arg)
+{
+	struct cpu_timer * tmr;
+	int handle;
+
+	if (cpu.timer_cnt > UINT16_MAX)
+		return -1;
+
+	if (cpu.timer_cnt == cpu.timer_len) {
+		int len = (cpu.timer_len == 0) ? 16 : cpu.timer_len * 2;
+
+		if ((tmr = realloc(cpu.timer, len * sizeof(struct cpu_timer))) == NULL)
+			return -1;
+		/* the sequence counters survive a CPU reset */
+		memset(&tmr[cpu.timer_len], 0, 
+			   (len - cpu.timer_len) * sizeof(struct cpu_timer));
+		cpu.timer = tmr;
+		cpu.timer_len = len;
+	}
+
+	handle = cpu.timer_cnt++;
+	tmr = &cpu.timer[handle];
+	tmr->isr = isr;
+	tmr->arg = arg;
+	/* invalidate events from before a CPU reset */
+	tmr->seq++;
+
+	return handle;
+}
+
+void chime_timer_arm(int handle, uint32_t timeout, uint32_t period)
+{
+	struct chime_req_timer_arm req;
+	struct cpu_timer * tmr;
+
+	assert(handle < cpu.timer_cnt);
+	assert(timeout > 0);
+
+	tmr = &cpu.timer[handle];
+
+	req.hdr.node_id = cpu.node_id;
+	req.hdr.opc = CHIME_REQ_TIMER_ARM;
+	req.hdr.oid = handle;
+	req.hdr.ahead = __cpu_ahead_take();
+	req.ticks = timeout;
+	req.period = period;
+	req.seq = ++tmr->seq;
+	DBG2("timer %d: ticks=%d period=%d.", handle, timeout, period);
+	if (__mq_send(cpu.xmt_mq, &req, CHIME_REQ_TIMER_ARM_LEN) < 0) {
+		ERR("__mq_send() failed: %s.", __strerr());
+		__cpu_except(EXCEPT_MQ_SEND);
+	} 
+
+	__cpu_horizon_clip(cpu.clk + cpu.node->dt * timeout);
+}
+
+void chime_timer_cancel(int handle)
+{
+	struct chime_req_hdr req;
+	struct cpu_timer * tmr;
+
+	assert(handle < cpu.timer_cnt);
+
+	tmr = &cpu.timer[handle];
+	tmr->seq++;
+
+	req.node_id = cpu.node_id;
+	req.opc = CHIME_REQ_TIMER_CANCEL;
+	req.oid = handle;
+	req.ahead = __cpu_ahead_take();
+	if (__mq_send(cpu.xmt_mq, &req, CHIME_REQ_HDR_LEN) < 0) {
+		ERR("__mq_send() failed: %s.", __strerr());
+		__cpu_except(EXCEPT_MQ_SEND);
+	} 
+}
+
+static void __cpu_prof_reset(void)
+{
+	struct chime_node * node = cpu.node;
+
+	node->prof.run_ns = 0;
+	node->prof.wait_ns = 0;
+	node->prof.cycles = 0;
+	node->prof.ticks = cpu.ticks;
+	node->prof.evt_cnt = 0;
+	node->prof.mark_ns = __clock_ns();
 }
 
 static void __cpu_event_wait(void)
 {       
 	struct chime_event buf;
 	struct chime_event * evt = (struct chime_event *)&buf;
+	struct chime_node * node = cpu.node;
+	uint64_t t0;
+	uint64_t t1;
 	int len;
 
 again:
+	/* everything since the last event was spent running the 
+	   ISRs or the reset handler */
+	t0 = __clock_ns();
+	node->prof.run_ns += t0 - node->prof.mark_ns;
+
+	/* give the worker back to other CPUs until we have an event */
+	if (cpu.task != NULL)
+		__exec_wait();
 
 	if ((len = __mq_recv(cpu.rcv_mq, evt, CHIME_EVENT_LEN)) < 0) {
 		DBG1("__mq_recv() failed: %s!", __strerr());
 		__cpu_except(EXCEPT_MQ_RECV);
 	}
 
+	t1 = __clock_ns();
+	node->prof.wait_ns += t1 - t0;
+	node->prof.mark_ns = t1;
+	node->prof.evt_cnt++;
+	/* The server updates the node clock before dispatching and 
+	   leaves it alone until we check in again. Run ahead on a 
+	   local copy from here. */
+	cpu.clk = node->clk;
+	cpu.ticks = node->ticks;
+	cpu.time = node->time;
+	cpu.ahead = 0;
+	node->prof.cycles += cpu.ticks - node->prof.ticks;
+	node->prof.ticks = cpu.ticks;
+	/* published by the server before dispatching */
+	cpu.horizon = node->horizon;
+
+	/* Events to be handled before checking in again. The flag is 
+	   kept in the CPU state, an ISR can wait for the rest of the 
+	   batch on its own. */
+	cpu.batch_pend = (evt->opc & CHIME_EVT_MORE) ? true : false;
+	evt->opc &= ~CHIME_EVT_MORE;
+	/* the horizon is published with the last event of the batch */
+	if (cpu.batch_pend)
+		cpu.horizon = cpu.clk;
+
 	DBG5("rcvd %d bytes.", (int)len);
 	DBG1("<%d> [%s]", evt->node_id, __evt_opc_nm[evt->opc]);
 
@@ -340,6 +501,9 @@ again:
 	case CHIME_EVT_TMR7:
 		__chime_evt_timer(evt);
 		break;
+	case CHIME_EVT_TIMER:
+		__chime_evt_handle_timer(evt);
+		break;
 	case CHIME_EVT_EOT0:
 	case CHIME_EVT_EOT1:
 	case CHIME_EVT_EOT2:
@@ -374,6 +538,10 @@ again:
 	default:
 		__cpu_except(EXCEPT_INVALID_EVENT);
 	}
+
+	/* nothing left if a nested wait consumed the batch already */
+	if (cpu.batch_pend)
+		goto again;
 }
 
 void chime_cpu_wait(void)
@@ -381,9 +549,17 @@ void chime_cpu_wait(void)
 	struct chime_req_bkpt req;
 	int ret;
 
+	/* Waiting from an ISR in the middle of a batch. The next event 
+	   is already queued, don't check in before the batch is over. */
+	if (cpu.batch_pend) {
+		__cpu_event_wait();
+		return;
+	}
+
 	req.hdr.node_id = cpu.node_id;
 	req.hdr.opc = CHIME_REQ_BKPT;
 	req.hdr.oid = 0;
+	req.hdr.ahead = __cpu_ahead_take();
 
 	DBG2("break...");
 	if ((ret = __mq_send(cpu.xmt_mq, &req, CHIME_REQ_BKPT_LEN)) < 0) {
@@ -410,6 +586,10 @@ int __cpu_sim_loop(struct chime_node * node)
 	cpu.node_id = -1;
 	cpu.node = node;
 
+	/* executor workers are placed on creation */
+	if (cpu.task == NULL)
+		__thread_placement(false);
+
 	DBG1("CPU:%s control init.", cpu.node->name);
 	
 	code = setjmp(cpu.except_env);
@@ -417,7 +597,12 @@ int __cpu_sim_loop(struct chime_node * node)
 	if (code > EXCEPT_CPU_HALT) {
 		ERR("exception: %d.", code);
 	} else {
+		__cpu_prof_reset();
+
 		if (setjmp(cpu.reset_env)) {
+			__cpu_prof_reset();
+			/* the timers are created again by the reset handler */
+			cpu.timer_cnt = 0;
 			cpu.rst_isr();
 		}
 
@@ -434,6 +619,7 @@ int __cpu_sim_loop(struct chime_node * node)
 	req.hdr.node_id = cpu.node_id;
 	req.hdr.opc = CHIME_REQ_ABORT;
 	req.hdr.oid = obj_oid(cpu.node);
+	req.hdr.ahead = __cpu_ahead_take();
 	req.code = code;
 	if (__mq_send(cpu.xmt_mq, &req, CHIME_REQ_ABORT_LEN) < 0) {
 		ERR("__mq_send() failed: %s.", __strerr());
@@ -460,7 +646,9 @@ int __cpu_ctrl_task(struct chime_node * node)
 
 void chime_cpu_step(uint32_t cycles)
 {
+	struct chime_node * node = cpu.node;
 	struct chime_req_step req;
+	uint64_t clk;
 
 	req.hdr.node_id = cpu.node_id;
 	req.hdr.opc = CHIME_REQ_STEP;
@@ -474,6 +662,29 @@ void chime_cpu_step(uint32_t cycles)
 
 	DBG5("cycles=%d.", cycles);
 
+	/* Stepping from an ISR in the middle of a batch. The events left 
+	   are due now, handle them before checking in. */
+	if (cpu.batch_pend)
+		__cpu_event_wait();
+
+	/* Run ahead: if no event can reach this node before the end 
+	   of the step, advance the clock locally. The node clock in 
+	   shared memory is left to the server, which advances it by
+	   the cycles reported with our next request. */
+	clk = cpu.clk + node->dt * cycles;
+	/* if ((clk < cpu.horizon) && (clk < node->horizon)) */
+	if (((int64_t)(clk - cpu.horizon) < 0) && 
+		((int64_t)(clk - node->horizon) < 0) &&
+		(cycles <= UINT32_MAX - cpu.ahead)) {
+		cpu.clk = clk;
+		cpu.ticks += cycles;
+		cpu.time += cycles * node->period;
+		cpu.ahead += cycles;
+		return;
+	}
+
+	req.hdr.ahead = __cpu_ahead_take();
+
 	if (__mq_send(cpu.xmt_mq, &req, CHIME_REQ_STEP_LEN) < 0) {
 		ERR("__mq_send() failed: %s.", __strerr());
 		__cpu_except(EXCEPT_MQ_SEND);
@@ -494,6 +705,7 @@ void chime_cpu_halt(void)
 	req.hdr.node_id = cpu.node_id;
 	req.hdr.opc = CHIME_REQ_HALT;
 	req.hdr.oid = 0;
+	req.hdr.ahead = __cpu_ahead_take();
 
 	if (__mq_send(cpu.xmt_mq, &req, CHIME_REQ_STEP_LEN) < 0) {
 		ERR("__mq_send() failed: %s.", __strerr());
@@ -520,6 +732,8 @@ bool tracef(int lvl, const char * __fmt, ...)
 
 	req.hdr.node_id = cpu.node_id;
 	req.hdr.opc = CHIME_REQ_TRACE;
+	req.hdr.oid = 0;
+	req.hdr.ahead = __cpu_ahead_take();
 	req.level = lvl;
 	req.facility = 0;
 
@@ -538,15 +752,12 @@ bool tracef(int lvl, const char * __fmt, ...)
 
 static int __var_open(const char * name)
 {
-	struct srv_shared * shared = cpu.srv_shared;
 	struct chime_var * var;
 	int oid;
 
 	DBG1("name=%s", name);
 
-	objpool_lock();
-	oid = __dir_lst_lookup(&shared->dir, name);
-	objpool_unlock();
+	oid = __dir_lookup(name);
 
 	if (oid != OID_NULL) {
 		return oid;
@@ -572,18 +783,32 @@ static int __var_open(const char * name)
 	var->f_dat = NULL;
 	objpool_unlock();
 
-	if (__cpu_req_send(CHIME_REQ_VAR_CREATE, oid)) {
-		/* insert into directory */
-		objpool_lock();
-		__dir_lst_insert(&shared->dir, name, oid);
-		objpool_unlock();
-	} else {
+	__dir_lock();
+
+	/* another node may have opened it in the meantime */
+	if ((oid = __dir_lookup(name)) != OID_NULL) {
+		__dir_unlock();
+		/* release our object and use the existing one */
+		obj_free(var);
+		return oid;
+	}
+
+	oid = obj_oid(var);
+
+	if (!__cpu_req_send(CHIME_REQ_VAR_CREATE, oid)) {
+		__dir_unlock();
 		/* release the object */
-		free(var->rec);
 		obj_free(var);
 		return -1;
 	}
 
+	/* publish the name only after the create request is queued, 
+	   the requests of other nodes will be processed after it */
+	if (!__dir_insert(name, oid))
+		ERR("var \"%s\" directory insert failed!", name);
+
+	__dir_unlock();
+
 	return oid;
 }
 
@@ -629,6 +854,7 @@ bool chime_var_rec(int oid, double value)
 	req.hdr.node_id = cpu.node_id;
 	req.hdr.opc = CHIME_REQ_VAR_REC;
 	req.hdr.oid = oid;
+	req.hdr.ahead = __cpu_ahead_take();
 	req.val = value;
 
 	if ((ret = __mq_send(cpu.xmt_mq, &req, CHIME_REQ_VAR_REC_LEN)) < 0) {
@@ -641,15 +867,18 @@ bool chime_var_rec(int oid, double value)
 
 double chime_cpu_time(void)
 {
-	DBG5("time=%.9f", cpu.node->time);
+	DBG5("time=%.9f", cpu.time);
 
-	return cpu.node->time;
+	return cpu.time;
 }
 
 bool chime_cpu_temp_set(float temp) 
 {
 	DBG5("<%d> temp=%.2f dg.C", cpu.node_id, temp);
 
+	/* the clock period will change, stop running ahead */
+	cpu.horizon = cpu.clk;
+
 	return __cpu_req_float_set(CHIME_REQ_SIM_TEMP_SET, 0, temp);
 }
 
@@ -658,6 +887,97 @@ float chime_cpu_temp_get(void)
 	return cpu.node->temperature;
 }
 
+static bool __temp_prof_send(struct chime_temp_prof * prof)
+{
+	/* the clock period will change, stop running ahead */
+	cpu.horizon = cpu.clk;
+
+	/* the server takes ownership of the object */
+	if (!__cpu_req_send(CHIME_REQ_TEMP_PROF, obj_oid(prof))) {
+		obj_free(prof);
+		return false;
+	}
+
+	return true;
+}
+
+bool chime_cpu_temp_piecewise(const float time[], const float temp[], 
+							  int cnt, bool repeat)
+{
+	struct chime_temp_prof * prof;
+	int i;
+
+	if ((cnt < 1) || (cnt > TEMP_PROF_PTS_MAX)) {
+		ERR("<%d> invalid number of points: %d!", cpu.node_id, cnt);
+		return false;
+	}
+
+	if ((prof = obj_alloc()) == NULL) {
+		ERR("object allocation failed!");
+		return false;
+	}
+
+	prof->type = TEMP_PROF_PIECEWISE;
+	prof->repeat = repeat;
+	prof->cnt = cnt;
+	for (i = 0; i < cnt; ++i) {
+		prof->pt[i].t = time[i];
+		prof->pt[i].temp = temp[i];
+	}
+
+	return __temp_prof_send(prof);
+}
+
+bool chime_cpu_temp_sine(float mean, float ampl, float period)
+{
+	struct chime_temp_prof * prof;
+
+	if ((prof = obj_alloc()) == NULL) {
+		ERR("object allocation failed!");
+		return false;
+	}
+
+	prof->type = TEMP_PROF_SINE;
+	prof->repeat = true;
+	prof->cnt = 0;
+	prof->mean = mean;
+	prof->ampl = ampl;
+	prof->period = period;
+
+	return __temp_prof_send(prof);
+}
+
+/* Load a piecewise profile from a text file with one "<time> <temp>" 
+   pair per line. Lines starting with '#' are ignored. */
+bool chime_cpu_temp_table(const char * path, bool repeat)
+{
+	float time[TEMP_PROF_PTS_MAX];
+	float temp[TEMP_PROF_PTS_MAX];
+	char line[128];
+	FILE * f;
+	int n = 0;
+
+	if ((f = fopen(path, "r")) == NULL) {
+		ERR("fopen(\"%s\") failed: %s!", path, __strerr());
+		return false;
+	}
+
+	while (fgets(line, sizeof(line), f) != NULL) {
+		if (line[0] == '#')
+			continue;
+		if (sscanf(line, "%f %f", &time[n], &temp[n]) != 2)
+			continue;
+		if (++n == TEMP_PROF_PTS_MAX) {
+			WARN("\"%s\": too many points, truncated.", path);
+			break;
+		}
+	}
+
+	fclose(f);
+
+	return chime_cpu_temp_piecewise(time, temp, n, repeat);
+}
+
 float chime_cpu_freq_get(void) 
 {
 	return (double)SEC / cpu.node->dt;
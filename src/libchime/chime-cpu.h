@@ -22,8 +22,16 @@ struct cpu_tmr {
 	uint32_t rst_ticks;
 };
 
+/* Server managed timer */
+struct cpu_timer {
+	void (* isr)(void *);
+	void * arg;
+	uint32_t seq;
+};
+
 struct cpu_comm {
 	bool tx_busy;
+	bool tx_ack;
 	uint16_t oid;
 	uint16_t rx_len;
 	void * rx_buf;
@@ -33,7 +41,7 @@ struct cpu_comm {
 };
 
 #define CHIME_TIMER_MAX 16
-#define CHIME_CPU_COMM_MAX 16
+#define CHIME_CPU_COMM_MAX CHIME_NODE_COMM_MAX
 
 #define CHIME_CPU_FREQ_HZ 1000000
 
@@ -45,17 +53,38 @@ struct chime_cpu {
 	__mq_t xmt_mq;
 	__mq_t rcv_mq;
 	bool step_rcvd;
+	bool batch_pend; /* more events of the current batch are queued */
+	uint64_t horizon; /* run-ahead limit, clipped by our own requests */
+	uint64_t clk; /* node clock, loaded on each event and advanced locally */
+	uint64_t ticks;
+	double time;
+	uint32_t ahead; /* cycles run ahead, reported with the next request */
 	jmp_buf reset_env;
 	jmp_buf except_env;
 	void (* rst_isr)(void);
 	struct cpu_tmr tmr[CHIME_TIMER_MAX];
+	struct cpu_timer * timer; /* indexed by handle */
+	int timer_cnt;
+	int timer_len;
 	struct cpu_comm comm[CHIME_CPU_COMM_MAX];
 	struct srv_shared * srv_shared;
+	void * task; /* executor task, NULL if running on its own thread */
 };
 
 /* Per thread storage */
 extern __thread struct chime_cpu cpu;
 
+/* Take the cycles run ahead since the last request, the server advances 
+   the node clock by them before handling the request. */
+static inline uint32_t __cpu_ahead_take(void)
+{
+	uint32_t cycles = cpu.ahead;
+
+	cpu.ahead = 0;
+
+	return cycles;
+}
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -70,6 +99,16 @@ int __cpu_ctrl_task(struct chime_node * node);
 
 int __cpu_sim_loop(struct chime_node * node);
 
+bool __exec_enabled(void);
+
+int __exec_spawn(struct chime_node * node);
+
+void __exec_cancel(struct chime_node * node);
+
+void __exec_stop(void);
+
+void __exec_wait(void);
+
 #ifdef __cplusplus
 }
 #endif	
@@ -0,0 +1,275 @@
+/*
+ * File:	 chime-dir.c
+ * Author:   Robinson Mittmann (bobmittmann@gmail.com)
+ * Target:
+ * Comment:
+ * Copyright(C) 2013 Bob Mittmann. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+/*
+ * This file implements the shared name directory (name -> OID).
+ *
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+
+#define __CHIME_I__
+#include "chime-i.h"
+#include "objpool.h"
+
+static struct  {
+	char name[64];
+	__shm_t shm;
+	__mutex_t mutex; /* serializes the writers */
+	struct dir_lst * lst;
+	int ref; /* opened by the server and the client in one process */
+} dir_mgr;
+
+/* FNV-1a */
+static inline uint32_t __dir_hash(const char * name)
+{
+	uint32_t h = 2166136261u;
+	int c;
+
+	while ((c = *name++) != '\0') {
+		h ^= (uint8_t)c;
+		h *= 16777619u;
+	}
+
+	return h;
+}
+
+static inline uint32_t __dir_read_begin(struct dir_lst * lst)
+{
+	uint32_t seq;
+
+	/* wait for a pending insert to complete */
+	while ((seq = __atomic_load_n(&lst->seq, __ATOMIC_ACQUIRE)) & 1);
+
+	return seq;
+}
+
+static inline bool __dir_read_retry(struct dir_lst * lst, uint32_t seq)
+{
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	return __atomic_load_n(&lst->seq, __ATOMIC_RELAXED) != seq;
+}
+
+static inline void __dir_write_begin(struct dir_lst * lst)
+{
+	__atomic_store_n(&lst->seq, lst->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void __dir_write_end(struct dir_lst * lst)
+{
+	__atomic_store_n(&lst->seq, lst->seq + 1, __ATOMIC_RELEASE);
+}
+
+/* Lock free lookup. Returns OID_NULL if the name is not in the directory. */
+uint16_t __dir_lookup(const char * name)
+{
+	struct dir_lst * lst = dir_mgr.lst;
+	uint32_t hash = __dir_hash(name);
+	uint32_t seq;
+	int oid;
+	int i;
+
+	do {
+		seq = __dir_read_begin(lst);
+		oid = OID_NULL;
+		for (i = 0; i < DIR_HASH_SIZE; ++i) {
+			int j = (hash + i) & (DIR_HASH_SIZE - 1);
+			int x;
+
+			if ((x = lst->entry[j].oid) == OID_NULL)
+				break;
+			if (strncmp(name, lst->entry[j].name, ENTRY_NAME_MAX) == 0) {
+				oid = x;
+				break;
+			}
+		}
+	} while (__dir_read_retry(lst, seq));
+
+	DBG1("name=\"%s\" OID=%d probes=%d", name, oid, i + 1);
+
+	return oid;
+}
+
+/* Insert a new entry. The caller must hold the directory lock. */
+bool __dir_insert(const char * name, int oid)
+{
+	struct dir_lst * lst = dir_mgr.lst;
+	uint32_t hash = __dir_hash(name);
+	int i;
+	int j;
+
+	assert(oid != OID_NULL);
+
+	if (strlen(name) >= ENTRY_NAME_MAX) {
+		ERR("name \"%s\" too long!", name);
+		return false;
+	}
+
+	if (lst->cnt >= DIR_ENTRY_MAX) {
+		ERR("directory full!");
+		return false;
+	}
+
+	for (i = 0; i < DIR_HASH_SIZE; ++i) {
+		j = (hash + i) & (DIR_HASH_SIZE - 1);
+		if (lst->entry[j].oid == OID_NULL)
+			break;
+		if (strncmp(name, lst->entry[j].name, ENTRY_NAME_MAX) == 0) {
+			WARN("\"%s\" already in the directory!", name);
+			return false;
+		}
+	}
+
+	__dir_write_begin(lst);
+	strcpy(lst->entry[j].name, name);
+	lst->entry[j].oid = oid;
+	lst->cnt++;
+	__dir_write_end(lst);
+
+	DBG1("%4d - name=\"%s\" OID=%d", j, lst->entry[j].name, oid);
+
+	return true;
+}
+
+/* Remove all entries. The caller must hold the directory lock. */
+void __dir_clear(void)
+{
+	struct dir_lst * lst = dir_mgr.lst;
+
+	DBG1("lst->cnt=%d.", lst->cnt);
+
+	__dir_write_begin(lst);
+	memset(lst->entry, 0, sizeof(lst->entry));
+	lst->cnt = 0;
+	__dir_write_end(lst);
+}
+
+/* Create the named directory segment. */
+int __dir_create(const char * name)
+{
+	int ret;
+
+	sprintf(dir_mgr.name, "%s.dir", name);
+
+	/* remove posibly existing files from the filesystem */
+	__mutex_unlink(dir_mgr.name);
+	__shm_unlink(dir_mgr.name);
+
+	if ((ret = __mutex_create(&dir_mgr.mutex, dir_mgr.name)) < 0) {
+		ERR("__mutex_create(\"%s\") failed: %s!", dir_mgr.name, __strerr());
+		return ret;
+	}
+
+	if ((ret = __shm_create(&dir_mgr.shm, dir_mgr.name,
+							sizeof(struct dir_lst))) < 0) {
+		ERR("__shm_create(\"%s\") failed: %s!", dir_mgr.name, __strerr());
+		return ret;
+	}
+
+	if ((dir_mgr.lst = __shm_mmap(dir_mgr.shm)) == NULL) {
+		ERR("__shm_mmap() failed: %s!", __strerr());
+		return -1;
+	}
+
+	DBG1("dir_mgr.lst=%p size=%d", dir_mgr.lst, (int)sizeof(struct dir_lst));
+
+	dir_mgr.lst->seq = 0;
+	__dir_clear();
+	dir_mgr.lst->magic = DIR_LST_MAGIC;
+	dir_mgr.ref = 1;
+
+	return 0;
+}
+
+/* Open an existing named directory. */
+int __dir_open(const char * name)
+{
+	char path[64];
+
+	sprintf(path, "%s.dir", name);
+	if ((dir_mgr.ref > 0) && (strcmp(dir_mgr.name, path) == 0)) {
+		/* already mapped in this process */
+		dir_mgr.ref++;
+		return 0;
+	}
+
+	strcpy(dir_mgr.name, path);
+
+	if (__mutex_open(&dir_mgr.mutex, dir_mgr.name) < 0) {
+		ERR("__mutex_open(\"%s\") failed!", dir_mgr.name);
+		return -1;
+	}
+
+	if (__shm_open(&dir_mgr.shm, dir_mgr.name) < 0) {
+		ERR("__shm_open(\"%s\") failed!", dir_mgr.name);
+		return -1;
+	}
+
+	if ((dir_mgr.lst = __shm_mmap(dir_mgr.shm)) == NULL) {
+		ERR("__shm_mmap() failed!");
+		return -1;
+	}
+
+	if (dir_mgr.lst->magic != DIR_LST_MAGIC) {
+		ERR("invalid directory magic number!");
+		return -1;
+	}
+
+	dir_mgr.ref = 1;
+
+	return 0;
+}
+
+void __dir_close(void)
+{
+	if (--dir_mgr.ref > 0)
+		return;
+
+	__shm_munmap(dir_mgr.shm, dir_mgr.lst);
+	dir_mgr.lst = NULL;
+
+	__shm_close(dir_mgr.shm);
+	__mutex_close(dir_mgr.mutex);
+}
+
+void __dir_destroy(void)
+{
+	__shm_unlink(dir_mgr.name);
+	__mutex_unlink(dir_mgr.name);
+}
+
+/* The directory lock serializes the writers. The readers are lock free.
+   It is held while a create request is sent to the server, so it must 
+   never be taken by the server thread. */
+void __dir_lock(void)
+{
+	__mutex_lock(dir_mgr.mutex);
+}
+
+void __dir_unlock(void)
+{
+	__mutex_unlock(dir_mgr.mutex);
+}
+
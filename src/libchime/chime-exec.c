@@ -0,0 +1,418 @@
+/*
+ * File:	 chime-exec.c
+ * Author:   Robinson Mittmann (bobmittmann@gmail.com)
+ * Target:
+ * Comment:
+ * Copyright(C) 2013 Bob Mittmann. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+/*
+ * M:N executor: simulated CPUs run as coroutines multiplexed over a
+ * fixed set of worker threads. A CPU yields back to its worker when it
+ * would block waiting for an event and is resumed when its event queue
+ * becomes readable.
+ *
+ * Tasks stay on the worker they were assigned to. The CPU state is
+ * thread local (see chime-cpu.h) and the compiler is free to cache
+ * the thread pointer across a context switch, so a task must never
+ * migrate.
+ *
+ * For the same reason a task is only released by its own worker: 
+ * __exec_cancel() posts the request through the worker's control 
+ * descriptor and waits for it to complete.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define __CHIME_CPU__
+#include "chime-cpu.h"
+
+#if defined(__linux__)
+
+#include <ucontext.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#define EXEC_WORKER_MAX 64
+#define EXEC_STACK_SIZE (256 * 1024)
+#define EXEC_EVENT_MAX 16
+
+struct exec_worker;
+
+struct exec_task {
+	ucontext_t ctx;
+	struct chime_node * node;
+	struct exec_worker * worker;
+	struct chime_cpu cpu; /* CPU state while suspended */
+	void * stack;
+	bool ready; /* resumed with an event pending */
+	bool done;
+};
+
+struct exec_worker {
+	__thread_t thread;
+	int epfd;
+	int ctlfd; /* cancel requests */
+	ucontext_t ctx;
+	struct exec_task * task; /* running task */
+	__mutex_t mutex; /* one cancel request at a time */
+	__sem_t done_sem;
+	struct chime_node * cancel; /* node to be cancelled */
+};
+
+static struct {
+	int cnt;
+	uint32_t seq;
+	__mutex_t mutex; /* node to task links */
+	struct exec_worker worker[EXEC_WORKER_MAX];
+} executor;
+
+/* Worker of the calling thread */
+static __thread struct exec_worker * exec_self;
+
+static void __exec_resume(struct exec_worker * w, struct exec_task * task)
+{
+	struct epoll_event ev;
+
+	w->task = task;
+	task->ready = true;
+	cpu = task->cpu;
+	swapcontext(&w->ctx, &task->ctx);
+	w->task = NULL;
+
+	if (task->done) {
+		DBG1("<%d> task done.", task->node->id);
+		epoll_ctl(w->epfd, EPOLL_CTL_DEL, (int)task->node->c.rcv_mq, NULL);
+		__mutex_lock(executor.mutex);
+		task->node->c.task = NULL;
+		__mutex_unlock(executor.mutex);
+		free(task->stack);
+		free(task);
+		return;
+	}
+
+	/* wait for the next event */
+	ev.events = EPOLLIN | EPOLLONESHOT;
+	ev.data.ptr = task;
+	if (epoll_ctl(w->epfd, EPOLL_CTL_MOD,
+				  (int)task->node->c.rcv_mq, &ev) < 0) {
+		ERR("epoll_ctl() failed: %s.", __strerr());
+	}
+}
+
+/* Release a task suspended on this worker. The events already 
+   collected for it in 'ev' are dropped. */
+static void __exec_release(struct exec_worker * w, struct chime_node * node,
+						   struct epoll_event ev[], int n)
+{
+	struct exec_task * task = node->c.task;
+	int i;
+
+	/* the task is gone already */
+	if (task == NULL)
+		return;
+
+	DBG1("<%s> task cancelled.", node->name);
+
+	epoll_ctl(w->epfd, EPOLL_CTL_DEL, (int)node->c.rcv_mq, NULL);
+	__mutex_lock(executor.mutex);
+	node->c.task = NULL;
+	__mutex_unlock(executor.mutex);
+
+	for (i = 0; i < n; ++i) {
+		if (ev[i].data.ptr == task)
+			ev[i].data.ptr = NULL;
+	}
+
+	free(task->stack);
+	free(task);
+}
+
+static void * __exec_worker_task(struct exec_worker * w)
+{
+	struct epoll_event ev[EXEC_EVENT_MAX];
+	uint64_t val;
+	int n;
+	int i;
+
+	__thread_init("EXEC");
+	__thread_placement(false);
+	exec_self = w;
+
+	for (;;) {
+		if ((n = epoll_wait(w->epfd, ev, EXEC_EVENT_MAX, -1)) < 0) {
+			if (errno == EINTR)
+				continue;
+			ERR("epoll_wait() failed: %s.", __strerr());
+			break;
+		}
+
+		for (i = 0; i < n; ++i) {
+			if (ev[i].data.ptr == w) {
+				/* cancel request */
+				if (read(w->ctlfd, &val, sizeof(val)) < 0)
+					ERR("read() failed: %s.", __strerr());
+				__exec_release(w, w->cancel, &ev[i + 1], n - i - 1);
+				__sem_post(w->done_sem);
+			} else if (ev[i].data.ptr != NULL) {
+				__exec_resume(w, (struct exec_task *)ev[i].data.ptr);
+			}
+		}
+	}
+
+	return NULL;
+}
+
+static void __exec_task_entry(void)
+{
+	struct exec_task * task = exec_self->task;
+
+	cpu.task = task;
+	__cpu_sim_loop(task->node);
+
+	/* back to the worker through uc_link */
+	task->done = true;
+}
+
+/* Called by a CPU before blocking on its event queue */
+void __exec_wait(void)
+{
+	struct exec_task * task = cpu.task;
+
+	if (!task->ready) {
+		task->cpu = cpu;
+		swapcontext(&task->ctx, &task->worker->ctx);
+	}
+
+	/* consume the readiness notification */
+	task->ready = false;
+}
+
+bool __exec_enabled(void)
+{
+	return (executor.cnt > 0);
+}
+
+int __exec_spawn(struct chime_node * node)
+{
+	struct epoll_event ev;
+	struct exec_task * task;
+	struct exec_worker * w;
+
+	if ((task = calloc(1, sizeof(struct exec_task))) == NULL)
+		return -1;
+
+	if ((task->stack = malloc(EXEC_STACK_SIZE)) == NULL) {
+		free(task);
+		return -1;
+	}
+
+	w = &executor.worker[executor.seq++ % executor.cnt];
+	task->node = node;
+	task->worker = w;
+	node->c.task = task;
+
+	getcontext(&task->ctx);
+	task->ctx.uc_stack.ss_sp = task->stack;
+	task->ctx.uc_stack.ss_size = EXEC_STACK_SIZE;
+	task->ctx.uc_link = &w->ctx;
+	makecontext(&task->ctx, __exec_task_entry, 0);
+
+	/* the task starts with the first event (JOIN) */
+	ev.events = EPOLLIN | EPOLLONESHOT;
+	ev.data.ptr = task;
+	if (epoll_ctl(w->epfd, EPOLL_CTL_ADD, (int)node->c.rcv_mq, &ev) < 0) {
+		ERR("epoll_ctl() failed: %s.", __strerr());
+		node->c.task = NULL;
+		free(task->stack);
+		free(task);
+		return -1;
+	}
+
+	DBG1("<%s> spawned on worker %d.", node->name,
+		 (int)(w - executor.worker));
+
+	return 0;
+}
+
+/* Unschedule the task of a CPU and release it with its stack. 
+   A running task is released after it yields. */
+void __exec_cancel(struct chime_node * node)
+{
+	struct exec_task * task;
+	struct exec_worker * w = NULL;
+	uint64_t val = 1;
+
+	/* the task may complete on its worker meanwhile */
+	if (executor.cnt > 0) {
+		__mutex_lock(executor.mutex);
+		if ((task = node->c.task) != NULL)
+			w = task->worker;
+		__mutex_unlock(executor.mutex);
+	}
+
+	if (w == NULL)
+		return;
+
+	/* a task can't release itself */
+	if (exec_self == w) {
+		WARN("<%s> cancelling from its own worker.", node->name);
+		return;
+	}
+
+	__mutex_lock(w->mutex);
+
+	w->cancel = node;
+	if (write(w->ctlfd, &val, sizeof(val)) < 0) {
+		ERR("write() failed: %s.", __strerr());
+	} else {
+		__sem_wait(w->done_sem);
+	}
+	w->cancel = NULL;
+
+	__mutex_unlock(w->mutex);
+}
+
+/* Stop the workers, the tasks must be cancelled already */
+void __exec_stop(void)
+{
+	int i;
+
+	for (i = 0; i < executor.cnt; ++i) {
+		struct exec_worker * w = &executor.worker[i];
+
+		DBG1("worker %d cancel...", i);
+		__thread_cancel(w->thread);
+		__thread_join(w->thread, NULL);
+		close(w->ctlfd);
+		close(w->epfd);
+		__mutex_close(w->mutex);
+		__sem_close(w->done_sem);
+	}
+
+	if (executor.cnt > 0)
+		__mutex_close(executor.mutex);
+
+	executor.cnt = 0;
+	executor.seq = 0;
+}
+
+int chime_executor_set(int workers)
+{
+	int i;
+
+	if (executor.cnt > 0) {
+		ERR("executor already running.");
+		return -1;
+	}
+
+	if (workers < 0)
+		workers = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (workers > EXEC_WORKER_MAX)
+		workers = EXEC_WORKER_MAX;
+
+	if (workers > 0)
+		__mutex_init(&executor.mutex);
+
+	for (i = 0; i < workers; ++i) {
+		struct exec_worker * w = &executor.worker[i];
+		struct epoll_event ev;
+
+		if ((w->epfd = epoll_create1(0)) < 0) {
+			ERR("epoll_create1() failed: %s.", __strerr());
+			return -1;
+		}
+
+		if ((w->ctlfd = eventfd(0, 0)) < 0) {
+			ERR("eventfd() failed: %s.", __strerr());
+			close(w->epfd);
+			return -1;
+		}
+
+		ev.events = EPOLLIN;
+		ev.data.ptr = w;
+		if (epoll_ctl(w->epfd, EPOLL_CTL_ADD, w->ctlfd, &ev) < 0) {
+			ERR("epoll_ctl() failed: %s.", __strerr());
+			close(w->ctlfd);
+			close(w->epfd);
+			return -1;
+		}
+
+		__mutex_init(&w->mutex);
+		__sem_init(&w->done_sem, 0, 0);
+		w->cancel = NULL;
+
+		if (__thread_create(&w->thread,
+							(void * (*)(void *))__exec_worker_task,
+							(void *)w) < 0) {
+			ERR("__thread_create() failed.");
+			__mutex_close(w->mutex);
+			__sem_close(w->done_sem);
+			close(w->ctlfd);
+			close(w->epfd);
+			return -1;
+		}
+
+		/* make the worker visible as soon as it's running */
+		executor.cnt = i + 1;
+	}
+
+	INF("%d workers.", executor.cnt);
+
+	return 0;
+}
+
+#else
+
+void __exec_wait(void)
+{
+}
+
+bool __exec_enabled(void)
+{
+	return false;
+}
+
+int __exec_spawn(struct chime_node * node)
+{
+	return -1;
+}
+
+void __exec_cancel(struct chime_node * node)
+{
+}
+
+void __exec_stop(void)
+{
+}
+
+int chime_executor_set(int workers)
+{
+	if (workers == 0)
+		return 0;
+
+	ERR("not supported on this platform.");
+	return -1;
+}
+
+#endif
+
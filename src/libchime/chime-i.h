@@ -40,6 +40,7 @@
 #include <sys/param.h>
 #include <sys/stat.h>
 #include <sys/time.h>
+#include <sys/socket.h>
 #include <unistd.h>
 #include <fcntl.h>
 #endif
@@ -60,7 +61,7 @@ typedef mqd_t __mq_t;
 typedef int __shm_t;
 typedef sem_t * __mutex_t;
 typedef sem_t * __sem_t;
-typedef pthread_t * __thread_t;
+typedef pthread_t __thread_t;
 typedef int __fd_t;
 #endif
 
@@ -125,7 +126,10 @@ enum {
 	CHIME_REQ_VAR_REC,
 	CHIME_REQ_VAR_DUMP,
 
-	CHIME_REQ_CPU_RESET
+	CHIME_REQ_CPU_RESET,
+	CHIME_REQ_TEMP_PROF,
+	CHIME_REQ_TIMER_ARM,
+	CHIME_REQ_TIMER_CANCEL
 };
 
 static const char __req_opc_nm[][16] = {
@@ -175,6 +179,9 @@ static const char __req_opc_nm[][16] = {
 	"DUMP",
 
 	"CPU RESET",
+	"TEMP PROF",
+	"TIMER ARM",
+	"TIMER CANCEL",
 };
 
 /* Request header */
@@ -182,6 +189,7 @@ struct chime_req_hdr {
 	uint8_t node_id;
 	int8_t opc;
 	uint16_t oid;
+	uint32_t ahead; /* cycles the CPU ran ahead since its last request */
 } __attribute__((aligned(4)));
 
 #define CHIME_REQ_HDR_LEN sizeof(struct chime_req_hdr)
@@ -220,6 +228,16 @@ struct chime_req_timer {
 
 #define CHIME_REQ_TIMER_LEN CHIME_REQ_LEN(chime_req_timer)
 
+/* Server managed timer arm request, the handle goes in hdr.oid */
+struct chime_req_timer_arm {
+	struct chime_req_hdr hdr;
+	uint32_t ticks;
+	uint32_t period;
+	uint32_t seq;
+} __attribute__((aligned(4)));
+
+#define CHIME_REQ_TIMER_ARM_LEN CHIME_REQ_LEN(chime_req_timer_arm)
+
 /* Breakpoint register request */
 struct chime_req_bkpt {
 	struct chime_req_hdr hdr;
@@ -232,6 +250,7 @@ struct chime_req_comm {
 	struct chime_req_hdr hdr;
 	uint16_t buf_oid;
 	uint16_t buf_len;
+	uint8_t dst; /* destination address */
 } __attribute__((aligned(4)));
 
 #define CHIME_REQ_COMM_LEN CHIME_REQ_LEN(chime_req_comm)
@@ -279,12 +298,14 @@ struct chime_request {
 			uint8_t node_id;
 			int8_t opc;
 			uint16_t oid;
+			uint32_t ahead;
 		};
 		struct chime_req_join join;
 		struct chime_req_step step;
 		struct chime_req_trace trace;
 		struct chime_req_comm comm;
 		struct chime_req_timer timer;
+		struct chime_req_timer_arm timer_arm;
 		struct chime_req_float_set temp;
 		struct chime_req_float_set speed;
 		struct chime_req_abort abort;
@@ -322,9 +343,14 @@ enum {
 	CHIME_EVT_KICK_OUT,
 	CHIME_EVT_RESET,
 	CHIME_EVT_STEP,
-	CHIME_EVT_PROBE
+	CHIME_EVT_PROBE,
+	CHIME_EVT_TIMER, /* server managed timer, the handle goes in oid */
+	CHIME_EVT_WHEEL /* timing wheel slot, never sent to a node */
 };
 
+/* Opcode flag: more events to the same node follow in this batch */
+#define CHIME_EVT_MORE 0x40
+
 static const char __evt_opc_nm[][8] = {
 	"TMR0",
 	"TMR1",
@@ -348,7 +374,9 @@ static const char __evt_opc_nm[][8] = {
 	"KICK",
 	"RESET",
 	"STEP",
-	"PROB"
+	"PROB",
+	"TIMER",
+	"WHEEL"
 };
 
 struct chime_event {
@@ -382,15 +410,27 @@ struct cpu_info {
  * Chime directory list
  *****************************************************************************/
 
-#define ENTRY_NAME_MAX 12
+#define ENTRY_NAME_MAX 32
 #define SRV_SHARED_OID 1
 
+/* Open addressing hash table, must be a power of 2 */
+#define DIR_HASH_SIZE 4096
+/* Keep the load factor below 3/4 to bound the probe sequences */
+#define DIR_ENTRY_MAX ((DIR_HASH_SIZE * 3) / 4)
+
+#define DIR_LST_MAGIC 0xd1c7ab1e
+
+/* The directory lives in its own shared memory segment. Lookups are 
+   lock free, guarded by the sequence counter (odd while an insert is 
+   in progress). Writers are serialized by the object pool mutex. */
 struct dir_lst {
-	uint8_t cnt;
+	uint32_t magic;
+	volatile uint32_t seq;
+	uint32_t cnt;
 	struct {
 		uint16_t oid;
 		char name[ENTRY_NAME_MAX];
-	} entry[0];
+	} entry[DIR_HASH_SIZE];
 };
 
 #define SRV_SHARED_MAGIC 0xbeadc0de
@@ -398,13 +438,14 @@ struct dir_lst {
 struct srv_shared {
 	uint32_t magic;
 	double time; /* simulation time */
-	struct dir_lst dir;
 };
 
 /*****************************************************************************
  * Node
  *****************************************************************************/
 
+#define CHIME_NODE_COMM_MAX 16 /* COMM channels per node */
+
 struct chime_node {
 	uint8_t id;
 	char name[63];
@@ -416,17 +457,34 @@ struct chime_node {
 	double dres; /* clock resolution in femptoseconds/microssecond */
 	double period; /* temperature corrected resolution */
 	uint64_t dt; /* temperature corrected clock resolution */
-	uint64_t clk;
+	uint64_t clk; /* updated by the server only, see chime_cpu_step() */
+	volatile uint64_t horizon; /* the CPU may step on its own up to here */
 	uint64_t ticks;
 	double time;
 	uint32_t sid; /* session id */
 	volatile uint32_t probe_seq; /* probe sequence number */
+	struct {
+		uint64_t run_ns; /* wall time running ISRs and reset handlers */
+		uint64_t wait_ns; /* wall time blocked waiting for events */
+		uint64_t mark_ns; /* wall clock at the last run/wait transition */
+		uint64_t cycles; /* simulated CPU cycles advanced */
+		uint64_t ticks; /* CPU ticks at the last event */
+		uint32_t evt_cnt; /* events handled */
+	} prof; /* CPU thread profiling, updated by the client only */
+	struct {
+		uint16_t oid; /* COMM attached to the channel */
+		uint32_t frm_cnt;
+		uint32_t drop_cnt; /* frames rejected with the transmitter busy */
+		uint64_t byte_cnt;
+		uint64_t busy; /* medium busy time */
+	} tx[CHIME_NODE_COMM_MAX]; /* per channel live counters */
 	struct {
 		struct chime_client * client;
 		struct srv_shared * srv_shared;
 		__mq_t rcv_mq;
 		__mq_t xmt_mq;
 		__thread_t thread;
+		void * task; /* executor task, NULL if running on a thread */
 		int except;
 		__sem_t except_sem;
 		void (* on_reset)(void);
@@ -434,11 +492,62 @@ struct chime_node {
 
 	struct {
 		__mq_t evt_mq;
+		uint32_t step; /* last simulation step this node was dispatched */
+		struct chime_event pend; /* last event of the batch being built */
+		uint16_t prof_oid; /* temperature profile */
+		uint64_t prof_start; /* clock at profile time zero */
+		uint64_t prof_next; /* clock of the next profile breakpoint */
+		bool rst_pend; /* reset sent, waiting for the CPU to init */
 	} s; /* server side only */
 };
 
 #define CHIME_NODE_MAX 255
 
+/*****************************************************************************
+ * Live state page
+ *****************************************************************************/
+
+#define LIVE_PAGE_MAGIC 0x11fe5a9e
+
+/* The live page lives in its own shared memory segment. It is written 
+   by the server control thread only, guarded by the sequence counter 
+   (odd while an update is in progress). Readers copy it out and retry 
+   if the counter changed, the simulation is never held. */
+struct live_page {
+	uint32_t magic;
+	volatile uint32_t seq;
+	uint32_t step_cnt;
+	uint32_t heap_len;
+	uint32_t heap_peak;
+	uint64_t clk; /* simulation clock */
+	uint64_t evt_cnt;
+	float speed; /* simulated over wall time */
+	float speed_set; /* requested speed */
+	uint32_t tick_lost; /* timer ticks the simulation couldn't keep up with */
+	bool paused;
+	/* sampled along with the speed */
+	uint32_t pool_alloc;
+	uint32_t pool_size;
+	uint32_t comm_cnt;
+	struct {
+		char name[ENTRY_NAME_MAX];
+		float util;
+		float util_peak;
+		uint64_t frm_cnt;
+		uint32_t drop_cnt;
+	} comm[CHIME_LIVE_COMM_MAX];
+	struct {
+		uint8_t state; /* CHIME_NODE_NONE, CHIME_NODE_WAIT, ... */
+		float temperature;
+		uint64_t clk;
+		uint64_t ticks;
+		/* sampled along with the speed */
+		uint32_t evt_cnt;
+		float load; /* wall time per simulated second */
+		char name[ENTRY_NAME_MAX];
+	} node[CHIME_NODE_MAX + 1];
+};
+
 /*****************************************************************************
  * Random number generators state
  *****************************************************************************/
@@ -457,10 +566,49 @@ struct exp_rand_state {
 #define CHIME_COMM_MAX CHIME_NODE_MAX
 #define COMM_STAT_BINS 256
 
+/* utilization sliding window: 10 slots of 100ms */
+#define COMM_WIN_SLOTS 10
+#define COMM_WIN_SLOT (100 * MSEC)
+
+/* node id bitmaps */
+#define NODE_MAP_LEN ((CHIME_NODE_MAX + 32) / 32)
+#define NODE_MAP_SET(MAP, ID) ((MAP)[(ID) / 32] |= (1U << ((ID) % 32)))
+#define NODE_MAP_CLR(MAP, ID) ((MAP)[(ID) / 32] &= ~(1U << ((ID) % 32)))
+#define NODE_MAP_TST(MAP, ID) (((MAP)[(ID) / 32] & (1U << ((ID) % 32))) != 0)
+
 struct chime_comm {
 	struct comm_attr attr;
 	char name[ENTRY_NAME_MAX];
 	uint8_t node_lst[CHIME_NODE_MAX + 1];
+	/* nodes with a receive/carrier detect handler. The server
+	   only schedules RCV and DCD events for these. */
+	uint32_t rcv_map[NODE_MAP_LEN];
+	uint32_t dcd_map[NODE_MAP_LEN];
+	/* node addresses, indexed by node id */
+	uint8_t addr[CHIME_NODE_MAX + 1];
+	/* token MAC state and statistics */
+	struct {
+		uint64_t clk; /* time the token reaches the holder */
+		uint8_t id; /* token holder */
+		uint64_t pass_cnt; /* token passes */
+		uint64_t frm_cnt; /* frames transmitted */
+		uint64_t nak_cnt; /* frames not acknowledged */
+		uint64_t wait_sum; /* sum of the token wait times */
+	} tok;
+	/* live transmission counters */
+	struct {
+		uint64_t frm_cnt;
+		uint64_t byte_cnt;
+		uint64_t busy; /* medium busy time */
+		uint32_t drop_cnt; /* frames rejected with the transmitter busy */
+		uint32_t inflight_max; /* frames in flight at the same time */
+		float util; /* utilization over the last window (percent) */
+		float util_peak;
+		uint32_t win_idx;
+		uint64_t win_clk; /* start of the current window slot */
+		uint64_t win_busy[COMM_WIN_SLOTS];
+	} tx;
+	uint64_t * eot; /* end of the last frame of each node, server only */
 	uint32_t cnt;
 	uint64_t randseed0;
 	uint64_t randseed1;
@@ -471,6 +619,32 @@ struct chime_comm {
 	uint32_t * stat;
 };
 
+/*****************************************************************************
+ * Temperature profile
+ *****************************************************************************/
+
+#define TEMP_PROF_PTS_MAX 120
+
+enum {
+	TEMP_PROF_PIECEWISE = 0,
+	TEMP_PROF_SINE
+};
+
+/* Temperature profile. Allocated by the CPU and handed over 
+   to the server, which evaluates it as the simulation runs. */
+struct chime_temp_prof {
+	uint8_t type;
+	bool repeat; /* piecewise: restart after the last point */
+	uint16_t cnt;
+	float mean; /* sine: mean temperature */
+	float ampl; /* sine: amplitude */
+	float period; /* sine: period in seconds */
+	struct {
+		float t; /* seconds from the profile start */
+		float temp;
+	} pt[TEMP_PROF_PTS_MAX];
+};
+
 /*****************************************************************************
  * Variable
  *****************************************************************************/
@@ -510,6 +684,13 @@ struct chime_timer {
  * Chime Message Queue OS wrappers
  *****************************************************************************/
 
+enum {
+	MQ_TRANSPORT_POSIX = 0, /* POSIX message queues */
+	MQ_TRANSPORT_UNIX /* Unix domain datagram sockets */
+};
+
+extern int __mq_transport;
+
 static inline int __mq_send(__mq_t mq, const void * msg, size_t len)
 {
 	int ret;
@@ -520,7 +701,10 @@ static inline int __mq_send(__mq_t mq, const void * msg, size_t len)
 	else
 		ret = -1;
 #else
-	ret = mq_send(mq, (char *)msg, len, 0);
+	if (__mq_transport == MQ_TRANSPORT_UNIX)
+		ret = send((int)mq, msg, len, 0);
+	else
+		ret = mq_send(mq, (char *)msg, len, 0);
 #endif
 	return ret;
 
@@ -536,7 +720,10 @@ static inline int __mq_recv(__mq_t mq, void * msg, size_t len)
 	else
 		ret = -1;
 #else
-	ret = mq_receive(mq, (char *)msg, len, NULL);
+	if (__mq_transport == MQ_TRANSPORT_UNIX)
+		ret = recv((int)mq, msg, len, 0);
+	else
+		ret = mq_receive(mq, (char *)msg, len, NULL);
 #endif
 	return ret;
 }
@@ -554,6 +741,8 @@ extern "C" {
  * Message queues
  *****************************************************************************/
 
+int __mq_transport_set(const char * name);
+
 int __mq_create(__mq_t * qp, const char * name, unsigned int maxmsg);
 
 int __mq_open(__mq_t * qp, const char * name);
@@ -628,6 +817,12 @@ int __thread_cancel(__thread_t thread);
 
 int __thread_join(__thread_t thread, void ** value_ptr);
 
+int __thread_affinity_set(int core);
+
+int __numa_cores(uint8_t node[], uint16_t core[], int max);
+
+void __thread_placement(bool ctrl);
+
 /*****************************************************************************
  * Error
  *****************************************************************************/
@@ -638,7 +833,7 @@ const char * __strerr(void);
  * Interval timer
  *****************************************************************************/
 
-int __itmr_init(uint32_t period, void (* isr)(void));
+int __itmr_init(uint32_t interval_us, void (* isr)(void));
 
 int __itmr_stop(void);
 
@@ -656,15 +851,54 @@ int __chime_trace_init(void);
 
 void __msleep(unsigned int ms);
 
+uint64_t __clock_ns(void);
+
 uint64_t __chime_clock(void);
 
 void __term_sig_handler(void (* handler)(void));
 
-void __dir_lst_clear(struct dir_lst * lst);
+/*****************************************************************************
+ * Shared directory
+ *****************************************************************************/
+
+int __dir_create(const char * name);
 
-uint16_t __dir_lst_lookup(struct dir_lst * lst, const char * name);
+int __dir_open(const char * name);
 
-bool __dir_lst_insert(struct dir_lst * lst, const char * name, int oid);
+void __dir_close(void);
+
+void __dir_destroy(void);
+
+void __dir_clear(void);
+
+uint16_t __dir_lookup(const char * name);
+
+bool __dir_insert(const char * name, int oid);
+
+void __dir_lock(void);
+
+void __dir_unlock(void);
+
+/*****************************************************************************
+ * Live state page
+ *****************************************************************************/
+
+int __live_create(const char * name);
+
+void __live_destroy(void);
+
+struct live_page * __live_page(void);
+
+static inline void __live_write_begin(struct live_page * pg)
+{
+	__atomic_store_n(&pg->seq, pg->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void __live_write_end(struct live_page * pg)
+{
+	__atomic_store_n(&pg->seq, pg->seq + 1, __ATOMIC_RELEASE);
+}
 
 /*****************************************************************************
  * Random number generators
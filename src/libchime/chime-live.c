@@ -0,0 +1,240 @@
+/*
+ * File:	 chime-live.c
+ * Author:   Robinson Mittmann (bobmittmann@gmail.com)
+ * Target:
+ * Comment:
+ * Copyright(C) 2013 Bob Mittmann. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+/*
+ * This file implements the shared live state page. The server
+ * publishes the simulation state in it, monitoring tools read it
+ * without sending requests to the server.
+ *
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+
+#define __CHIME_I__
+#include "chime-i.h"
+
+static struct  {
+	char name[64];
+	__shm_t shm;
+	struct live_page * pg;
+	int ref; /* opened by the server and a reader in one process */
+} live_mgr;
+
+/* An update takes microseconds, a page held longer than this was
+   left half written by a server that is gone. */
+#define LIVE_READ_TMO_MS 100
+
+static inline bool __live_read_begin(struct live_page * pg, uint32_t * seqp,
+									 uint64_t deadline)
+{
+	unsigned int n = 0;
+	uint32_t seq;
+
+	/* wait for a pending update to complete, checking the
+	   clock once in a while only */
+	while ((seq = __atomic_load_n(&pg->seq, __ATOMIC_ACQUIRE)) & 1) {
+		if (((++n & 0x3ff) == 0) && (__clock_ns() > deadline))
+			return false;
+	}
+
+	*seqp = seq;
+	return true;
+}
+
+static inline bool __live_read_retry(struct live_page * pg, uint32_t seq)
+{
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	return __atomic_load_n(&pg->seq, __ATOMIC_RELAXED) != seq;
+}
+
+struct live_page * __live_page(void)
+{
+	return live_mgr.pg;
+}
+
+/* Create the named live state segment. */
+int __live_create(const char * name)
+{
+	int ret;
+
+	sprintf(live_mgr.name, "%s.live", name);
+
+	/* remove posibly existing files from the filesystem */
+	__shm_unlink(live_mgr.name);
+
+	if ((ret = __shm_create(&live_mgr.shm, live_mgr.name,
+							sizeof(struct live_page))) < 0) {
+		ERR("__shm_create(\"%s\") failed: %s!", live_mgr.name, __strerr());
+		return ret;
+	}
+
+	if ((live_mgr.pg = __shm_mmap(live_mgr.shm)) == NULL) {
+		ERR("__shm_mmap() failed: %s!", __strerr());
+		return -1;
+	}
+
+	DBG1("live_mgr.pg=%p size=%d", live_mgr.pg,
+		 (int)sizeof(struct live_page));
+
+	memset(live_mgr.pg, 0, sizeof(struct live_page));
+	live_mgr.pg->magic = LIVE_PAGE_MAGIC;
+	live_mgr.ref = 1;
+
+	return 0;
+}
+
+static void __live_close(void)
+{
+	if (--live_mgr.ref > 0)
+		return;
+
+	__shm_munmap(live_mgr.shm, live_mgr.pg);
+	live_mgr.pg = NULL;
+
+	__shm_close(live_mgr.shm);
+}
+
+void __live_destroy(void)
+{
+	__live_close();
+	__shm_unlink(live_mgr.name);
+}
+
+int chime_live_open(const char * name)
+{
+	char path[64];
+
+	sprintf(path, "%s.live", name);
+	if ((live_mgr.ref > 0) && (strcmp(live_mgr.name, path) == 0)) {
+		/* already mapped in this process */
+		live_mgr.ref++;
+		return 0;
+	}
+
+	strcpy(live_mgr.name, path);
+
+	if (__shm_open(&live_mgr.shm, live_mgr.name) < 0) {
+		ERR("__shm_open(\"%s\") failed!", live_mgr.name);
+		return -1;
+	}
+
+	if ((live_mgr.pg = __shm_mmap(live_mgr.shm)) == NULL) {
+		ERR("__shm_mmap() failed!");
+		__shm_close(live_mgr.shm);
+		return -1;
+	}
+
+	if (live_mgr.pg->magic != LIVE_PAGE_MAGIC) {
+		ERR("invalid live page magic number!");
+		__shm_munmap(live_mgr.shm, live_mgr.pg);
+		__shm_close(live_mgr.shm);
+		live_mgr.pg = NULL;
+		return -1;
+	}
+
+	live_mgr.ref = 1;
+
+	return 0;
+}
+
+void chime_live_close(void)
+{
+	if (live_mgr.ref > 0)
+		__live_close();
+}
+
+int chime_live_read(struct chime_live * live)
+{
+	struct live_page * pg = live_mgr.pg;
+	struct live_page cp;
+	uint64_t deadline;
+	uint32_t seq;
+	int n;
+	int i;
+
+	if (pg == NULL)
+		return -1;
+
+	deadline = __clock_ns() + (uint64_t)LIVE_READ_TMO_MS * 1000000LL;
+	for (;;) {
+		if (!__live_read_begin(pg, &seq, deadline)) {
+			DBG1("live page update pending for too long!");
+			return -1;
+		}
+		memcpy(&cp, pg, sizeof(struct live_page));
+		if (!__live_read_retry(pg, seq))
+			break;
+		if (__clock_ns() > deadline) {
+			DBG1("live page busy for too long!");
+			return -1;
+		}
+	}
+
+	live->time = (double)cp.clk / (double)SEC;
+	live->evt_cnt = cp.evt_cnt;
+	live->step_cnt = cp.step_cnt;
+	live->heap_len = cp.heap_len;
+	live->heap_peak = cp.heap_peak;
+	live->speed = cp.speed;
+	live->speed_set = cp.speed_set;
+	live->tick_lost = cp.tick_lost;
+	live->paused = cp.paused;
+	live->pool_alloc = cp.pool_alloc;
+	live->pool_size = cp.pool_size;
+
+	for (i = 0; i < cp.comm_cnt; ++i) {
+		struct chime_live_comm * comm = &live->comm[i];
+
+		strncpy(comm->name, cp.comm[i].name, CHIME_LIVE_NAME_MAX - 1);
+		comm->name[CHIME_LIVE_NAME_MAX - 1] = '\0';
+		comm->util = cp.comm[i].util;
+		comm->util_peak = cp.comm[i].util_peak;
+		comm->frm_cnt = cp.comm[i].frm_cnt;
+		comm->drop_cnt = cp.comm[i].drop_cnt;
+	}
+	live->comm_cnt = cp.comm_cnt;
+
+	n = 0;
+	for (i = 1; (i <= CHIME_NODE_MAX) && (n < CHIME_LIVE_NODE_MAX); ++i) {
+		struct chime_live_node * node = &live->node[n];
+
+		if (cp.node[i].state == CHIME_NODE_NONE)
+			continue;
+
+		node->id = i;
+		node->state = cp.node[i].state;
+		node->temperature = cp.node[i].temperature;
+		node->ticks = cp.node[i].ticks;
+		node->time = (double)cp.node[i].clk / (double)SEC;
+		node->evt_cnt = cp.node[i].evt_cnt;
+		node->load = cp.node[i].load;
+		strncpy(node->name, cp.node[i].name, CHIME_LIVE_NAME_MAX - 1);
+		node->name[CHIME_LIVE_NAME_MAX - 1] = '\0';
+		n++;
+	}
+	live->node_cnt = n;
+
+	return 0;
+}
+
@@ -1,7 +1,12 @@
+#define _GNU_SOURCE /* CPU affinity */
 #include <errno.h>
 #include <string.h>
 #include <stdio.h>
 #include <unistd.h>
+#include <time.h>
+#ifndef _WIN32
+#include <sys/un.h>
+#endif
 
 #define __CHIME_I__
 #include "chime-i.h"
@@ -27,7 +32,7 @@ void __msleep(unsigned int ms)
 	struct timespec tv;
 
 	tv.tv_sec = ms / 1000;
-	tv.tv_nsec = ms % 1000;
+	tv.tv_nsec = (ms % 1000) * 1000000;
 
 	while (nanosleep(&tv, &tv)) {
 		if (errno != EINTR)
@@ -36,6 +41,28 @@ void __msleep(unsigned int ms)
 #endif
 }
 
+/* Monotonic wall clock in nanoseconds. 
+   Used for profiling, the origin is arbitrary. */
+uint64_t __clock_ns(void)
+{       
+#ifdef _WIN32
+	static LARGE_INTEGER freq;
+	LARGE_INTEGER cnt;
+
+	if (freq.QuadPart == 0)
+		QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&cnt);
+
+	return (uint64_t)((double)cnt.QuadPart * 1e9 / (double)freq.QuadPart);
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+#endif
+}
+
 
 /*****************************************************************************
  * Application initialization and signal handling
@@ -104,10 +131,6 @@ static void __termination_handler(int signum)
 
 /* Should be called from the main(). This will
  initialize signals, and signal handlers. 
-
- Alert: The application cannot use SIGALRM as the interval timer 
- depends on it to work.
- 
  */
 
 void __term_sig_handler(void (* handler)(void))
@@ -128,10 +151,7 @@ void __term_sig_handler(void (* handler)(void))
 	/* Register a cleanup callback routine */
 	__term_handler = handler;
 
-	/* Disable SIGALRM signal wich is used by the interval timer. 
-	   Only one thread can have this signal enabled. */
 	sigemptyset(&set);
-//	sigaddset(&set, SIGALRM);
 	pthread_sigmask(SIG_BLOCK, &set, NULL);
 
 	/* Configure the common termination handlers to call
@@ -163,9 +183,6 @@ void __thread_init(const char * name)
 	sigaddset(&set, SIGHUP);
 	sigaddset(&set, SIGTERM);
 	sigaddset(&set, SIGQUIT);
-	/* SIGALRM should be delivered to a single thread handling the 
-	 interval timer. */
-	sigaddset(&set, SIGALRM);
 	pthread_sigmask(SIG_BLOCK, &set, NULL);
 #endif
 }
@@ -174,6 +191,86 @@ void __thread_init(const char * name)
  * Message queues
  *****************************************************************************/
 
+int __mq_transport = MQ_TRANSPORT_POSIX;
+static bool __mq_transport_sel = false;
+
+int __mq_transport_set(const char * name)
+{
+	if ((name == NULL) || (strcmp(name, "mq") == 0)) {
+		__mq_transport = MQ_TRANSPORT_POSIX;
+#ifndef _WIN32
+	} else if (strcmp(name, "unix") == 0) {
+		__mq_transport = MQ_TRANSPORT_UNIX;
+#endif
+	} else {
+		ERR("invalid transport: \"%s\".", name);
+		return -1;
+	}
+
+	__mq_transport_sel = true;
+	return 0;
+}
+
+/* Pick the default transport on first use. */
+static void __mq_transport_init(void)
+{
+	if (!__mq_transport_sel) {
+		char * env = getenv("CHIME_TRANSPORT");
+
+		if ((env == NULL) || (__mq_transport_set(env) < 0))
+			__mq_transport_set(NULL);
+	}
+}
+
+#ifndef _WIN32
+/* Unix domain datagram sockets keep the message boundaries and,
+   unlike the message queues, are not bound by the system's 
+   message queue limits. */
+static void __mq_sock_addr(struct sockaddr_un * addr, const char * name)
+{
+	memset(addr, 0, sizeof(struct sockaddr_un));
+	addr->sun_family = AF_UNIX;
+	snprintf(addr->sun_path, sizeof(addr->sun_path), 
+			 "/tmp/%s.sock", name);
+}
+
+static int __mq_sock_create(__mq_t * qp, const char * name)
+{
+	struct sockaddr_un addr;
+	int fd;
+
+	if ((fd = socket(AF_UNIX, SOCK_DGRAM, 0)) < 0)
+		return -1;
+
+	__mq_sock_addr(&addr, name);
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		close(fd);
+		return -1;
+	}
+
+	*qp = (__mq_t)fd;
+	return 0;
+}
+
+static int __mq_sock_open(__mq_t * qp, const char * name)
+{
+	struct sockaddr_un addr;
+	int fd;
+
+	if ((fd = socket(AF_UNIX, SOCK_DGRAM, 0)) < 0)
+		return -1;
+
+	__mq_sock_addr(&addr, name);
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		close(fd);
+		return -1;
+	}
+
+	*qp = (__mq_t)fd;
+	return 0;
+}
+#endif
+
 int __mq_create(__mq_t * qp, const char * name, 
 							  unsigned int maxmsg)
 {
@@ -181,6 +278,8 @@ int __mq_create(__mq_t * qp, const char * name,
 	__mq_t mq;
 	int ret;
 
+	__mq_transport_init();
+
 #ifdef _WIN32
 	sprintf(path, "\\\\.\\mailslot\\%s", name);
 
@@ -200,6 +299,9 @@ int __mq_create(__mq_t * qp, const char * name,
 		.mq_curmsgs = 0   /* # of messages currently in queue */
 	};
 
+	if (__mq_transport == MQ_TRANSPORT_UNIX)
+		return __mq_sock_create(qp, name);
+
 	sprintf(path, "/%s", name);
 	/* create a new message queue */
 	mq = mq_open(path, O_RDONLY | O_CREAT, 
@@ -215,6 +317,9 @@ int __mq_open(__mq_t * qp, const char * name)
 	char path[128];
 	__mq_t mq;
 	int ret;
+
+	__mq_transport_init();
+
 #ifdef _WIN32
 	sprintf(path, "\\\\.\\mailslot\\%s", name);
 	
@@ -230,6 +335,9 @@ int __mq_open(__mq_t * qp, const char * name)
 					(HANDLE) NULL); 
 	ret = (mq == INVALID_HANDLE_VALUE) ? -1 : 0;
 #else
+	if (__mq_transport == MQ_TRANSPORT_UNIX)
+		return __mq_sock_open(qp, name);
+
 	sprintf(path, "/%s", name);
 	mq = mq_open(path, O_WRONLY);
 	ret = (mq == (mqd_t)-1) ? -1 : 0;
@@ -243,7 +351,10 @@ void __mq_close(__mq_t mq)
 #ifdef _WIN32
 	CloseHandle(mq);
 #else
-	mq_close(mq);
+	if (__mq_transport == MQ_TRANSPORT_UNIX)
+		close((int)mq);
+	else
+		mq_close(mq);
 #endif
 }
 
@@ -251,9 +362,19 @@ void __mq_unlink(const char * name)
 {
 	char path[128];
 
+	__mq_transport_init();
+
 #ifdef _WIN32
 	sprintf(path, "\\\\.\\mailslot\\%s", name);
 #else
+	if (__mq_transport == MQ_TRANSPORT_UNIX) {
+		struct sockaddr_un addr;
+
+		__mq_sock_addr(&addr, name);
+		unlink(addr.sun_path);
+		return;
+	}
+
 	sprintf(path, "/%s", name);
 	/* remove existing file */
 	mq_unlink(path);
@@ -687,12 +808,25 @@ int __sem_post(__sem_t sem)
  * System interval timer
  *****************************************************************************/
 
+/* On POSIX systems the interval timer is a dedicated pacing thread
+   sleeping on absolute CLOCK_MONOTONIC deadlines. The next deadline is
+   always computed from the previous one, not from the wake up time, so
+   the scheduling latency does not accumulate as drift. If the thread
+   wakes up late the missed deadlines are delivered back to back. */
+
+/* If the pacing thread falls behind more than this, the missed
+   deadlines are dropped and the timer restarts from the current time. */
+#define ITMR_LAG_MAX_NS 1000000000LL
+
 static struct {
 	void (* isr)(void);
 #ifdef _WIN32
 	HANDLE hTimerQueue;
 	HANDLE hEvent;
 	HANDLE hTimer;
+#else
+	pthread_t thread;
+	uint64_t interval_ns;
 #endif
 	bool running;
 } __itmr = {
@@ -714,17 +848,56 @@ static VOID CALLBACK __tmr_isr(PVOID lpParam, BOOLEAN TimerOrWaitFired)
 	__itmr.isr();
 }
 #else
-static void __alrm_handler(int signum)
+static uint64_t __timespec_ns(const struct timespec * ts)
 {
-	__itmr.isr();
+	return (uint64_t)ts->tv_sec * 1000000000LL + ts->tv_nsec;
+}
+
+static void * __itmr_task(void * arg)
+{
+	struct timespec ts;
+	uint64_t deadline;
+	uint64_t now;
+
+	__thread_init("ITMR");
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	deadline = __timespec_ns(&ts);
+
+	for (;;) {
+		deadline += __itmr.interval_ns;
+
+		ts.tv_sec = deadline / 1000000000LL;
+		ts.tv_nsec = deadline % 1000000000LL;
+
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, 
+							   &ts, NULL) == EINTR);
+
+		__itmr.isr();
+
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		now = __timespec_ns(&ts);
+		if ((int64_t)(now - deadline) > ITMR_LAG_MAX_NS) {
+			/* We were not scheduled for a long time (suspended, 
+			   debugger...). Don't flood the handler. */
+			deadline = now;
+		}
+	}
+
+	return NULL;
 }
 #endif
 
-int __itmr_init(uint32_t interval_ms, void (* isr)(void))
+int __itmr_init(uint32_t interval_us, void (* isr)(void))
 {
 	__itmr.isr = isr;
 
 #ifdef _WIN32
+	uint32_t interval_ms;
+
+	/* timer queues have millisecond resolution */
+	interval_ms = (interval_us + 999) / 1000;
+
 	if (__itmr.hEvent == NULL) {
 		/* Use an event object to track the TimerRoutine execution */
 		__itmr.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
@@ -762,42 +935,18 @@ int __itmr_init(uint32_t interval_ms, void (* isr)(void))
 	}
 
 #else
-	struct sigaction new_action;
-	struct itimerval it;
-	uint32_t sec;
-	uint32_t usec;
-	sigset_t set;
-
-//	fprintf(stderr, "%s: interval=%u ms.\n", __func__, interval_ms);
-//	fflush(stderr);
-
-	if (!__itmr.running) {
-
-//		fprintf(stderr, "%s: initializing interval timer.\n", __func__);
-//		fflush(stderr);
-
-		/* set SIGALRM handler */
-		new_action.sa_flags = SA_NODEFER;
-		new_action.sa_handler = __alrm_handler;
-		sigaction(SIGALRM, &new_action, NULL);
-
-		/* unblocks SIGALRM */
-		sigemptyset(&set);
-		sigaddset(&set, SIGALRM);
-		pthread_sigmask(SIG_UNBLOCK, &set, NULL);
-	}
+	int ret;
 
-	sec = interval_ms / 1000;
-	usec = (interval_ms - (sec * 1000)) * 1000;
+	/* restart the pacing thread with the new interval */
+	__itmr_stop();
 
-	it.it_interval.tv_sec = sec;
-	it.it_interval.tv_usec = usec;
-	it.it_value = it.it_interval;
+	__itmr.interval_ns = (uint64_t)interval_us * 1000;
 
-	if (setitimer(ITIMER_REAL, &it, NULL) < 0) {
-		fprintf(stderr, "%s: setitimer() failed: %s.\n",
-				__func__, strerror(errno));
+	if ((ret = pthread_create(&__itmr.thread, NULL, __itmr_task, NULL)) != 0) {
+		fprintf(stderr, "%s: pthread_create() failed: %s.\n",
+				__func__, strerror(ret));
 		fflush(stderr);
+		return -1;
 	}
 
 	__itmr.running = true;
@@ -813,22 +962,12 @@ int __itmr_stop(void)
 		return -1;
 
 #else
-
-	struct itimerval it;
-
 	if (!__itmr.running)
 		return -1;
 
-
-	it.it_interval.tv_sec = 0;
-	it.it_interval.tv_usec = 0;
-	it.it_value = it.it_interval;
-
-	if (setitimer(ITIMER_REAL, &it, NULL) < 0) {
-		fprintf(stderr, "%s: setitimer() failed: %s.\n",
-				__func__, strerror(errno));
-		fflush(stderr);
-	}
+	/* clock_nanosleep() is a cancellation point */
+	pthread_cancel(__itmr.thread);
+	pthread_join(__itmr.thread, NULL);
 
 	__itmr.running = false;
 #endif
@@ -855,14 +994,14 @@ int __thread_create(__thread_t * pthread, void *(* task)(void*), void * arg)
 	ret = (thread == (HANDLE)-1L) ? -1 : 0;
 #else
 	assert(pthread != NULL);	
-	thread = malloc(sizeof(pthread_t));
 
-	if ((ret = pthread_create(thread, NULL,
+	if ((ret = pthread_create(&thread, NULL,
 							  (void * (*)(void *))task,
-							  (void *)arg)) < 0) {
+							  (void *)arg)) != 0) {
 		fprintf(stderr, "%s: pthread_create() failed: %s.\n",
 				__func__, strerror(ret));
 		fflush(stderr);
+		ret = -1;
 	}
 #endif
 
@@ -901,6 +1040,96 @@ int __thread_join(__thread_t thread, void ** value_ptr)
 #endif
 }
 
+/* Pin the calling thread to a processor core. */
+int __thread_affinity_set(int core)
+{
+#ifdef _WIN32
+	if (SetThreadAffinityMask(GetCurrentThread(), 
+							  (DWORD_PTR)1 << core) == 0)
+		return -1;
+	return 0;
+#elif defined(__linux__)
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+	CPU_SET(core, &set);
+
+	return pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+	return -1;
+#endif
+}
+
+#ifdef __linux__
+static int __cpulist_parse(const char * s, uint8_t id, 
+						   uint8_t node[], uint16_t core[], int n, int max)
+{
+	while (*s != '\0') {
+		char * end;
+		int lo;
+		int hi;
+		int i;
+
+		lo = hi = strtol(s, &end, 10);
+		if (end == s)
+			break;
+		if (*end == '-')
+			hi = strtol(end + 1, &end, 10);
+		for (i = lo; (i <= hi) && (n < max); ++i) {
+			node[n] = id;
+			core[n] = i;
+			n++;
+		}
+		s = (*end == ',') ? end + 1 : end;
+	}
+
+	return n;
+}
+#endif
+
+/* Get the online processor cores with their NUMA node, ordered 
+   by node. Returns the number of cores. */
+int __numa_cores(uint8_t node[], uint16_t core[], int max)
+{
+	int n = 0;
+	int i;
+
+#ifdef __linux__
+	for (i = 0; (i < 256) && (n < max); ++i) {
+		char path[64];
+		char buf[1024];
+		FILE * f;
+
+		sprintf(path, "/sys/devices/system/node/node%d/cpulist", i);
+		if ((f = fopen(path, "r")) == NULL)
+			continue;
+		if (fgets(buf, sizeof(buf), f) != NULL)
+			n = __cpulist_parse(buf, i, node, core, n, max);
+		fclose(f);
+	}
+
+	if (n > 0)
+		return n;
+#endif
+
+	/* no NUMA information, single node */
+#ifdef _WIN32
+	{
+		SYSTEM_INFO si;
+		GetSystemInfo(&si);
+		n = si.dwNumberOfProcessors;
+	}
+#else
+	n = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+	for (i = 0; (i < n) && (i < max); ++i) {
+		node[i] = 0;
+		core[i] = i;
+	}
+
+	return i;
+}
+
 /*****************************************************************************
  * Memory Mapped File
  *****************************************************************************/
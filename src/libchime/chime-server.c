@@ -13,6 +13,9 @@
 #define __CLK_HEAP__
 #include "clk-heap.h"
 
+#define __TMR_WHEEL__
+#include "tmr-wheel.h"
+
 #include "objpool.h"
 #include "list.h"
 
@@ -23,6 +26,28 @@
  * Server
  *****************************************************************************/
 
+/* Server managed timer */
+struct srv_timer {
+	struct wheel_tmr w;
+	uint8_t node_id;
+	uint8_t state;
+	uint16_t handle;
+	uint32_t seq;
+	uint32_t period; /* CPU cycles, 0 for one shot */
+};
+
+enum {
+	SRV_TIMER_IDLE = 0,
+	SRV_TIMER_WHEEL, /* waiting in the timing wheel */
+	SRV_TIMER_HEAP /* event in the clock heap */
+};
+
+/* Timers of a node, indexed by handle */
+struct srv_timer_tbl {
+	unsigned int len;
+	struct srv_timer ** tmr;
+};
+
 struct chime_server {
 	bool started;
 	__mq_t mq;
@@ -37,6 +62,18 @@ struct chime_server {
 		uint64_t clk;
 		uint32_t tick_cnt;
 		uint32_t tick_lost;
+		uint32_t step_cnt; /* dispatcher steps */
+		uint64_t evt_cnt; /* events dispatched */
+		uint64_t heap_sum; /* heap length accumulated over the steps */
+		uint32_t heap_smpl; /* heap length samples */
+		uint32_t heap_peak; /* longest heap */
+		volatile uint32_t dump_cnt; /* variable dumps completed */
+		uint64_t stop_clk; /* pause at this clock (0 = never) */
+		uint64_t stop_evt; /* pause after this many events (0 = never) */
+		uint64_t hold_clk; /* stop clock that paused the run (0 = none) */
+		uint64_t lookahead; /* shortest COMM delay */
+		uint64_t temp_clk; /* earliest temperature profile breakpoint */
+		int temp_cnt; /* nodes with an active temperature profile */
 		volatile bool paused;
 	} sim;
 
@@ -50,6 +87,14 @@ struct chime_server {
 
 	struct clk_heap * heap;
 
+	struct {
+		struct tmr_wheel w;
+		bool armed; /* a slot event is in the heap */
+		uint64_t clk; /* next slot clock */
+		uint64_t key; /* slot event clock */
+		struct srv_timer_tbl tbl[CHIME_NODE_MAX + 1];
+	} wheel;
+
 	uint32_t probe_seq;
 
 	float temperature;
@@ -64,6 +109,12 @@ struct chime_server {
 
 	uint16_t shared_oid;
 	struct srv_shared * shared;
+
+	struct {
+		struct live_page * pg;
+		uint64_t mark_ns; /* wall clock of the last speed sample */
+		uint64_t mark_clk; /* simulation clock of the last speed sample */
+	} live;
 };
 
 static struct chime_server server = {
@@ -91,6 +142,195 @@ static struct chime_node * __node_getinstance(int node_id)
 	return node;
 }
 
+/*****************************************************************************
+ * Live state page
+ *****************************************************************************/
+
+/* speed ratio sampling interval */
+#define LIVE_SPEED_SMPL_NS 250000000LL
+
+static inline void __live_node_set(struct live_page * pg, 
+								   struct chime_node * node)
+{
+	pg->node[node->id].state = node->bkpt ? CHIME_NODE_WAIT : CHIME_NODE_RUN;
+	pg->node[node->id].temperature = node->temperature;
+	pg->node[node->id].clk = node->clk;
+	pg->node[node->id].ticks = node->ticks;
+}
+
+/* Publish the state of a node */
+static void __live_node_sync(struct chime_node * node)
+{
+	struct live_page * pg = server.live.pg;
+
+	__live_write_begin(pg);
+	__live_node_set(pg, node);
+	__live_write_end(pg);
+}
+
+/* A new node, publish its name as well */
+static void __live_node_add(struct chime_node * node)
+{
+	struct live_page * pg = server.live.pg;
+
+	__live_write_begin(pg);
+	snprintf(pg->node[node->id].name, ENTRY_NAME_MAX, "%.*s", 
+			 ENTRY_NAME_MAX - 1, node->name);
+	__live_node_set(pg, node);
+	__live_write_end(pg);
+}
+
+static void __live_node_clear(int node_id)
+{
+	struct live_page * pg = server.live.pg;
+
+	__live_write_begin(pg);
+	memset(&pg->node[node_id], 0, sizeof(pg->node[node_id]));
+	__live_write_end(pg);
+}
+
+/* Restart the speed ratio measurement */
+static void __live_speed_reset(void)
+{
+	server.live.mark_ns = __clock_ns();
+	server.live.mark_clk = server.heap->clk;
+}
+
+/* Wall clock time spent running per simulated second */
+static double __node_prof_load(struct chime_node * node)
+{
+	double sim_time = node->prof.cycles * node->period;
+
+	if (sim_time == 0)
+		return 0;
+
+	return ((double)node->prof.run_ns / 1e9) / sim_time;
+}
+
+/* Slide the utilization window of a COMM up to 'clk' */
+static void __chime_comm_win_slide(struct chime_comm * comm, uint64_t clk)
+{
+	uint64_t n;
+	uint64_t sum;
+	int j;
+
+	if ((int64_t)(clk - comm->tx.win_clk) >= 0) {
+		n = (clk - comm->tx.win_clk) / COMM_WIN_SLOT;
+		if (n > COMM_WIN_SLOTS) {
+			/* idle for more than a window */
+			comm->tx.win_clk += (n - COMM_WIN_SLOTS) * COMM_WIN_SLOT;
+			n = COMM_WIN_SLOTS;
+		}
+		while (n-- > 0) {
+			for (sum = 0, j = 0; j < COMM_WIN_SLOTS; ++j)
+				sum += comm->tx.win_busy[j];
+			comm->tx.util = (100.0 * sum) / (COMM_WIN_SLOTS * COMM_WIN_SLOT);
+			if (comm->tx.util > comm->tx.util_peak)
+				comm->tx.util_peak = comm->tx.util;
+			comm->tx.win_idx = (comm->tx.win_idx + 1) % COMM_WIN_SLOTS;
+			comm->tx.win_busy[comm->tx.win_idx] = 0;
+			comm->tx.win_clk += COMM_WIN_SLOT;
+		}
+	}
+}
+
+/* Sample the slow changing statistics: object pool usage, 
+   COMM utilization and CPU loads. */
+static void __live_sample(struct live_page * pg)
+{
+	int n;
+	int i;
+
+	pg->speed_set = (double)server.sim.period / (double)server.tmr.period;
+	pg->tick_lost = server.sim.tick_lost;
+	pg->pool_size = objpool_get_free();
+	pg->pool_alloc = objpool_get_alloc();
+	pg->pool_size += pg->pool_alloc;
+
+	n = 0;
+	for (i = 1; (i <= LIST_LEN(server.comm_oid)) && 
+		 (n < CHIME_LIVE_COMM_MAX); ++i) {
+		struct chime_comm * comm = obj_getinstance(server.comm_oid[i]);
+
+		memcpy(pg->comm[n].name, comm->name, ENTRY_NAME_MAX);
+		pg->comm[n].util = comm->tx.util;
+		pg->comm[n].util_peak = comm->tx.util_peak;
+		pg->comm[n].frm_cnt = comm->tx.frm_cnt;
+		pg->comm[n].drop_cnt = comm->tx.drop_cnt;
+		n++;
+	}
+	pg->comm_cnt = n;
+
+	for (i = 1; i <= LIST_LEN(server.node_idx); ++i) {
+		struct chime_node * node = server.node[server.node_idx[i]];
+
+		if (node == NULL)
+			continue;
+
+		pg->node[node->id].evt_cnt = node->prof.evt_cnt;
+		pg->node[node->id].load = __node_prof_load(node);
+	}
+}
+
+/* Publish the simulation state and the nodes dispatched in a step */
+static void __live_step_sync(uint8_t batch[], int cnt)
+{
+	struct live_page * pg = server.live.pg;
+	uint64_t clk = server.heap->clk;
+	uint64_t now;
+	int64_t dt;
+	int i;
+
+	server.shared->time = (double)clk / (double)SEC;
+
+	/* the utilization windows move with the simulation clock, 
+	   on an idle medium too */
+	for (i = 1; i <= LIST_LEN(server.comm_oid); ++i)
+		__chime_comm_win_slide(obj_getinstance(server.comm_oid[i]), clk);
+
+	__live_write_begin(pg);
+
+	pg->clk = clk;
+	pg->evt_cnt = server.sim.evt_cnt;
+	pg->step_cnt = server.sim.step_cnt;
+	pg->heap_len = heap_size(server.heap);
+	pg->heap_peak = server.sim.heap_peak;
+
+	for (i = 0; i < cnt; ++i) {
+		struct chime_node * node = server.node[batch[i]];
+
+		if (node != NULL)
+			__live_node_set(pg, node);
+	}
+
+	/* sample the speed ratio, checking the wall clock once every
+	   few steps is enough */
+	if ((server.sim.step_cnt & 0x3f) == 0) {
+		now = __clock_ns();
+		if ((dt = now - server.live.mark_ns) >= LIVE_SPEED_SMPL_NS) {
+			/* fs per ns: 10^6 */
+			pg->speed = (double)(clk - server.live.mark_clk) / 
+				((double)dt * 1000000.0);
+			server.live.mark_ns = now;
+			server.live.mark_clk = clk;
+			__live_sample(pg);
+		}
+	}
+
+	__live_write_end(pg);
+}
+
+static void __live_paused_set(bool paused)
+{
+	struct live_page * pg = server.live.pg;
+
+	__live_write_begin(pg);
+	pg->paused = paused;
+	if (paused)
+		pg->speed = 0;
+	__live_write_end(pg);
+}
+
 const uint64_t bin_range[20] = {
 	   1 * USEC,
 	   2 * USEC,
@@ -114,6 +354,33 @@ const uint64_t bin_range[20] = {
     2000 * MSEC
 };
 
+/* The lookahead is the shortest time from a COMM transmission to
+   the corresponding events at the receivers. */
+static void __chime_lookahead_update(void)
+{
+	uint64_t lookahead = UINT64_MAX;
+	int i;
+
+	for (i = 1; i <= LIST_LEN(server.comm_oid); ++i) {
+		struct chime_comm * comm = obj_getinstance(server.comm_oid[i]);
+		uint64_t delay;
+
+		if (comm->attr.mac == COMM_MAC_TOKEN) {
+			/* the fixed delay is not used with the token, the token 
+			   may be waiting at the transmitter: the carrier is 
+			   detected after the first bit */
+			delay = (uint64_t)comm->bit_time;
+		} else
+			delay = comm->fix_delay;
+
+		if (delay < lookahead)
+			lookahead = delay;
+	}
+
+	server.sim.lookahead = lookahead;
+	DBG1("lookahead=%"PRIu64"us", TS2USEC(lookahead));
+}
+
 void __chime_comm_reset(struct chime_comm * comm)
 {
 	struct chime_node * node;
@@ -154,6 +421,11 @@ void __chime_comm_reset(struct chime_comm * comm)
 	delay_max = (wr_cycles * dt_max) + comm->fix_delay + attr->max_jitter * SEC;
 	delay_max += attr->nodes_max * attr->nod_delay;
 	delay_max += bits_max * comm->bit_time;
+	if (attr->mac == COMM_MAC_TOKEN) {
+		/* one token rotation plus the handshake */
+		delay_max += (attr->nodes_max + 1) * attr->tok_bits * comm->bit_time;
+		delay_max += attr->ack_bits * comm->bit_time;
+	}
 
 	DBG("delay_max=%f", TS2F(delay_max));
 
@@ -169,6 +441,15 @@ void __chime_comm_reset(struct chime_comm * comm)
 
 	comm->bin_delay = bin_width;
 
+	/* the token starts before the lowest node id */
+	memset(&comm->tok, 0, sizeof(comm->tok));
+	comm->tok.clk = server.heap->clk;
+
+	/* clear the live counters */
+	memset(&comm->tx, 0, sizeof(comm->tx));
+	comm->tx.win_clk = server.heap->clk;
+	memset(comm->eot, 0, (CHIME_NODE_MAX + 1) * sizeof(uint64_t));
+
 	/* FIXME: initialize the seed from attribute */
 	comm->randseed0 = 1000LL;
 	comm->randseed1 = 1000000LL;
@@ -178,6 +459,8 @@ void __chime_comm_reset(struct chime_comm * comm)
 //	exp_rand_init(&comm->exprnd, 0.5, 1000000000LL);
 
 	objpool_unlock();
+
+	__chime_lookahead_update();
 }
 
 bool __chime_comm_stat_dump(struct chime_comm * comm)
@@ -194,6 +477,24 @@ bool __chime_comm_stat_dump(struct chime_comm * comm)
 	FILE * f;
 	int j;
 
+	if (comm->attr.mac == COMM_MAC_TOKEN) {
+		/* medium access statistics */
+		strncpy(fname, comm->name, ENTRY_NAME_MAX);
+		fname[ENTRY_NAME_MAX] = '\0';
+		sprintf(dat_path, "./%s.mac", fname);
+
+		if ((f = fopen(dat_path, "w")) == NULL) {
+			ERR("fopen(\"%s\") failed: %s!", dat_path, __strerr());
+			return false;
+		}
+		fprintf(f, "frames=%"PRIu64"\n", comm->tok.frm_cnt);
+		fprintf(f, "naks=%"PRIu64"\n", comm->tok.nak_cnt);
+		fprintf(f, "token_passes=%"PRIu64"\n", comm->tok.pass_cnt);
+		fprintf(f, "token_wait_avg=%.9f\n", (comm->tok.frm_cnt == 0) ? 0 :
+				TS2F(comm->tok.wait_sum / comm->tok.frm_cnt));
+		fclose(f);
+	}
+
 	if (comm->attr.hist_en == false)
 		return true;
 
@@ -264,12 +565,33 @@ static void __chime_comm_hist_add(struct chime_comm * comm, uint64_t delay)
 		TS2USEC(comm->bin_delay), TS2USEC(delay));
 
 	n = delay / comm->bin_delay;
-	assert(n < COMM_STAT_BINS);
+	/* the token MAC wait is unbounded under load, 
+	   saturate in the last bin */
+	if (n >= COMM_STAT_BINS)
+		n = COMM_STAT_BINS - 1;
 
 	comm->stat[n]++;
 	comm->cnt++;
 }
 
+/* Update the live counters with a frame transmitted by 'node' at 'clk' 
+   which holds the medium for 'busy' */
+static void __chime_comm_tx_count(struct chime_comm * comm, 
+								  struct chime_node * node, int chan, 
+								  int len, uint64_t clk, uint64_t busy)
+{
+	__chime_comm_win_slide(comm, clk);
+	comm->tx.win_busy[comm->tx.win_idx] += busy;
+
+	comm->tx.frm_cnt++;
+	comm->tx.byte_cnt += len;
+	comm->tx.busy += busy;
+
+	node->tx[chan].frm_cnt++;
+	node->tx[chan].byte_cnt += len;
+	node->tx[chan].busy += busy;
+}
+
 bool __chime_var_flush(struct chime_var * var)
 {
 	int i;
@@ -323,54 +645,622 @@ static void __chime_var_reset(struct chime_var * var)
 }
 
 
-bool __chime_var_dump(struct chime_var * var)
+bool __chime_var_dump(struct chime_var * var)
+{
+	char name[ENTRY_NAME_MAX + 8];
+	char plt_path[PATH_MAX];
+	char out_path[PATH_MAX];
+	char dat_path[PATH_MAX];
+	FILE * f;
+
+	strncpy(name, var->name, ENTRY_NAME_MAX);
+	name[ENTRY_NAME_MAX] = '\0';
+
+	sprintf(plt_path, "./%s.plt", name);
+	sprintf(out_path, "./%s.png", name);
+	sprintf(dat_path, "./%s.dat", name);
+
+	if ((f = fopen(plt_path, "w")) == NULL) {
+		ERR("fopen(\"%s\") failed: %s!", plt_path, __strerr());
+		return false;
+	}
+	fprintf(f, "#set terminal wxt\n");
+	fprintf(f, "set terminal png size 1280,768 font 'Verdana,12'\n");
+	fprintf(f, "set output '%s'\n", out_path);
+	fprintf(f, "set offset graph 0.0,0.0,0.0,0.0\n");
+	fprintf(f, "# labels\n"); /* labels */
+	fprintf(f, "set xlabel 'Time(s)'\n");
+	fprintf(f, "set ylabel '%s'\n", name);
+	fprintf(f, "# define axis\n"); /* axis */
+	fprintf(f, "set style line 11 lc rgb '#808080' lt 1\n");
+	fprintf(f, "set border 3 back ls 11\n");
+	fprintf(f, "set tics out nomirror\n");
+	fprintf(f, "# define grid\n"); /* grid */
+	fprintf(f, "set style line 12 lc rgb '#808080' lt 0 lw 1\n");
+	fprintf(f, "set grid back ls 12\n");
+	fprintf(f, "# line styles\n"); /* line styles */
+	fprintf(f, "set style line 1 lc rgb '#801010' pt 0 lt 1 lw 2\n");
+	fprintf(f, "set style line 2 lc rgb '#108010' pt 0 lt 1 lw 2\n");
+	fprintf(f, "set style line 3 lc rgb '#101080' pt 0 lt 1 lw 2\n");
+	fprintf(f, "plot '%s' using 1:2 notitle with lp ls 1\n", dat_path);
+	fprintf(f, "set output\n");
+	fprintf(f, "quit\n");
+	fclose(f);
+
+	return true;
+}
+
+static double xtal_temp_offs(float tc, float t)
+{
+	return 1.0 - tc * (t - 25.0) * (t - 25.0);
+}
+
+/*****************************************************************************
+ * Server managed timers
+ *****************************************************************************/
+
+/* The timers wait in the timing wheel until their slot comes, then 
+   move to the clock heap with their exact clock. A single slot event 
+   (CHIME_EVT_WHEEL) in the heap tells the dispatcher when to advance 
+   the wheel. Canceled timers whose event is already in the heap are 
+   dropped by the dispatcher, see __chime_heap_next(). */
+
+/* Put the slot event in the heap if the next slot moved earlier */
+static void __wheel_sched(void)
+{
+	struct chime_event evt;
+	uint64_t clk;
+
+	if (!wheel_next(&server.wheel.w, &clk))
+		return;
+
+	/* if (armed && (clk >= server.wheel.clk)) */
+	if (server.wheel.armed && ((int64_t)(clk - server.wheel.clk) >= 0))
+		return;
+
+	server.wheel.clk = clk;
+	/* processing a slot early is harmless, late is not */
+	if ((int64_t)(clk - server.heap->clk) < 0)
+		clk = server.heap->clk;
+	server.wheel.key = clk;
+	server.wheel.armed = true;
+
+	evt.node_id = 0;
+	evt.opc = CHIME_EVT_WHEEL;
+	evt.oid = 0;
+	evt.u32 = 0;
+	heap_insert_min(server.heap, clk, &evt);
+}
+
+static void __srv_timer_expire(struct wheel_tmr * w, void * arg)
+{
+	struct srv_timer * tmr = (struct srv_timer *)w;
+	struct chime_event evt;
+	uint64_t clk = tmr->w.clk;
+
+	evt.node_id = tmr->node_id;
+	evt.opc = CHIME_EVT_TIMER;
+	evt.oid = tmr->handle;
+	evt.seq = tmr->seq;
+
+	if ((int64_t)(clk - server.heap->clk) < 0)
+		clk = server.heap->clk;
+
+	tmr->state = SRV_TIMER_HEAP;
+	heap_insert_min(server.heap, clk, &evt);
+}
+
+static void __srv_timer_queue(struct srv_timer * tmr, uint64_t clk)
+{
+	/* a node idle for long may fall behind the heap */
+	if ((int64_t)(clk - server.heap->clk) < 0)
+		clk = server.heap->clk;
+
+	tmr->w.clk = clk;
+
+	wheel_sync(&server.wheel.w, server.heap->clk);
+	if (wheel_insert(&server.wheel.w, &tmr->w)) {
+		tmr->state = SRV_TIMER_WHEEL;
+		__wheel_sched();
+	} else {
+		__srv_timer_expire(&tmr->w, NULL);
+	}
+}
+
+static void __srv_timer_dequeue(struct srv_timer * tmr)
+{
+	if (tmr->state == SRV_TIMER_WHEEL)
+		wheel_remove(&server.wheel.w, &tmr->w);
+	tmr->state = SRV_TIMER_IDLE;
+}
+
+static struct srv_timer * __srv_timer_get(int node_id, int handle, 
+										  bool alloc)
+{
+	struct srv_timer_tbl * tbl = &server.wheel.tbl[node_id];
+	struct srv_timer * tmr;
+
+	if (handle >= tbl->len) {
+		struct srv_timer ** p;
+		unsigned int len;
+
+		if (!alloc)
+			return NULL;
+
+		len = (tbl->len == 0) ? 16 : tbl->len;
+		while (len <= handle)
+			len *= 2;
+
+		if ((p = realloc(tbl->tmr, len * sizeof(struct srv_timer *))) == NULL) {
+			ERR("<%d> realloc() failed!", node_id);
+			return NULL;
+		}
+		memset(&p[tbl->len], 0, (len - tbl->len) * sizeof(struct srv_timer *));
+		tbl->tmr = p;
+		tbl->len = len;
+	}
+
+	if (((tmr = tbl->tmr[handle]) == NULL) && alloc) {
+		if ((tmr = calloc(1, sizeof(struct srv_timer))) == NULL) {
+			ERR("<%d> calloc() failed!", node_id);
+			return NULL;
+		}
+		tmr->node_id = node_id;
+		tmr->handle = handle;
+		tmr->state = SRV_TIMER_IDLE;
+		tbl->tmr[handle] = tmr;
+	}
+
+	return tmr;
+}
+
+/* Release all the timers of a node */
+static void __srv_timer_clear(int node_id)
+{
+	struct srv_timer_tbl * tbl = &server.wheel.tbl[node_id];
+	int i;
+
+	for (i = 0; i < tbl->len; ++i) {
+		if (tbl->tmr[i] != NULL) {
+			__srv_timer_dequeue(tbl->tmr[i]);
+			free(tbl->tmr[i]);
+		}
+	}
+
+	free(tbl->tmr);
+	tbl->tmr = NULL;
+	tbl->len = 0;
+}
+
+/* Map a clock pending at 'clk' with the old period of a node to the 
+   new one. 'base' is the node's last cycle before the breakpoint and
+   node->clk the same cycle on the new time scale, see
+   __chime_node_rekey(). */
+static inline uint64_t __node_clk_rescale(struct chime_node * node, 
+										  uint64_t base, uint64_t old_dt,
+										  uint64_t clk)
+{
+	uint64_t d = clk - base;
+	uint64_t cycles = d / old_dt;
+	uint64_t rem = d % old_dt;
+
+	return node->clk + (node->dt * cycles) + 
+		(uint64_t)((double)rem * node->dt / old_dt);
+}
+
+/* Re-key the wheel timers of a node after its clock period changed.
+   The ones already in the heap are re-keyed with the other events. */
+static void __srv_timer_rekey(struct chime_node * node, uint64_t base,
+							  uint64_t old_dt)
+{
+	struct srv_timer_tbl * tbl = &server.wheel.tbl[node->id];
+	int i;
+
+	for (i = 0; i < tbl->len; ++i) {
+		struct srv_timer * tmr = tbl->tmr[i];
+		uint64_t clk;
+
+		if ((tmr == NULL) || (tmr->state != SRV_TIMER_WHEEL))
+			continue;
+
+		clk = __node_clk_rescale(node, base, old_dt, tmr->w.clk);
+		assert((int64_t)(clk - server.heap->clk) >= 0);
+
+		wheel_remove(&server.wheel.w, &tmr->w);
+		__srv_timer_queue(tmr, clk);
+	}
+}
+
+/* A timer event was dispatched, reload periodic timers */
+static void __srv_timer_fired(struct chime_node * node, 
+							  struct chime_event * evt, uint64_t clk)
+{
+	struct srv_timer * tmr;
+
+	if ((tmr = __srv_timer_get(node->id, evt->oid, false)) == NULL)
+		return;
+
+	if (tmr->period == 0)
+		tmr->state = SRV_TIMER_IDLE;
+	else
+		__srv_timer_queue(tmr, clk + (node->dt * tmr->period));
+}
+
+/* Whether a timer event is still current */
+static bool __srv_timer_valid(struct chime_event * evt)
+{
+	struct srv_timer * tmr;
+
+	tmr = __srv_timer_get(evt->node_id, evt->oid, false);
+
+	return (tmr != NULL) && (tmr->state == SRV_TIMER_HEAP) && 
+		(tmr->seq == evt->seq);
+}
+
+static void __srv_timer_reset(void)
+{
+	int i;
+
+	for (i = 0; i <= CHIME_NODE_MAX; ++i)
+		__srv_timer_clear(i);
+
+	wheel_init(&server.wheel.w, server.heap->clk);
+	server.wheel.armed = false;
+}
+
+/* Get the next event from the heap. The timing wheel slots are
+   processed and the stale timer events discarded on the way. */
+static bool __chime_heap_next(uint64_t * clk, struct chime_event * evt)
+{
+	while (heap_minimum(server.heap, clk, evt)) {
+		if (evt->opc == CHIME_EVT_WHEEL) {
+			heap_delete_min(server.heap);
+			if (server.wheel.armed && (*clk == server.wheel.key)) {
+				server.wheel.armed = false;
+				wheel_advance(&server.wheel.w, server.wheel.clk, 
+							  __srv_timer_expire, NULL);
+				__wheel_sched();
+			}
+			continue;
+		}
+
+		if ((evt->opc == CHIME_EVT_TIMER) && !__srv_timer_valid(evt)) {
+			DBG3("<%d> stale timer %d", evt->node_id, evt->oid);
+			heap_delete_min(server.heap);
+			continue;
+		}
+
+		return true;
+	}
+
+	return false;
+}
+
+void __chime_req_timer_arm(struct chime_request * req)
+{
+	int node_id = req->node_id;
+	uint32_t cycles = req->timer_arm.ticks;
+	struct chime_node * node;
+	struct srv_timer * tmr;
+
+    if ((node = server.node[node_id]) == NULL) {
+		WARN("<%d> invalid node!!!", node_id);
+		return;
+	}
+
+	if (node->sid != server.sim.sid) {
+		WARN("<%d> wrong SID.", node_id);
+		return;
+	}
+
+	if (cycles == 0) {
+		WARN("<%d> cycles == 0 !!!", node_id);
+		return;
+	}
+
+	if ((tmr = __srv_timer_get(node_id, req->oid, true)) == NULL)
+		return;
+
+	DBG1("<%d> timer %d: cycles=%u period=%u", node_id, req->oid, 
+		 cycles, req->timer_arm.period);
+
+	__srv_timer_dequeue(tmr);
+	tmr->seq = req->timer_arm.seq;
+	tmr->period = req->timer_arm.period;
+	__srv_timer_queue(tmr, node->clk + (node->dt * cycles));
+}
+
+void __chime_req_timer_cancel(struct chime_request * req)
+{
+	struct srv_timer * tmr;
+
+	if ((tmr = __srv_timer_get(req->node_id, req->oid, false)) == NULL)
+		return;
+
+	DBG1("<%d> timer %d", req->node_id, req->oid);
+
+	/* an event already in the heap is dropped by the dispatcher */
+	__srv_timer_dequeue(tmr);
+}
+
+#define EVENT_PER_NODE_MAX 2048
+
+/* Re-key the pending events of a node after its clock period changed.
+   The period changes at the breakpoint 'bkpt': the time before it 
+   runs with the old period, the time after it with the new one. */
+static void __chime_node_rekey(struct chime_node * node, uint64_t old_dt,
+							   uint64_t bkpt)
+{
+	struct chime_event evt[EVENT_PER_NODE_MAX];
+	uint64_t clk[EVENT_PER_NODE_MAX];
+	int node_id = node->id;
+	uint64_t cycles;
+	uint64_t base;
+	uint64_t phase;
+	int i;
+	int n;
+
+	/* the events up to the heap clock were already dispatched */
+	if ((int64_t)(bkpt - server.heap->clk) < 0)
+		bkpt = server.heap->clk;
+	/* a running node may be ahead of the heap clock */
+	if ((int64_t)(bkpt - node->clk) < 0)
+		bkpt = node->clk;
+
+	/* advance the node to its last cycle before the breakpoint */
+	cycles = (bkpt - node->clk) / old_dt;
+	base = node->clk + (old_dt * cycles);
+	node->ticks += cycles;
+	node->time += cycles * ((double)old_dt / (double)SEC);
+
+	/* the cycle in progress at the breakpoint completes with the new
+	   period, move its start so that the node clock stays aligned */
+	phase = bkpt - base;
+	node->clk = bkpt - 
+		(uint64_t)((double)phase * node->dt / old_dt);
+
+	/* update clock on pending events !!! */
+	i = 1;
+	n = 0;
+	while (heap_pick(server.heap, i, &clk[n], &evt[n])) {
+		if (evt[n].node_id == node_id) {
+			DBG2("<%d> updating event %s", node_id, __evt_opc_nm[evt[n].opc]);
+			heap_delete(server.heap, i);
+			n++;
+			if (n == EVENT_PER_NODE_MAX) {
+				ERR("<%d> events per node limit!", node_id);
+				assert(0);
+				break;
+			}
+		} else {
+			i++;
+		}
+	}
+
+	for (i = 0; i < n; ++i) {
+		/* update evnt clock */
+		clk[i] = __node_clk_rescale(node, base, old_dt, clk[i]);
+		assert((int64_t)(clk[i] - server.heap->clk) >= 0);
+
+		/* insert into the clock simulation heap */
+		heap_insert_min(server.heap, clk[i], &evt[i]);
+	}
+
+	__srv_timer_rekey(node, base, old_dt);
+
+	DBG2("<%d> %d events updated", node_id, n);
+}
+
+/*****************************************************************************
+ * Temperature profiles
+ *****************************************************************************/
+
+/* Longest time between breakpoints when the temperature changes */
+#define TEMP_PROF_STEP_MAX 1.0
+/* Breakpoints per period of a sine profile */
+#define TEMP_PROF_SINE_STEPS 32
+
+/* Temperature of a profile 't' seconds from its start. The time of
+   the following breakpoint is returned in 'next', or a negative value if
+   the temperature won't change anymore. */
+static double __temp_prof_eval(struct chime_temp_prof * prof, 
+							   double t, double * next)
+{
+	double base = 0;
+	double tl;
+	double dt;
+	int i;
+
+	if (prof->type == TEMP_PROF_SINE) {
+		dt = prof->period / TEMP_PROF_SINE_STEPS;
+		*next = t + MIN(dt, TEMP_PROF_STEP_MAX);
+		return prof->mean + prof->ampl * sin(2 * M_PI * t / prof->period);
+	}
+
+	tl = prof->pt[prof->cnt - 1].t;
+	if (t >= tl) {
+		if (!prof->repeat || (tl <= prof->pt[0].t)) {
+			*next = -1;
+			return prof->pt[prof->cnt - 1].temp;
+		}
+		/* wrap around */
+		base = floor(t / tl) * tl;
+		t -= base;
+	}
+
+	if (t < prof->pt[0].t) {
+		*next = base + prof->pt[0].t;
+		return prof->pt[0].temp;
+	}
+
+	for (i = 0; prof->pt[i + 1].t <= t; ++i);
+
+	dt = prof->pt[i + 1].t - prof->pt[i].t;
+	*next = base + prof->pt[i + 1].t;
+	if (prof->pt[i + 1].temp == prof->pt[i].temp) {
+		/* flat segment */
+		return prof->pt[i].temp;
+	}
+
+	*next = MIN(*next, base + t + TEMP_PROF_STEP_MAX);
+	return prof->pt[i].temp + (prof->pt[i + 1].temp - prof->pt[i].temp) *
+		(t - prof->pt[i].t) / dt;
+}
+
+static void __chime_temp_clk_update(void)
+{
+	uint64_t clk = server.heap->clk;
+	int64_t dmin = INT64_MAX;
+	int cnt = 0;
+	int i;
+
+	for (i = 1; i <= LIST_LEN(server.node_idx); ++i) {
+		struct chime_node * node = server.node[server.node_idx[i]];
+		int64_t d;
+
+		if (node->s.prof_oid == OID_NULL)
+			continue;
+
+		d = (int64_t)(node->s.prof_next - clk);
+		if (d < dmin)
+			dmin = d;
+		cnt++;
+	}
+
+	server.sim.temp_cnt = cnt;
+	server.sim.temp_clk = clk + dmin;
+}
+
+static void __chime_node_temp_prof_clear(struct chime_node * node)
+{
+	if (node->s.prof_oid == OID_NULL)
+		return;
+
+	obj_decref(obj_getinstance(node->s.prof_oid));
+	node->s.prof_oid = OID_NULL;
+}
+
+/* Move a node to the next interval of its temperature profile. 
+   The clock period is set to the mean over the interval, computed
+   analytically for a linear temperature change: for 
+   u = T - 25, the mean of u^2 from u0 to u1 is (u0^2 + u0*u1 + u1^2)/3. */
+static void __chime_node_temp_prof_update(struct chime_node * node)
+{
+	struct chime_temp_prof * prof;
+	uint64_t old_dt;
+	double t0;
+	double t1;
+	double u0;
+	double u1;
+	double tmp;
+
+	prof = obj_getinstance(node->s.prof_oid);
+
+	/* the breakpoint may have passed while the node was idle */
+	if ((int64_t)(node->clk - node->s.prof_next) > 0)
+		t0 = (double)(node->clk - node->s.prof_start) / (double)SEC;
+	else
+		t0 = (double)(node->s.prof_next - node->s.prof_start) / (double)SEC;
+
+	u0 = __temp_prof_eval(prof, t0, &t1) - 25.0;
+	if (t1 < 0)
+		u1 = u0;
+	else
+		u1 = __temp_prof_eval(prof, t1, &tmp) - 25.0;
+
+	/* stop the node from running ahead with the old clock */
+	node->horizon = node->clk;
+	node->temperature = 25.0 + (u0 + u1) / 2;
+	old_dt = node->dt;
+	node->dt = node->dres * (1.0 - node->tc * (u0 * u0 + u0 * u1 + u1 * u1) / 3);
+	node->period = (double)node->dt / (double)SEC;
+	__live_node_sync(node);
+
+	DBG1("<%d> t=%.3f..%.3f temp=%.2f dt=%"PRIu64, 
+		 node->id, t0, t1, node->temperature, node->dt);
+
+	if (node->dt != old_dt)
+		__chime_node_rekey(node, old_dt, node->s.prof_next);
+
+	if (t1 < 0) {
+		/* end of profile, hold the last temperature */
+		__chime_node_temp_prof_clear(node);
+	} else {
+		node->s.prof_next = node->s.prof_start + (uint64_t)(t1 * SEC);
+	}
+}
+
+/* Apply the profile breakpoints due by 'clk' */
+static void __chime_temp_prof_step(uint64_t clk)
+{
+	int i;
+
+	for (i = 1; i <= LIST_LEN(server.node_idx); ++i) {
+		struct chime_node * node = server.node[server.node_idx[i]];
+
+		if (node->s.prof_oid == OID_NULL)
+			continue;
+
+		/* leave running nodes for a later step */
+		if (!node->bkpt)
+			continue;
+
+		/* if (node->s.prof_next <= clk) */
+		if ((int64_t)(node->s.prof_next - clk) <= 0)
+			__chime_node_temp_prof_update(node);
+	}
+
+	__chime_temp_clk_update();
+}
+
+void __chime_req_temp_prof(struct chime_request * req)
 {
-	char name[ENTRY_NAME_MAX + 8];
-	char plt_path[PATH_MAX];
-	char out_path[PATH_MAX];
-	char dat_path[PATH_MAX];
-	FILE * f;
+	int node_id = req->node_id;
+	struct chime_temp_prof * prof;
+	struct chime_node * node;
+	int i;
 
-	strncpy(name, var->name, ENTRY_NAME_MAX);
-	name[ENTRY_NAME_MAX] = '\0';
+	prof = obj_getinstance(req->oid);
+	assert(prof != NULL);
 
-	sprintf(plt_path, "./%s.plt", name);
-	sprintf(out_path, "./%s.png", name);
-	sprintf(dat_path, "./%s.dat", name);
+	/* sanity check */
+	node = server.node[node_id];
+    if (node == NULL) {
+		WARN("<%d> invalid node!!!", node_id);
+		obj_decref(prof);
+		return;
+	}
 
-	if ((f = fopen(plt_path, "w")) == NULL) {
-		ERR("fopen(\"%s\") failed: %s!", plt_path, __strerr());
-		return false;
+	if (prof->type == TEMP_PROF_SINE) {
+		if (!isnormal(prof->period) || (prof->period < 0)) {
+			ERR("<%d> invalid period!!!", node_id);
+			obj_decref(prof);
+			return;
+		}
+	} else {
+		for (i = 1; i < prof->cnt; ++i) {
+			if (prof->pt[i].t < prof->pt[i - 1].t)
+				break;
+		}
+		if ((prof->cnt == 0) || (prof->cnt > TEMP_PROF_PTS_MAX) || 
+			(i < prof->cnt) || (prof->pt[0].t < 0)) {
+			ERR("<%d> invalid profile points!!!", node_id);
+			obj_decref(prof);
+			return;
+		}
 	}
-	fprintf(f, "#set terminal wxt\n");
-	fprintf(f, "set terminal png size 1280,768 font 'Verdana,12'\n");
-	fprintf(f, "set output '%s'\n", out_path);
-	fprintf(f, "set offset graph 0.0,0.0,0.0,0.0\n");
-	fprintf(f, "# labels\n"); /* labels */
-	fprintf(f, "set xlabel 'Time(s)'\n");
-	fprintf(f, "set ylabel '%s'\n", name);
-	fprintf(f, "# define axis\n"); /* axis */
-	fprintf(f, "set style line 11 lc rgb '#808080' lt 1\n");
-	fprintf(f, "set border 3 back ls 11\n");
-	fprintf(f, "set tics out nomirror\n");
-	fprintf(f, "# define grid\n"); /* grid */
-	fprintf(f, "set style line 12 lc rgb '#808080' lt 0 lw 1\n");
-	fprintf(f, "set grid back ls 12\n");
-	fprintf(f, "# line styles\n"); /* line styles */
-	fprintf(f, "set style line 1 lc rgb '#801010' pt 0 lt 1 lw 2\n");
-	fprintf(f, "set style line 2 lc rgb '#108010' pt 0 lt 1 lw 2\n");
-	fprintf(f, "set style line 3 lc rgb '#101080' pt 0 lt 1 lw 2\n");
-	fprintf(f, "plot '%s' using 1:2 notitle with lp ls 1\n", dat_path);
-	fprintf(f, "set output\n");
-	fprintf(f, "quit\n");
-	fclose(f);
 
-	return true;
-}
+	INF("<%d> %s temperature profile.", node_id, 
+		(prof->type == TEMP_PROF_SINE) ? "sine" : "piecewise");
 
-static double xtal_temp_offs(float tc, float t)
-{
-	return 1.0 - tc * (t - 25.0) * (t - 25.0);
+	__chime_node_temp_prof_clear(node);
+	node->s.prof_oid = req->oid;
+	node->s.prof_start = node->clk;
+	node->s.prof_next = node->clk;
+
+	/* apply the first interval now */
+	__chime_node_temp_prof_update(node);
+	__chime_temp_clk_update();
 }
 
 static void __chime_node_alloc_init(void)
@@ -440,6 +1330,9 @@ static int __chime_node_clear_comms(int node_id)
 		if (u8_list_contains(comm->node_lst, node_id)) {
 			INF("<%d> removing from COMM %d", node_id, server.comm_oid[i]);
 			u8_list_remove(comm->node_lst, node_id);
+			NODE_MAP_CLR(comm->rcv_map, node_id);
+			NODE_MAP_CLR(comm->dcd_map, node_id);
+			comm->addr[node_id] = 0;
 			n++;
 		}
 		objpool_unlock();
@@ -466,8 +1359,12 @@ static bool __chime_node_remove(int node_id)
 
 	INF("removing node: %d, oid=%d.", node_id, obj_oid(node));
 
+	/* release the temperature profile */
+	__chime_node_temp_prof_clear(node);
+
 	/* remove from vector of nodes */
 	server.node[node_id] = NULL;
+	__live_node_clear(node_id);
 
 	/* close event message queue */
 	__mq_close(node->s.evt_mq);
@@ -481,6 +1378,8 @@ static bool __chime_node_remove(int node_id)
 //	heap_dump(stderr, server.heap);
 	__chime_node_clear_events(node_id);
 
+	__srv_timer_clear(node_id);
+
 	__chime_node_clear_comms(node_id);
 
 	return bkpt;
@@ -495,8 +1394,17 @@ static bool __chime_node_reset(int node_id, uint32_t sid)
 
 	/* restart clock */
 	node->clk = server.heap->clk;
+	node->horizon = node->clk;
 	/* restart time */
 	node->time = 0;
+	/* the cycles the CPU reports until it inits are from before */
+	node->s.rst_pend = true;
+	/* the CPU declares its profile again on reset */
+	__chime_node_temp_prof_clear(node);
+	/* clear the COMM counters, the channels are attached again */
+	memset(node->tx, 0, sizeof(node->tx));
+	/* the CPU creates its timers again */
+	__srv_timer_clear(node_id);
 
 	/* send a reset event to the node */
 	evt.node_id = node->id;
@@ -625,6 +1533,7 @@ static void __sim_timer_reset(void)
 	server.sim.tick_lost = 0;
 	/* reset the simulation time budget */
 	server.sim.clk = server.heap->clk;
+	__live_speed_reset();
 }
 
 static void __chime_sim_reset(void)
@@ -655,28 +1564,83 @@ static void __chime_sim_reset(void)
 	}
 
 	server.heap->clk = 0LL;
+	__srv_timer_reset();
+	server.sim.hold_clk = 0;
+	server.sim.evt_cnt = 0;
+	server.sim.heap_sum = 0;
+	server.sim.heap_smpl = 0;
+	server.sim.heap_peak = 0;
+	__live_step_sync(NULL, 0);
 
 	INF("reseting timer!");
 	__sim_timer_reset();
 }
 
-#define CHIME_TICKS_PER_STEP_MAX 4
+/* Pacing timer interval */
+#define CHIME_TMR_PERIOD_US 500
+/* Maximum simulation budget consumed by a single step (40ms) */
+#define CHIME_TICKS_PER_STEP_MAX (40000 / CHIME_TMR_PERIOD_US)
+/* Overdue budget the simulation may still catch up with (1s) */
+#define CHIME_TICKS_BACKLOG_MAX (1000000 / CHIME_TMR_PERIOD_US)
+
+/* Send the pending event of a node. */
+static void __chime_node_evt_flush(struct chime_node * node, int flags)
+{
+	node->s.pend.opc |= flags;
+
+	DBG3("<%d> [%s]", node->id, 
+		 __evt_opc_nm[node->s.pend.opc & ~CHIME_EVT_MORE]);
+
+	if (__mq_send(node->s.evt_mq, &node->s.pend, CHIME_EVENT_LEN) < 0) {
+		WARN("<%d> __mq_send() failed!", node->id);
+		/* remove unresponsive node... */
+		__chime_node_remove(node->id);
+	}
+}
 
 /* This is the simulation dispatcher... */
 
+void __chime_sig_pause_sim(struct chime_request * req);
+
 static void __chime_sim_step(void)
 {
+	uint8_t batch[CHIME_NODE_MAX]; /* nodes dispatched in this step */
 	struct chime_event evt;
+	uint64_t horizon; /* safe run-ahead clock */
+	int cnt = 0;
+	int i;
 	uint64_t sim_clk; /* simulation budget clock */
 	uint64_t max_clk; /* step window clock */
 	uint64_t cpu_clk; /* cpu clock */
 
 	/* get the first clock from the heap */
-	if (!heap_minimum(server.heap, &cpu_clk, &evt)) {
+	if (!__chime_heap_next(&cpu_clk, &evt)) {
 		WARN("clock heap is empty!!!");
 		return;
 	}
 
+	/* apply the temperature profile breakpoints due by the next event */
+	if ((server.sim.temp_cnt > 0) && 
+		((int64_t)(server.sim.temp_clk - cpu_clk) <= 0)) {
+		__chime_temp_prof_step(cpu_clk);
+		/* the events may have been re-keyed */
+		__chime_heap_next(&cpu_clk, &evt);
+	}
+
+	/* stop condition reached, hold the simulation */
+	if (((server.sim.stop_clk != 0) && 
+		 ((int64_t)(cpu_clk - server.sim.stop_clk) >= 0)) ||
+		((server.sim.stop_evt != 0) && 
+		 (server.sim.evt_cnt >= server.sim.stop_evt))) {
+		INF("stop condition reached.");
+		/* the heap clock is the last event before the stop clock */
+		if ((server.sim.stop_clk != 0) && 
+			((int64_t)(cpu_clk - server.sim.stop_clk) >= 0))
+			server.sim.hold_clk = server.sim.stop_clk;
+		__chime_sig_pause_sim(NULL);
+		return;
+	}
+
 	/* get the simulation timer clock */
 	sim_clk = server.sim.clk;
 	DBG4("sim_clk=%"PRId64".", sim_clk);
@@ -696,32 +1660,65 @@ static void __chime_sim_step(void)
 			return; /* wait for timer notification */
 		}
 
-		/* consume the ticks */
-		server.sim.tick_cnt += ticks;
-
-		if (ticks > CHIME_TICKS_PER_STEP_MAX) {
+		if (ticks > CHIME_TICKS_BACKLOG_MAX) {
 			/* The simulation is running slow.
 			   it is time to get a faster computer... */
 			if (server.sim.tick_lost == 0) {
 				WARN("sluggishness detected...");
 			}
-			/* limit the simulation ticks consumption,
-			   to avoid it growing fat. Add the remaining ticks
-			   to the lost count for speed correction. */
-			server.sim.tick_lost += ticks - CHIME_TICKS_PER_STEP_MAX;
+			/* Too far behind to catch up. Drop the excess
+			   ticks, adding them to the lost count. */
+			server.sim.tick_lost += ticks - CHIME_TICKS_BACKLOG_MAX;
+			server.sim.tick_cnt += ticks - CHIME_TICKS_BACKLOG_MAX;
+			ticks = CHIME_TICKS_BACKLOG_MAX;
+		}
+
+		/* Limit the budget consumed by this step, to avoid 
+		   it growing fat. The overdue ticks are left pending 
+		   and spread over the next steps. */
+		if (ticks > CHIME_TICKS_PER_STEP_MAX)
 			ticks = CHIME_TICKS_PER_STEP_MAX;
-		};
+
+		/* consume the ticks */
+		server.sim.tick_cnt += ticks;
 
 		/* update the simulation budget clock */
 		sim_clk = server.sim.clk += (int64_t)ticks * server.sim.period;
 		DBG1("ticks=%d sim.clk=%"PRId64".", ticks, server.sim.clk);
 	}
 
+	/* don't run past the stop clock */
+	if ((server.sim.stop_clk != 0) && 
+		((int64_t)(sim_clk - server.sim.stop_clk) > 0))
+		sim_clk = server.sim.stop_clk;
+
 	/* set the initial step clock to the simulation budget */
 	max_clk = sim_clk;
 
+	/* Nodes dispatched in this step can run ahead on their own 
+	   (see chime_cpu_step()) up to the earliest of: the simulation 
+	   budget, the next event in the heap, the earliest 
+	   event a COMM transmission from this step can cause and the
+	   next temperature profile breakpoint. */
+	horizon = sim_clk;
+	if ((server.sim.lookahead != UINT64_MAX) && 
+		((int64_t)(cpu_clk + server.sim.lookahead - horizon) < 0))
+		horizon = cpu_clk + server.sim.lookahead;
+	if ((server.sim.temp_cnt > 0) && 
+		((int64_t)(server.sim.temp_clk - horizon) < 0))
+		horizon = server.sim.temp_clk;
+
 	DBG3("max_clk=%"PRIu64" --------", max_clk);
 
+	server.sim.step_cnt++;
+
+	/* sample the heap depth */
+	i = heap_size(server.heap);
+	server.sim.heap_sum += i;
+	server.sim.heap_smpl++;
+	if (i > server.sim.heap_peak)
+		server.sim.heap_peak = i;
+
 	/* Parallel run decision algorithm */
 
 	/* Assumptions:
@@ -742,7 +1739,7 @@ static void __chime_sim_step(void)
 		/* dead node !!!! */
 		assert(node != NULL);
 
-		/* FIXME: Is it possible to have multiple events to the same node
+		/* It is possible to have multiple events to the same node
 		   (CPU) in the event heap.
 		   We keep track of this by means of the breakpoint
 		   indication flag (bkpt).
@@ -750,17 +1747,15 @@ static void __chime_sim_step(void)
 		   flag is set.
 		   When the first event is dispatched the breakpoint
 		   flag is cleared. */
-		if (!node->bkpt) {
-			/* If we reached this bracnh it means we have multiple events.
-			   To simplify the client, we allow only one event to be
-			   dispatched per node at each simulation step.
-			   Stop the simulation after dispatching one event to the
-			   node. */
+		if (!node->bkpt && (node->s.step != server.sim.step_cnt)) {
+			/* The node is still running from a previous step.
+			   Stop the simulation here. */
 			break;
 		}
 
 		/* remove the clock from the heap */
 		heap_delete_min(server.heap);
+		server.sim.evt_cnt++;
 		/* update the heap clock with the heap's head */
 		server.heap->clk = cpu_clk;
 
@@ -795,18 +1790,23 @@ static void __chime_sim_step(void)
 			DBG3("max_clk=%"PRIu64, max_clk);
 		}
 
-		/* Multiple events to the same node (CPU) are possible.
-		   We keep track of this by means of the breakpoint
-		   indication flag.
-		   When the CPU checks in for simulation, the breakpoint
-		   flag is set.
-		   When the first event is dispatched the breakpoint
-		   flag is cleared. The number of running CPUs is updated
-		   accordingly. */
-		node->bkpt = false; /* clear breakpoint flag */
-		/* update the running count */
-		server.sim.checkout_cnt++;
-		DBG3("server.sim.checkout_cnt=%d.", server.sim.checkout_cnt );
+		if (node->bkpt) {
+			/* First event to this node in the step. The number 
+			   of running CPUs is updated accordingly. */
+			node->bkpt = false; /* clear breakpoint flag */
+			node->s.step = server.sim.step_cnt;
+			batch[cnt++] = node_id;
+			/* update the running count */
+			server.sim.checkout_cnt++;
+			DBG3("server.sim.checkout_cnt=%d.", server.sim.checkout_cnt );
+		} else {
+			/* The node was already dispatched in this step. As the 
+			   step window is no longer than the node's cycle this 
+			   event falls in the same cycle. Chain it to the batch, 
+			   the CPU will run the ISRs back to back before 
+			   checking in again. */
+			__chime_node_evt_flush(node, CHIME_EVT_MORE);
+		}
 
 #if 0
 		if (evt.opc == CHIME_EVT_EOT0) {
@@ -817,16 +1817,17 @@ static void __chime_sim_step(void)
 		}
 #endif
 
-		DBG3("<%d> [%s]", node_id, __evt_opc_nm[evt.opc]);
+		/* reload a periodic server managed timer, unless the flush 
+		   above removed the node */
+		if ((evt.opc == CHIME_EVT_TIMER) && (server.node[node_id] != NULL))
+			__srv_timer_fired(node, &evt, cpu_clk);
 
-		if (__mq_send(node->s.evt_mq, &evt, CHIME_EVENT_LEN) < 0) {
-			WARN("<%d> __mq_send() failed!", node_id);
-			/* remove unresponsive node... */
-			__chime_node_remove(node_id);
-		}
+		/* hold the event until we know whether more follow */
+		if (server.node[node_id] != NULL)
+			node->s.pend = evt;
 
 		/* get the next clock from the heap */
-		if (!heap_minimum(server.heap, &cpu_clk, &evt)) {
+		if (!__chime_heap_next(&cpu_clk, &evt)) {
 			DBG1("heap empty...");
 			break;
 		}
@@ -834,6 +1835,24 @@ static void __chime_sim_step(void)
 		/* if (cpu_clk < max_clk) */
 	} while ((int64_t)(cpu_clk - max_clk) < 0);
 
+	/* if (cpu_clk < horizon) */
+	if ((heap_minimum(server.heap, &cpu_clk, &evt)) && 
+		((int64_t)(cpu_clk - horizon) < 0))
+		horizon = cpu_clk;
+
+	__live_step_sync(batch, cnt);
+
+	/* publish the horizon and send the last event of each batch */
+	for (i = 0; i < cnt; ++i) {
+		struct chime_node * node = server.node[batch[i]];
+
+		/* the node may have been removed */
+		if (node != NULL) {
+			node->horizon = horizon;
+			__chime_node_evt_flush(node, 0);
+		}
+	}
+
 	/* done. wait for next sync... */
 	DBG3("done.");
 };
@@ -851,6 +1870,7 @@ void __chime_sig_pause_sim(struct chime_request * req)
 
 		/* set the paused flag */
 		server.sim.paused = true;
+		__live_paused_set(true);
 	}
 }
 
@@ -858,6 +1878,8 @@ void __chime_sig_resume_sim(struct chime_request * req)
 {
 	if (server.sim.paused) {
 		server.sim.paused = false;
+		server.sim.hold_clk = 0;
+		__live_paused_set(false);
 		__chime_sanity_check();
 		/* reset simulation timer */
 		__sim_timer_reset();
@@ -902,6 +1924,7 @@ void __chime_req_bkpt(struct chime_request * req)
 
 	assert(node->bkpt == false);
 	node->bkpt = true; /* set breakpoint flag */
+	__live_node_sync(node);
 
 	DBG1("<%d> node->clk=%"PRIu64".", node_id, node->clk);
 
@@ -964,6 +1987,93 @@ void __chime_req_timer(struct chime_request * req)
 	heap_insert_min(server.heap, clk, &evt);
 }
 
+/* Number of token passes from node 'from' to node 'to' on the
+   logical ring. A full rotation if 'from' and 'to' are the same. */
+static int __comm_tok_hops(struct chime_comm * comm, int from, int to)
+{
+	int n = 0;
+	int i;
+
+	for (i = 1; i <= LIST_LEN(comm->node_lst); ++i) {
+		int id = comm->node_lst[i];
+
+		if (from < to) {
+			if ((id > from) && (id <= to))
+				n++;
+		} else if ((id > from) || (id <= to))
+			n++;
+	}
+
+	return n;
+}
+
+/* Successor of node 'id' on the logical ring */
+static int __comm_tok_next(struct chime_comm * comm, int id)
+{
+	int next = CHIME_NODE_MAX + 1;
+	int first = CHIME_NODE_MAX + 1;
+	int i;
+
+	for (i = 1; i <= LIST_LEN(comm->node_lst); ++i) {
+		int j = comm->node_lst[i];
+
+		if (j < first)
+			first = j;
+		if ((j > id) && (j < next))
+			next = j;
+	}
+
+	return (next <= CHIME_NODE_MAX) ? next : first;
+}
+
+/* Token MAC: the absolute time node 'xmt_id', ready to transmit at 'clk',
+   receives the token. The token is not simulated while idle, the ring 
+   position is computed from the last holder and the rotation time.
+   Transmissions are granted in the order the requests are received. */
+static uint64_t __comm_tok_wait(struct chime_comm * comm, 
+								int xmt_id, uint64_t clk)
+{
+	uint64_t pass_dt = comm->attr.tok_bits * comm->bit_time;
+	int n = LIST_LEN(comm->node_lst);
+	uint64_t rot_dt;
+	uint64_t tok_clk;
+	uint64_t m = 0;
+	int hops;
+
+	if (!u8_list_contains(comm->node_lst, xmt_id)) {
+		WARN("<%d> not in the ring!", xmt_id);
+		return ((int64_t)(clk - comm->tok.clk) > 0) ? clk : comm->tok.clk;
+	}
+
+	/* first arrival at the transmitter from the last holder */
+	hops = __comm_tok_hops(comm, comm->tok.id, xmt_id) % n;
+	tok_clk = comm->tok.clk + hops * pass_dt;
+
+	/* wait for the rotations which reach it after 'clk' */
+	if ((int64_t)(clk - tok_clk) > 0) {
+		rot_dt = n * pass_dt;
+		if (rot_dt > 0) {
+			m = (clk - tok_clk + rot_dt - 1) / rot_dt;
+			tok_clk += m * rot_dt;
+		} else
+			tok_clk = clk;
+	}
+
+	comm->tok.pass_cnt += hops + m * n;
+	comm->tok.wait_sum += tok_clk - clk;
+
+	return tok_clk;
+}
+
+/* Token MAC: pass the token on after the transmission ending at 'clk' */
+static void __comm_tok_pass(struct chime_comm * comm, int xmt_id, uint64_t clk)
+{
+	comm->tok.id = __comm_tok_next(comm, xmt_id);
+	comm->tok.clk = clk + comm->attr.tok_bits * comm->bit_time;
+	comm->tok.pass_cnt++;
+	comm->tok.frm_cnt++;
+}
+
 void __chime_req_comm_xmt(struct chime_request * req)
 {
 	int xmt_id = req->node_id;
@@ -981,9 +2091,12 @@ void __chime_req_comm_xmt(struct chime_request * req)
 	uint64_t xmt_delay;
 	uint64_t propagation_delay;
 	uint64_t xmt_dt;
+	uint64_t ack_dt = 0;
 	uint64_t clk;
 	void * buf;
 	int len;
+	int dst;
+	unsigned int inflight;
 	int i;
 
 	/* get the transmitting node instance */
@@ -1010,6 +2123,7 @@ void __chime_req_comm_xmt(struct chime_request * req)
 	/* frame info */
 	buf = obj_getinstance(req->comm.buf_oid);
 	len = req->comm.buf_len;
+	dst = req->comm.dst;
 
 	evt.node_id = xmt_id;
 	evt.oid = oid;
@@ -1026,8 +2140,37 @@ void __chime_req_comm_xmt(struct chime_request * req)
 	DBG4("bits=%u speed=%0.1fbps xmt_dt=%"PRIu64"",
 		bits, attr->speed_bps, TS2USEC(xmt_dt));
 
+	/* not acknowledged if no one has the destination address */
+	if (dst != COMM_ADDR_BCAST)
+		evt.u32 = 1;
+	/* frames from other nodes not finished yet */
+	inflight = 1;
+	for (i = 1; i <= LIST_LEN(comm->node_lst); ++i) {
+		int id = comm->node_lst[i];
+
+		if (id == xmt_id)
+			continue;
+		if ((int64_t)(comm->eot[id] - xmt_node->clk) > 0)
+			inflight++;
+		if ((dst != COMM_ADDR_BCAST) && (comm->addr[id] == dst))
+			evt.u32 = 0;
+	}
+	if (inflight > comm->tx.inflight_max)
+		comm->tx.inflight_max = inflight;
+
 	/* Medium access delay */
-	if (attr->max_jitter != 0) {
+	if (attr->mac == COMM_MAC_TOKEN) {
+		/* wait for the token after writing the frame */
+		clk = xmt_node->clk + wr_cycles * xmt_node->dt;
+		mac_delay = __comm_tok_wait(comm, xmt_id, clk) - clk;
+		if (dst != COMM_ADDR_BCAST) {
+			/* the handshake holds the medium after the frame */
+			ack_dt = attr->ack_bits * comm->bit_time;
+			if (evt.u32 != 0)
+				comm->tok.nak_cnt++;
+		}
+		DBG4("token wait=%"PRIu64".", TS2USEC(mac_delay));
+	} else if (attr->max_jitter != 0) {
 		double latency;
 		/* low order approximation of a normal distribution random number,
 		   using the central limit theorem.
@@ -1044,7 +2187,7 @@ void __chime_req_comm_xmt(struct chime_request * req)
 		DBG4("latency=0.0 delay=%"PRIu64".", TS2USEC(mac_delay));
 	}
 
-	if (attr->nod_delay != 0) {
+	if ((attr->mac != COMM_MAC_TOKEN) && (attr->nod_delay != 0)) {
 		int n = LIST_LEN(comm->node_lst);
 		mac_delay += unif_rand(&comm->randseed1) * attr->nod_delay * n * SEC;
 	}
@@ -1052,7 +2195,7 @@ void __chime_req_comm_xmt(struct chime_request * req)
 	mac_delay += wr_cycles * xmt_node->dt;
 
 	/* total transmission time */
-	xmt_delay = mac_delay + xmt_dt;
+	xmt_delay = mac_delay + xmt_dt + ack_dt;
 
 	if (attr->hist_en) {
 		/* update statistics */
@@ -1062,6 +2205,14 @@ void __chime_req_comm_xmt(struct chime_request * req)
 	/* absolute clock time for end of transmission */
 	eot_clk = xmt_node->clk + xmt_delay;
 
+	if (attr->mac == COMM_MAC_TOKEN)
+		__comm_tok_pass(comm, xmt_id, eot_clk);
+
+	/* update the live counters */
+	comm->eot[xmt_id] = eot_clk;
+	__chime_comm_tx_count(comm, xmt_node, req->opc - CHIME_REQ_XMT0, len,
+						  xmt_node->clk + mac_delay, xmt_dt + ack_dt);
+
 	if (attr->txbuf_en) {
 		/* buffer write clock */
 		clk = xmt_node->clk + (wr_cycles * xmt_node->dt);
@@ -1083,7 +2234,7 @@ void __chime_req_comm_xmt(struct chime_request * req)
 	/* FIXME: propagation delay */
 	propagation_delay = 0;
 	/* absolute clock time for end of reception */
-	rcv_clk = eot_clk + propagation_delay;
+	rcv_clk = eot_clk - ack_dt + propagation_delay;
 	/* insert one receive event for each node in the list */
 	evt.buf.oid = req->comm.buf_oid;
 	evt.buf.len = len;
@@ -1098,6 +2249,12 @@ void __chime_req_comm_xmt(struct chime_request * req)
 		if (id == xmt_id) /* don't send back to the transmitter */
 			continue;
 
+		/* passive listener or not addressed, no events */
+		if ((!NODE_MAP_TST(comm->rcv_map, id) ||
+			 ((dst != COMM_ADDR_BCAST) && (comm->addr[id] != dst))) &&
+			!(attr->dcd_en && NODE_MAP_TST(comm->dcd_map, id)))
+			continue;
+
 		DBG3("<%d> --> <%d>", xmt_id, id);
 
 		node = server.node[id];
@@ -1109,7 +2266,7 @@ void __chime_req_comm_xmt(struct chime_request * req)
 
 		evt.node_id = id;
 
-		if (attr->dcd_en) {
+		if (attr->dcd_en && NODE_MAP_TST(comm->dcd_map, id)) {
 			uint64_t dcd_clk;
 
 			/* absolute clock time for data carrier detection,
@@ -1124,6 +2281,12 @@ void __chime_req_comm_xmt(struct chime_request * req)
 			heap_insert_min(server.heap, clk, &evt);
 		}
 
+		/* the medium is busy for everyone, but only the 
+		   addressed nodes receive the frame */
+		if (!NODE_MAP_TST(comm->rcv_map, id) ||
+			((dst != COMM_ADDR_BCAST) && (comm->addr[id] != dst)))
+			continue;
+
 		/* Round up the number of cycles for this node to receive and
 		   read the comm data.
 		   The rcv_clk is the absolute time for the end of reception.
@@ -1191,6 +2354,7 @@ void __chime_req_step(struct chime_request * req)
 
 	assert(node->bkpt == false);
 	node->bkpt = true; /* set breakpoint flag */
+	__live_node_sync(node);
 
 	evt.node_id = node_id;
 	evt.opc = CHIME_EVT_STEP;
@@ -1266,6 +2430,7 @@ void __chime_node_join(struct chime_request * req)
 		node->s.evt_mq = mq;
 		node->id = node_id;
 		node->clk = server.heap->clk;
+		node->horizon = node->clk;
 		node->temperature = server.temperature;
 		node->tc = (node->tc_ppm / 1000000.0);
 
@@ -1275,6 +2440,8 @@ void __chime_node_join(struct chime_request * req)
 		node->period = (double)node->dt / (double)SEC;
 		node->time = 0;
 		node->bkpt = false;
+		node->s.rst_pend = false;
+		node->s.prof_oid = OID_NULL;
 
 #if DEBUG
 		{
@@ -1307,6 +2474,7 @@ void __chime_node_join(struct chime_request * req)
 	} else if (node_id >= 0) {
 		/* insert in the node pointer list */
 		server.node[node_id] = node;
+		__live_node_add(node);
 		/* insert ID in the index list */
 		u8_list_insert(server.node_idx, node_id);
 //		server.sim.checkout_cnt++;
@@ -1363,6 +2531,11 @@ void __chime_req_init(struct chime_request * req)
 
 	/* clear the breakpoint flag */
 	node->bkpt = false;
+	node->s.rst_pend = false;
+	/* The simulation may have stepped since the reset, the node 
+	   clock starts now that the CPU is running. */
+	node->clk = server.heap->clk;
+	node->horizon = node->clk;
 
 	/* increment the checkout counter */
 	server.sim.checkout_cnt++;
@@ -1473,19 +2646,13 @@ void __chime_req_reset_cpu(struct chime_request * req)
 }
 
 
-#define EVENT_PER_NODE_MAX 2048
-
 void __chime_req_temp_set(struct chime_request * req)
 {
-	struct chime_event evt[EVENT_PER_NODE_MAX];
-	uint64_t clk[EVENT_PER_NODE_MAX];
 	int node_id = req->node_id;
 	float t = req->temp.val;
 	struct chime_node * node;
 	double old_period;
 	double old_dt;
-	int i;
-	int n;
 
 	/* sanity check */
 	node = server.node[node_id];
@@ -1506,15 +2673,23 @@ void __chime_req_temp_set(struct chime_request * req)
 		return;
 	}
 
+	/* an explicit temperature overrides the profile */
+	if (node->s.prof_oid != OID_NULL) {
+		__chime_node_temp_prof_clear(node);
+		__chime_temp_clk_update();
+	}
 
 	old_dt = node->dt;
 	(void)old_dt;
 	old_period = node->period;
 	(void)old_period;
 
+	/* stop the node from running ahead with the old clock */
+	node->horizon = node->clk;
 	node->temperature = t;
 	node->dt = node->dres * xtal_temp_offs(node->tc, node->temperature);
 	node->period = (double)node->dt / (double)SEC;
+	__live_node_sync(node);
 
 #if DEBUG
 	{
@@ -1525,39 +2700,7 @@ void __chime_req_temp_set(struct chime_request * req)
 	}
 #endif
 
-	/* update clock on pending events !!! */
-	i = 1;
-	n = 0;
-	while (heap_pick(server.heap, i, &clk[n], &evt[n])) {
-		if (evt[n].node_id == node_id) {
-			DBG2("<%d> updating event %s", node_id, __evt_opc_nm[evt[n].opc]);
-			heap_delete(server.heap, i);
-			n++;
-			if (n == EVENT_PER_NODE_MAX) {
-				ERR("<%d> events per node limit!", node_id);
-				assert(0);
-				break;
-			}
-		} else {
-			i++;
-		}
-	}
-
-	for (i = 0; i < n; ++i) {
-		int32_t cycles;
-
-		cycles = (clk[i] - node->clk) / old_dt;
-
-		/* update evnt clock */
-		clk[i] = node->clk + (node->dt * cycles);
-
-		/* insert into the clock simulation heap */
-		assert((int64_t)(clk[i] - server.heap->clk) >= 0);
-		heap_insert_min(server.heap, clk[i], &evt[i]);
-	}
-
-	DBG2("<%d> %d events updated", node_id, n);
-
+	__chime_node_rekey(node, old_dt, server.heap->clk);
 }
 
 void __chime_req_sim_speed_set(struct chime_request * req)
@@ -1606,6 +2749,8 @@ void __chime_req_comm_create(struct chime_request * req)
 
 	/* alloc statistics distribution bins */
 	comm->stat = malloc(COMM_STAT_BINS * sizeof(uint32_t));
+	/* alloc the end of transmission clocks */
+	comm->eot = malloc((CHIME_NODE_MAX + 1) * sizeof(uint64_t));
 
 	/* reset COMM */
 	__chime_comm_reset(comm);
@@ -1623,6 +2768,9 @@ void __chime_req_comm_destroy(struct chime_request * req)
 
 	/* release statistics distribution bins */
 	free(comm->stat);
+	free(comm->eot);
+
+	__chime_lookahead_update();
 }
 
 void __chime_req_reset_all(struct chime_request * req)
@@ -1732,6 +2880,8 @@ void __chime_req_var_dump(struct chime_request * req)
 		__chime_var_dump(var);
 		__chime_var_flush(var);
 	}
+
+	server.sim.dump_cnt++;
 }
 
 void __chime_req_var_rec(struct chime_request * req)
@@ -1793,6 +2943,29 @@ void __chime_req_var_rec(struct chime_request * req)
 	rec->y = req->rec.val;
 }
 
+/* The CPU runs ahead on a local copy of its clock (see chime_cpu_step()).
+   The cycles are reported with its next request, advance the node clock 
+   before handling it. */
+static void __chime_node_ahead(struct chime_request * req)
+{
+	struct chime_node * node;
+	uint32_t cycles = req->ahead;
+
+	if ((node = server.node[req->node_id]) == NULL)
+		return;
+
+	/* the node was reset while running ahead */
+	if (node->s.rst_pend) {
+		DBG("<%d> dropping %u cycles from before the reset.", 
+			req->node_id, cycles);
+		return;
+	}
+
+	node->clk += node->dt * cycles;
+	node->ticks += cycles;
+	node->time += cycles * node->period;
+}
+
 static int chime_ctrl_task(void * arg)
 {
 	uint32_t buf[CHIME_REQUEST_LEN / 4];
@@ -1801,6 +2974,7 @@ static int chime_ctrl_task(void * arg)
 	ssize_t len;
 
 	__thread_init("CTRL");
+	__thread_placement(true);
 
 	INF("simulation thread started.");
 
@@ -1808,6 +2982,9 @@ static int chime_ctrl_task(void * arg)
 
 		DBG3("<%d> [%s]", req->node_id, __req_opc_nm[req->opc]);
 
+		if (req->ahead != 0)
+			__chime_node_ahead(req);
+
 		switch (req->opc) {
 		case CHIME_REQ_TMR0:
 		case CHIME_REQ_TMR1:
@@ -1910,6 +3087,16 @@ static int chime_ctrl_task(void * arg)
 		case CHIME_REQ_CPU_RESET:
 			__chime_req_reset_cpu(req);
 			break;
+
+		case CHIME_REQ_TEMP_PROF:
+			__chime_req_temp_prof(req);
+			break;
+		case CHIME_REQ_TIMER_ARM:
+			__chime_req_timer_arm(req);
+			break;
+		case CHIME_REQ_TIMER_CANCEL:
+			__chime_req_timer_cancel(req);
+			break;
 		}
 	}
 
@@ -1980,15 +3167,79 @@ void chime_server_comm_stat(void)
 		ERR("__mq_send() failed: %s.", __strerr());
 }
 
-void chime_server_var_dump(void)
+int chime_server_var_dump(void)
 {
 	struct chime_req_hdr req;
+	uint32_t cnt = server.sim.dump_cnt;
+	int tmo;
 
 	req.node_id = 0;
 	req.opc = CHIME_REQ_VAR_DUMP;
 	req.oid = 0;
-	if (__mq_send(server.tmr.mq, &req, CHIME_REQ_HDR_LEN) < 0)
+	if (__mq_send(server.tmr.mq, &req, CHIME_REQ_HDR_LEN) < 0) {
 		ERR("__mq_send() failed: %s.", __strerr());
+		return -1;
+	}
+
+	/* wait for the files to be written */
+	for (tmo = CHIME_VAR_DUMP_TMO_MS; server.sim.dump_cnt == cnt; tmo -= 10) {
+		if (tmo <= 0) {
+			ERR("timeout waiting for the variables dump!");
+			return -1;
+		}
+		__msleep(10);
+	}
+
+	return 0;
+}
+
+void chime_server_stat(struct chime_sim_stat * stat)
+{
+	/* a run held by the stop clock reached the stop time */
+	if (server.sim.paused && (server.sim.hold_clk != 0))
+		stat->time = (double)server.sim.hold_clk / (double)SEC;
+	else
+		stat->time = (double)server.heap->clk / (double)SEC;
+	stat->evt_cnt = server.sim.evt_cnt;
+	stat->step_cnt = server.sim.step_cnt;
+	stat->heap_avg = (server.sim.heap_smpl == 0) ? 0 : 
+		(float)((double)server.sim.heap_sum / server.sim.heap_smpl);
+	stat->heap_peak = server.sim.heap_peak;
+	stat->paused = server.sim.paused;
+}
+
+int chime_server_comm_node_stat(const char * name, int node_id, 
+								struct chime_comm_stat * stat)
+{
+	struct chime_node * node;
+	int oid;
+	int i;
+
+	if ((oid = __dir_lookup(name)) == OID_NULL)
+		return -1;
+
+	if ((node_id <= 0) || (node_id > CHIME_NODE_MAX) || 
+		((node = server.node[node_id]) == NULL))
+		return -1;
+
+	memset(stat, 0, sizeof(struct chime_comm_stat));
+
+	for (i = 0; i < CHIME_NODE_COMM_MAX; ++i) {
+		if (node->tx[i].oid == oid) {
+			stat->frames += node->tx[i].frm_cnt;
+			stat->bytes += node->tx[i].byte_cnt;
+			stat->busy += (double)node->tx[i].busy / (double)SEC;
+			stat->drops += node->tx[i].drop_cnt;
+		}
+	}
+
+	return 0;
+}
+
+void chime_server_stop_at(double time, uint64_t events)
+{
+	server.sim.stop_clk = (time > 0) ? (uint64_t)(time * SEC) : 0;
+	server.sim.stop_evt = events;
 }
 
 void chime_server_info(FILE * f)
@@ -2015,10 +3266,60 @@ void chime_server_info(FILE * f)
 		chime_server_resume();
 };
 
+void chime_server_cpu_prof(FILE * f, int max)
+{
+	struct chime_node * lst[CHIME_NODE_MAX + 1];
+	bool paused = server.sim.paused;
+	int cnt;
+	int i;
+	int j;
+
+	if (!paused)
+		chime_server_pause();
+
+	/* sort the nodes by load, worst first */
+	cnt = 0;
+	for (i = 1; i <= LIST_LEN(server.node_idx); ++i) {
+		struct chime_node * node = server.node[server.node_idx[i]];
+		double load;
+
+		if (node == NULL)
+			continue;
+
+		load = __node_prof_load(node);
+		for (j = cnt; (j > 0) && (__node_prof_load(lst[j - 1]) < load); --j)
+			lst[j] = lst[j - 1];
+		lst[j] = node;
+		cnt++;
+	}
+
+	if ((max > 0) && (max < cnt))
+		cnt = max;
+
+	fprintf(f, "---------------------------------------------------\n");
+	fprintf(f, " ID                CPU     events  sim time(s)"
+			"   run(s)  wait(s) load(ms/s)\n");
+	for (i = 0; i < cnt; ++i) {
+		struct chime_node * node = lst[i];
+
+		fprintf(f, "%3d %18s %10u %12.3f %8.3f %8.3f %10.4f\n",
+				node->id, node->name, node->prof.evt_cnt,
+				node->prof.cycles * node->period,
+				(double)node->prof.run_ns / 1e9,
+				(double)node->prof.wait_ns / 1e9,
+				__node_prof_load(node) * 1000);
+	}
+	fprintf(f, "---------------------------------------------------\n");
+	fflush(f);
+
+	if (!paused)
+		chime_server_resume();
+}
+
 int chime_server_start(const char * name)
 {
 	struct timeval tv;
-	uint32_t period_ms;
+	uint32_t period_us;
 	int ret = -1;
 	int i;
 
@@ -2051,7 +3352,7 @@ int chime_server_start(const char * name)
 		/* Initial simulation speed (real time) */
 		server.tmr.ack = 0;
 		server.tmr.req = 0;
-		server.tmr.period = 10 * MSEC;
+		server.tmr.period = CHIME_TMR_PERIOD_US * USEC;
 		server.tmr.tick_cnt = 0;
 		/* initialize simulation at 1x speed */
 		server.sim.period = server.tmr.period;
@@ -2060,6 +3361,16 @@ int chime_server_start(const char * name)
 		server.sim.tick_lost = 0;
 		server.sim.paused = false;
 		server.sim.checkout_cnt = 0;
+		server.sim.lookahead = UINT64_MAX;
+		server.sim.temp_cnt = 0;
+		server.sim.evt_cnt = 0;
+		server.sim.step_cnt = 0;
+		server.sim.heap_sum = 0;
+		server.sim.heap_smpl = 0;
+		server.sim.heap_peak = 0;
+		server.sim.stop_clk = 0;
+		server.sim.stop_evt = 0;
+		server.sim.hold_clk = 0;
 		/* set initial session id.
 		  The session id is incremented on each reset.
 		  It's used to synchronize nodes.
@@ -2089,6 +3400,19 @@ int chime_server_start(const char * name)
 				break;
 			}
 
+			INF("creating object directory...");
+			if (__dir_create(name) < 0) {
+				ERR("__dir_create() failed.");
+				break;
+			}
+
+			INF("creating live state page...");
+			if (__live_create(name) < 0) {
+				ERR("__live_create() failed.");
+				break;
+			}
+			server.live.pg = __live_page();
+
 			INF("allocating server shared structure...");
 			server.shared = obj_alloc();
 			/* Sanity check ... */
@@ -2096,7 +3420,6 @@ int chime_server_start(const char * name)
 			/* the first object must be 1 */
 			assert(server.shared_oid == SRV_SHARED_OID);
 			/* initialize shared structure */
-			__dir_lst_clear(&server.shared->dir);
 			server.shared->magic = SRV_SHARED_MAGIC;
 			server.shared->time = 0;
 
@@ -2130,9 +3453,9 @@ int chime_server_start(const char * name)
 				ERR("__mq_open(\"%s\") failed: %s.", name, __strerr());
 				break;;
 			}
-			period_ms = TS2MSEC(server.tmr.period);
-			INF("period=%d ms.", period_ms);
-			if (__itmr_init(period_ms, __sim_timer_isr) < 0) {
+			period_us = TS2USEC(server.tmr.period);
+			INF("period=%d us.", period_us);
+			if (__itmr_init(period_us, __sim_timer_isr) < 0) {
 				ERR("__itmr_init() failed!");
 				break;
 			}
@@ -2180,6 +3503,11 @@ int chime_server_stop(void)
 
 		__mq_unlink(server.mqname);
 
+		__dir_close();
+		__dir_destroy();
+
+		__live_destroy();
+
 		objpool_close();
 		objpool_destroy();
 
@@ -27,56 +27,115 @@ void chime_msleep(unsigned int ms)
 }
 
 /* Should be called from the main(). This will
- initialize signals, and signal handlers. 
- Alert: The application cannot use SIGALRM as the interval timer 
- depends on it to work. */
+ initialize signals, and signal handlers. */
 void chime_app_init(void (* on_cleanup)(void))
 {       
 	__term_sig_handler(on_cleanup);
 }
 
-#define DIR_LIST_MAX 127
+#define AFFINITY_CORE_MAX 1024
 
-void __dir_lst_clear(struct dir_lst * lst)
+static struct {
+	int policy;
+	int ctrl_core;
+	int nodes; /* number of NUMA nodes */
+	int cnt; /* cores available for CPU threads */
+	uint32_t seq; /* CPU threads placed so far */
+	uint8_t node[AFFINITY_CORE_MAX];
+	uint16_t core[AFFINITY_CORE_MAX];
+} affinity;
+
+int chime_affinity_set(int policy, int ctrl_core)
 {
-	DBG1("lst->cnt=%d.", lst->cnt);
-	lst->cnt = 0;
+	uint8_t node[AFFINITY_CORE_MAX];
+	uint16_t core[AFFINITY_CORE_MAX];
+	int n;
+	int i;
+
+	if ((policy < CHIME_AFFINITY_NONE) || (policy > CHIME_AFFINITY_PACKED)) {
+		ERR("invalid policy: %d.", policy);
+		return -1;
+	}
+
+	n = __numa_cores(node, core, AFFINITY_CORE_MAX);
+
+	/* keep the dispatcher core for itself */
+	affinity.cnt = 0;
+	affinity.nodes = 0;
+	for (i = 0; i < n; ++i) {
+		if (core[i] == ctrl_core)
+			continue;
+		if ((affinity.cnt == 0) || 
+			(node[i] != affinity.node[affinity.cnt - 1]))
+			affinity.nodes++;
+		affinity.node[affinity.cnt] = node[i];
+		affinity.core[affinity.cnt] = core[i];
+		affinity.cnt++;
+	}
+
+	if (affinity.cnt == 0) {
+		ERR("no cores left for the CPUs!");
+		return -1;
+	}
+
+	affinity.policy = policy;
+	affinity.ctrl_core = ctrl_core;
+	affinity.seq = 0;
+
+	DBG1("policy=%d ctrl_core=%d cores=%d nodes=%d", policy, ctrl_core,
+		 affinity.cnt, affinity.nodes);
+
+	return 0;
 }
 
-uint16_t __dir_lst_lookup(struct dir_lst * lst, const char * name) 
+/* Get the core for the n-th CPU thread */
+static int __affinity_cpu_core(uint32_t n)
 {
-	int oid = OID_NULL;
+	int node;
+	int pos;
 	int i;
 
-	DBG1("cnt=%d name=%s", lst->cnt, name);
+	if (affinity.policy == CHIME_AFFINITY_PACKED)
+		return affinity.core[n % affinity.cnt];
 
-	for (i = 0; i < lst->cnt; ++i) {
-		oid = lst->entry[i].oid;
-		DBG1("%2d - name=\"%s\" OID=%d", i, lst->entry[i].name, oid);
-		if (oid == OID_NULL)
-			break;
-		if (strcmp(name, lst->entry[i].name) == 0)
-			break;
-		oid = OID_NULL;
+	/* round robin: n-th NUMA node (in order), then n-th core on it */
+	node = n % affinity.nodes;
+	pos = n / affinity.nodes;
+	for (i = 0; node > 0; ++i) {
+		if (affinity.node[i + 1] != affinity.node[i])
+			node--;
 	}
+	for (n = i; (n < affinity.cnt) && 
+		 (affinity.node[n] == affinity.node[i]); ++n);
 
-	return oid;
+	return affinity.core[i + pos % (n - i)];
 }
 
-bool __dir_lst_insert(struct dir_lst * lst, const char * name, int oid) 
+/* Apply the placement policy to the calling thread. */
+void __thread_placement(bool ctrl)
 {
-	int i;
+	int core;
 
-	if ((i = lst->cnt) >= DIR_LIST_MAX)
-		return false;
+	if (affinity.policy == CHIME_AFFINITY_NONE)
+		return;
 
-	lst->entry[i].oid = oid;
-	strcpy(lst->entry[i].name, name);
-	lst->cnt++;
+	if (ctrl) {
+		if ((core = affinity.ctrl_core) < 0)
+			return;
+	} else {
+		core = __affinity_cpu_core(__sync_fetch_and_add(&affinity.seq, 1));
+	}
 
-	DBG1("%2d - name=\"%s\" OID=%d", i, lst->entry[i].name, lst->entry[i].oid);
+	DBG1("%s thread on core %d.", ctrl ? "CTRL" : "CPU", core);
 
-	return true;
+	if (__thread_affinity_set(core) != 0)
+		WARN("can't set thread affinity to core %d.", core);
+}
+
+/* Select the IPC transport, see <chime.h> */
+int chime_transport_set(const char * name)
+{
+	return __mq_transport_set(name);
 }
 
 /*****************************************************************************
@@ -19,6 +19,8 @@ extern "C" {
 
 struct mempool * mempool_alloc(size_t nmemb, size_t size);
 
+void mempool_free(struct mempool * pool);
+
 void * memblk_alloc(struct mempool * pool);
 
 bool memblk_free(struct mempool * pool, void * ptr);
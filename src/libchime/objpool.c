@@ -66,6 +66,7 @@ static struct  {
 	__mutex_t mutex;
 	__shm_t shm;
 	struct objpool * pool;
+	int ref; /* opened by the server and the client in one process */
 } obj_mgr;
 
 
@@ -418,6 +419,7 @@ int objpool_create(const char * name, size_t nmemb)
 	DBG1("obj_mgr.pool=%p size=%d", obj_mgr.pool, (int)size);
 
 	objpool_init(obj_mgr.pool, nmemb);
+	obj_mgr.ref = 1;
 
 	return 0;
 }
@@ -425,6 +427,12 @@ int objpool_create(const char * name, size_t nmemb)
 /* Open an existing named object pool. */
 int objpool_open(const char * name)
 {
+	if ((obj_mgr.ref > 0) && (strcmp(obj_mgr.name, name) == 0)) {
+		/* already mapped in this process */
+		obj_mgr.ref++;
+		return 0;
+	}
+
 	strcpy(obj_mgr.name, name);
 
 	if (__mutex_open(&obj_mgr.mutex, obj_mgr.name) < 0) {
@@ -442,11 +450,16 @@ int objpool_open(const char * name)
 		return -1;
 	}
 
+	obj_mgr.ref = 1;
+
 	return 0;
 }
 
 void objpool_close(void)
 {
+	if (--obj_mgr.ref > 0)
+		return;
+
 	__shm_munmap(obj_mgr.shm, obj_mgr.pool);
 	obj_mgr.pool = NULL;
 
@@ -0,0 +1,199 @@
+/*
+ * @file	tmr-wheel.c
+ * @brief	Hierarchical timing wheel
+ * @author	Robinson Mittmann (bobmittmann@gmail.com)
+ *
+ */
+
+/*
+   The clock is divided in slots of 2^WHEEL_SLOT_SHIFT. A timer is
+   placed at the lowest level whose current rotation window holds
+   its slot, every level being WHEEL_SLOTS times coarser than the
+   one below. When the wheel reaches a coarse slot its timers are
+   cascaded to the lower levels. Insert and remove are O(1), finding
+   the next slot is O(WHEEL_LEVELS) with the occupancy bitmaps.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#define __TMR_WHEEL__
+#include "tmr-wheel.h"
+
+#define __SHIFT(L) ((L) * WHEEL_LEVEL_BITS)
+#define __IDX(T, L) (((T) >> __SHIFT(L)) & (WHEEL_SLOTS - 1))
+/* first slot of the level L window holding T */
+#define __WIN(T, L) (((T) >> __SHIFT((L) + 1)) << __SHIFT((L) + 1))
+
+static inline void __link(struct wheel_tmr ** head, struct wheel_tmr * e)
+{
+	if ((e->next = *head) != NULL)
+		e->next->pprev = &e->next;
+	*head = e;
+	e->pprev = head;
+}
+
+static inline void __unlink(struct wheel_tmr * e)
+{
+	if ((*e->pprev = e->next) != NULL)
+		e->next->pprev = e->pprev;
+	e->pprev = NULL;
+}
+
+bool wheel_insert(struct tmr_wheel * w, struct wheel_tmr * e)
+{
+	uint64_t t = e->clk >> WHEEL_SLOT_SHIFT;
+	int lvl;
+	int idx;
+
+	/* if (t <= w->t) */
+	if ((int64_t)(t - w->t) <= 0)
+		return false;
+
+	for (lvl = 0; lvl < WHEEL_LEVELS; ++lvl) {
+		if (__WIN(t, lvl) == __WIN(w->t, lvl))
+			break;
+	}
+
+	e->lvl = lvl;
+	if (lvl == WHEEL_LEVELS) {
+		e->idx = 0;
+		__link(&w->ovf, e);
+	} else {
+		idx = __IDX(t, lvl);
+		e->idx = idx;
+		__link(&w->slot[lvl][idx], e);
+		w->bmp[lvl] |= 1ULL << idx;
+	}
+
+	w->cnt++;
+
+	return true;
+}
+
+void wheel_remove(struct tmr_wheel * w, struct wheel_tmr * e)
+{
+	if (e->pprev == NULL)
+		return;
+
+	__unlink(e);
+	w->cnt--;
+
+	if ((e->lvl < WHEEL_LEVELS) && (w->slot[e->lvl][e->idx] == NULL))
+		w->bmp[e->lvl] &= ~(1ULL << e->idx);
+}
+
+static bool __next_slot(struct tmr_wheel * w, uint64_t * slot)
+{
+	uint64_t min = 0;
+	bool found = false;
+	int lvl;
+
+	if (w->cnt == 0)
+		return false;
+
+	for (lvl = 0; lvl < WHEEL_LEVELS; ++lvl) {
+		unsigned int cur = __IDX(w->t, lvl);
+		uint64_t msk;
+		uint64_t t;
+
+		/* the current slot of every level is always empty */
+		if (cur == WHEEL_SLOTS - 1)
+			continue;
+		if ((msk = w->bmp[lvl] & (~0ULL << (cur + 1))) == 0)
+			continue;
+
+		t = __WIN(w->t, lvl) |
+			((uint64_t)__builtin_ctzll(msk) << __SHIFT(lvl));
+		if (!found || (t < min))
+			min = t;
+		found = true;
+	}
+
+	if (w->ovf != NULL) {
+		uint64_t t = __WIN(w->t, WHEEL_LEVELS - 1) +
+			(1ULL << __SHIFT(WHEEL_LEVELS));
+		if (!found || (t < min))
+			min = t;
+		found = true;
+	}
+
+	*slot = min;
+
+	return found;
+}
+
+bool wheel_next(struct tmr_wheel * w, uint64_t * clk)
+{
+	uint64_t slot;
+
+	if (!__next_slot(w, &slot))
+		return false;
+
+	*clk = slot << WHEEL_SLOT_SHIFT;
+
+	return true;
+}
+
+void wheel_sync(struct tmr_wheel * w, uint64_t clk)
+{
+	uint64_t t = clk >> WHEEL_SLOT_SHIFT;
+	uint64_t next;
+
+	if (__next_slot(w, &next) && ((int64_t)(t - next) >= 0))
+		t = next - 1;
+
+	/* if (t > w->t) */
+	if ((int64_t)(t - w->t) > 0)
+		w->t = t;
+}
+
+int wheel_advance(struct tmr_wheel * w, uint64_t clk,
+				  void (* expire)(struct wheel_tmr *, void *), void * arg)
+{
+	uint64_t t = clk >> WHEEL_SLOT_SHIFT;
+	struct wheel_tmr * lst;
+	struct wheel_tmr * e;
+	int lvl;
+	int idx;
+	int n = 0;
+
+	/* a new overflow window */
+	lst = (__WIN(t, WHEEL_LEVELS - 1) != __WIN(w->t, WHEEL_LEVELS - 1)) ?
+		w->ovf : NULL;
+	if (lst != NULL)
+		w->ovf = NULL;
+
+	w->t = t;
+
+	/* cascade from the top */
+	for (lvl = WHEEL_LEVELS; lvl >= 0; --lvl) {
+		if (lvl < WHEEL_LEVELS) {
+			idx = __IDX(t, lvl);
+			lst = w->slot[lvl][idx];
+			w->slot[lvl][idx] = NULL;
+			w->bmp[lvl] &= ~(1ULL << idx);
+		}
+
+		while ((e = lst) != NULL) {
+			lst = e->next;
+			e->pprev = NULL;
+			w->cnt--;
+			if (!wheel_insert(w, e)) {
+				expire(e, arg);
+				n++;
+			}
+		}
+	}
+
+	return n;
+}
+
+void wheel_init(struct tmr_wheel * w, uint64_t clk)
+{
+	memset(w, 0, sizeof(struct tmr_wheel));
+	w->t = clk >> WHEEL_SLOT_SHIFT;
+}
+
@@ -0,0 +1,69 @@
+/*****************************************************************************
+ * Hierarchical timing wheel (private) header file
+ *****************************************************************************/
+
+#ifndef __TMR_WHEEL_H__
+#define __TMR_WHEEL_H__
+
+#ifndef __TMR_WHEEL__
+#error "Never use <tmr-wheel.h> directly; include <chime-i.h> instead."
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Level 0 slot width: 2^30 fs (~1.07us) */
+#define WHEEL_SLOT_SHIFT 30
+#define WHEEL_LEVEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_LEVEL_BITS)
+/* 5 levels span 2^60 fs (~19 minutes), farther timers overflow */
+#define WHEEL_LEVELS 5
+
+struct wheel_tmr {
+	struct wheel_tmr * next;
+	struct wheel_tmr ** pprev;
+	uint64_t clk; /* expiration clock */
+	uint8_t lvl; /* WHEEL_LEVELS for the overflow list */
+	uint8_t idx;
+};
+
+struct tmr_wheel {
+	uint64_t t; /* current slot */
+	unsigned int cnt; /* timers in the wheel */
+	uint64_t bmp[WHEEL_LEVELS]; /* non empty slots */
+	struct wheel_tmr * slot[WHEEL_LEVELS][WHEEL_SLOTS];
+	struct wheel_tmr * ovf; /* overflow list */
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void wheel_init(struct tmr_wheel * w, uint64_t clk);
+
+/* Insert a timer. Returns false if the timer is due in the current
+   slot, it is not inserted and the caller must handle it. */
+bool wheel_insert(struct tmr_wheel * w, struct wheel_tmr * e);
+
+void wheel_remove(struct tmr_wheel * w, struct wheel_tmr * e);
+
+/* Get the clock of the next slot to be processed.
+   Returns false if the wheel is empty. */
+bool wheel_next(struct tmr_wheel * w, uint64_t * clk);
+
+/* Move the current slot up to 'clk' without processing,
+   never past the next slot with timers. */
+void wheel_sync(struct tmr_wheel * w, uint64_t clk);
+
+/* Process the next slot, 'clk' must be the one returned by
+   wheel_next(). The due timers are removed and passed to 'expire'.
+   Returns the number of expired timers. */
+int wheel_advance(struct tmr_wheel * w, uint64_t clk,
+				  void (* expire)(struct wheel_tmr *, void *), void * arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __TMR_WHEEL_H__ */
+
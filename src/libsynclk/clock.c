@@ -25,12 +25,6 @@
 #include "debug.h"
 #include "clock.h"
 
-#ifndef CLOCK_DRIFT_MAX
-//#define CLOCK_DRIFT_MAX FLOAT_Q31(0.000200)
-/* FIXME: change the max drift to 200ppm */
-#define CLOCK_DRIFT_MAX FLOAT_Q31(0.000500)
-#endif
-
 /****************************************************************************
  * Clock
  ****************************************************************************/
@@ -237,4 +231,48 @@ void clock_init(uint32_t tick_itvl, unsigned int hw_tmr)
 	}
 }
 
+/****************************************************************************
+ * Structure of arrays clock
+ ****************************************************************************/
+
+/* Initialize 'n' lanes, all ticking at the same 'tick_itvl' */
+void clock_soa_init(struct clock_soa * clk, int n, uint32_t tick_itvl)
+{
+	float freq_hz;
+	int i;
+
+	assert(n <= CLOCK_SOA_MAX);
+
+	freq_hz = 1.0 / CLK_FLOAT(tick_itvl);
+
+	clk->n = n;
+	clk->resolution = tick_itvl;
+	clk->n_freq = freq_hz;
+	clk->q_freq = FLOAT_Q31(freq_hz - clk->n_freq);
+	clk->tmr_fk = freq_hz / HW_TMR_FREQ_HZ;
+
+	for (i = 0; i < n; ++i) {
+		clk->ts[i] = 0;
+		clk->offset[i] = 0;
+		clk->increment[i] = tick_itvl;
+		clk->drift_comp[i] = 0;
+	}
+}
+
+/* Update the time of all lanes. Returns a mask of the lanes
+   that crossed a second boundary. */
+uint64_t clock_soa_tick(struct clock_soa * clk)
+{
+	uint64_t pps = 0;
+	uint64_t ts;
+	int i;
+
+	for (i = 0; i < clk->n; ++i) {
+		ts = clk->ts[i] + clk->increment[i];
+		pps |= (uint64_t)(((ts ^ clk->ts[i]) >> 32) != 0) << i;
+		clk->ts[i] = ts;
+	}
+
+	return pps;
+}
 
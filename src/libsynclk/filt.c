@@ -144,6 +144,7 @@ int64_t filt_receive(struct clock_filt * filt,
 			WARN("spike!!");
 			/* set the spike flag */
 			filt->spike = true;
+			filt->stat.spike++;
 			/* do not update the clock */
 			ret = CLK_OFFS_INVALID;
 		}	
@@ -177,6 +178,7 @@ int64_t filt_receive(struct clock_filt * filt,
 			if (Q31_MUL(dx, dx) > (4 * filt->variance)) {
 				/* do not update the clock */
 				ret = CLK_OFFS_INVALID;
+				filt->stat.drop++;
 				chime_var_rec(filt_avg_var, 1.9);
 			}
 		}
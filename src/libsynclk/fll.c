@@ -49,6 +49,14 @@ __thread int fll_err_var;
 #define FLL_KP 128 /* Attack gain */
 #define FLL_KD 256 /* Decay gain */
 
+/* Default coefficients */
+const struct fll_coef fll_coef_default = {
+	.kp = FLL_KP,
+	.kd = FLL_KD,
+	.edge_win = FLL_EDGE_FILTER_WIN_MIN,
+	.calc_win = FLL_FREQ_CALC_MIN_WIN
+};
+
 static void __fll_clear(struct clock_fll  * fll)
 {
 	fll->run = false;
@@ -76,6 +84,7 @@ static void __fll_stat_clear(struct clock_fll  * fll)
  */
 void fll_step(struct clock_fll  * fll, uint64_t ref_ts, int64_t offs)
 {
+	const struct fll_coef * c = fll->coef;
 	int64_t clk_dt;
 	int64_t rtc_dt;
 	int32_t drift;
@@ -116,8 +125,8 @@ void fll_step(struct clock_fll  * fll, uint64_t ref_ts, int64_t offs)
 		if (fll->edge_filt) {
 			if (offs < 0) { /* invalid edge detected  */
 				/* extend the window */
-				fll->edge_jit += FLL_EDGE_FILTER_WIN_MIN - fll->edge_filt;
-				fll->edge_filt = FLL_EDGE_FILTER_WIN_MIN; 
+				fll->edge_jit += c->edge_win - fll->edge_filt;
+				fll->edge_filt = c->edge_win; 
 				break;
 			}
 			if (--fll->edge_filt == 0) {
@@ -148,7 +157,7 @@ void fll_step(struct clock_fll  * fll, uint64_t ref_ts, int64_t offs)
 
 		/* Enable edge filter window to avoid detecting 
 		   a second transition right after the first one. */
-		fll->edge_filt = FLL_EDGE_FILTER_WIN_MIN;
+		fll->edge_filt = c->edge_win;
 		fll->edge_jit  = 0;
 
 		/* set the residual error to to be compensated by stepping
@@ -181,7 +190,7 @@ void fll_step(struct clock_fll  * fll, uint64_t ref_ts, int64_t offs)
 
 		if (!fll->lock) {
 			/* minimum window for initial frequency adjustment */
-			if (clk_dt < FLOAT_CLK(FLL_FREQ_CALC_MIN_WIN))
+			if (clk_dt < FLOAT_CLK(c->calc_win))
 				break;
 			DBG("FLL locked at %s!", FMT_CLK(ref_ts));
 			fll->lock = true;
@@ -226,8 +235,8 @@ void fll_step(struct clock_fll  * fll, uint64_t ref_ts, int64_t offs)
 		int32_t de;
 		int32_t drift;
 
-		fll->clk_err[0] = fll->clk_err[0] - fll->clk_err[0] / FLL_KD;
-		de = (fll->clk_err[1] - fll->clk_err[0]) / FLL_KP;
+		fll->clk_err[0] = fll->clk_err[0] - fll->clk_err[0] / c->kd;
+		de = (fll->clk_err[1] - fll->clk_err[0]) / c->kp;
 		/* adjust the clock */
 		drift = clock_drift_comp(fll->clk_drift + de, fll->clk_err[1]);
 		de = drift - fll->clk_drift;
@@ -248,6 +257,7 @@ void fll_reset(struct clock_fll  * fll, uint64_t ref_ts)
 
 void fll_init(struct clock_fll  * fll, int64_t err_max)
 {
+	fll->coef = &fll_coef_default;
 	fll->err_max = err_max;
 	__fll_clear(fll);
 	__fll_stat_clear(fll);
@@ -260,3 +270,10 @@ void fll_init(struct clock_fll  * fll, int64_t err_max)
 	}
 }
 
+/* Change the FLL coefficients, NULL selects the defaults.
+   The structure is not copied, it must stay valid. */
+void fll_coef_set(struct clock_fll  * fll, const struct fll_coef * coef)
+{
+	fll->coef = (coef == NULL) ? &fll_coef_default : coef;
+}
+
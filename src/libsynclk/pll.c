@@ -104,20 +104,41 @@ __thread int de_var;
 #define PLL_B2 FLOAT_Q31(0.0022516/PLL_A0)
 #endif
 
+#define PLL_KD 4
+#define PLL_KP 8
+#define PLL_KI 512
+
+/* Default coefficients */
+const struct pll_coef pll_coef_default = {
+	.a = PLL_A,
+	.b = PLL_B,
+	.a0 = PLL_A0,
+	.a1 = PLL_A1,
+	.a2 = PLL_A2,
+	.b0 = PLL_B0,
+	.b1 = PLL_B1,
+	.b2 = PLL_B2,
+	.kd = PLL_KD,
+	.kp = PLL_KP,
+	.ki = PLL_KI
+};
+
 #if ENABLE_PLL_LOW_PASS
-static int32_t iir_apply(int32_t x[], int32_t y[], int32_t v) 
+static int32_t iir_apply(const struct pll_coef * c, 
+						 int32_t x[], int32_t y[], int32_t v) 
 {
 	/* Shift the old samples */
 	x[1] = x[0];
 	y[1] = y[0];
 	/* Calculate the new output */
 	x[0] = v;
-	y[0] = Q31_MUL(PLL_B, x[0] + x[1]) - Q31_MUL(PLL_A, y[1]);
+	y[0] = Q31_MUL(c->b, x[0] + x[1]) - Q31_MUL(c->a, y[1]);
 	return y[0];
 }
 
 #if ENABLE_PLL_LOW_PASS2
-int32_t iir2_apply(int32_t x[], int32_t y[], int32_t v)
+int32_t iir2_apply(const struct pll_coef * c, 
+				   int32_t x[], int32_t y[], int32_t v)
 {
 	int64_t y0;
 
@@ -128,11 +149,11 @@ int32_t iir2_apply(int32_t x[], int32_t y[], int32_t v)
 	y[1] = y[0];
 	/* Calculate the new output */
 	x[0] = v;
-	y0 = Q31_MUL(PLL_B0, x[0]);
-	y0 += Q31_MUL(PLL_B1, x[1]) - Q31_MUL(PLL_A1, y[1]);
-	y0 += Q31_MUL(PLL_B2, x[2]) - Q31_MUL(PLL_A2, y[2]);
+	y0 = Q31_MUL(c->b0, x[0]);
+	y0 += Q31_MUL(c->b1, x[1]) - Q31_MUL(c->a1, y[1]);
+	y0 += Q31_MUL(c->b2, x[2]) - Q31_MUL(c->a2, y[2]);
 	/* Scale and Truncate... */
-	y[0] = PLL_A0 * y0;
+	y[0] = c->a0 * y0;
 
 	return y[0];
 }
@@ -150,6 +171,7 @@ static void __pll_clear(struct clock_pll  * pll)
 	pll->drift = 0;
 	pll->offs = 0;
 	pll->ref = 0;
+	pll->ierr = 0;
 
 #if ENABLE_PLL_LOW_PASS
 	/* IIR order filer */
@@ -165,25 +187,22 @@ static void __pll_stat_clear(struct clock_pll  * pll)
 	pll->stat.step_cnt = 0;
 }
 
-#define PLL_KD 4
-#define PLL_KP 8
-#define PLL_KI 512
-
 /*
  * PLL control algorithm
  * This function should be called periodically once a second.
  */
 void pll_step(struct clock_pll  * pll)
 {
+	const struct pll_coef * c = pll->coef;
 	int32_t ierr;
 	int32_t err;
 
-	pll->ref = pll->ref - pll->ref / PLL_KD;
-	err = (pll->offs - pll->ref) / PLL_KP;
+	pll->ref = pll->ref - pll->ref / c->kd;
+	err = (pll->offs - pll->ref) / c->kp;
 	pll->offs -= err;
 
 	/* integral term */
-	ierr = pll->ierr + err / PLL_KI;
+	ierr = pll->ierr + err / c->ki;
 	pll->ierr = ierr;
 
 	pll->drift = clock_drift_comp(ierr + err, err);
@@ -217,8 +236,8 @@ void pll_phase_adjust(struct clock_pll  * pll, int64_t offs, int64_t itvl)
 
 	x = CLK_Q31(offs);
 #if ENABLE_PLL_LOW_PASS
-	x = iir_apply(pll->iir.x, pll->iir.y, x);
-//	x = iir2_apply(pll->iir.x, pll->iir.y, offs);
+	x = iir_apply(pll->coef, pll->iir.x, pll->iir.y, x);
+//	x = iir2_apply(pll->coef, pll->iir.x, pll->iir.y, offs);
 #endif
 	pll->offs = x;
 	pll->ref = x;
@@ -242,6 +261,7 @@ void pll_reset(struct clock_pll  * pll)
  */
 void pll_init(struct clock_pll  * pll)
 {
+	pll->coef = &pll_coef_default;
 
 	__pll_clear(pll);
 	__pll_stat_clear(pll);
@@ -251,3 +271,169 @@ void pll_init(struct clock_pll  * pll)
 	pll_err_var = chime_var_open("pll_err");
 }
 
+/* 
+ * Change the PLL coefficients, NULL selects the defaults.
+ * The structure is not copied, it must stay valid.
+ */
+void pll_coef_set(struct clock_pll  * pll, const struct pll_coef * coef)
+{
+	pll->coef = (coef == NULL) ? &pll_coef_default : coef;
+}
+
+/****************************************************************************
+ * Structure of arrays PLL
+ ****************************************************************************/
+
+/* Signed division by 2^s, truncating towards zero like '/' does */
+static inline int32_t __div_pow2(int32_t x, int32_t s)
+{
+	return (x + ((x >> 31) & ((1 << s) - 1))) >> s;
+}
+
+/* Lane select, 'm' is either 0 or -1 */
+static inline int32_t __sel(int32_t m, int32_t x, int32_t y)
+{
+	return (x & m) | (y & ~m);
+}
+
+static int __gain_shift(int32_t k)
+{
+	int s;
+
+	if ((k <= 0) || (k & (k - 1)))
+		return -1;
+
+	for (s = 0; (1 << s) != k; ++s);
+
+	return s;
+}
+
+/* 
+ * Set the coefficients of lane 'i', NULL selects the defaults.
+ * Returns -1 if a loop gain is not a power of two.
+ */
+int pll_soa_coef_set(struct clock_pll_soa * pll, int i, 
+					 const struct pll_coef * coef)
+{
+	const struct pll_coef * c = (coef == NULL) ? &pll_coef_default : coef;
+	int kd_s = __gain_shift(c->kd);
+	int kp_s = __gain_shift(c->kp);
+	int ki_s = __gain_shift(c->ki);
+
+	if ((kd_s < 0) || (kp_s < 0) || (ki_s < 0)) {
+		WARN("lane %d: gains must be powers of two", i);
+		return -1;
+	}
+
+	pll->a[i] = c->a;
+	pll->b[i] = c->b;
+	pll->kd_s[i] = kd_s;
+	pll->kp_s[i] = kp_s;
+	pll->ki_s[i] = ki_s;
+
+	return 0;
+}
+
+/* 
+ * Initialize 'n' lanes with the default coefficients
+ */
+void pll_soa_init(struct clock_pll_soa * pll, int n)
+{
+	int i;
+
+	assert(n <= CLOCK_SOA_MAX);
+
+	pll->n = n;
+	for (i = 0; i < n; ++i) {
+		pll->drift[i] = 0;
+		pll->ref[i] = 0;
+		pll->offs[i] = 0;
+		pll->ierr[i] = 0;
+		pll->x1[i] = 0;
+		pll->y1[i] = 0;
+		pll->step_cnt[i] = 0;
+		pll_soa_coef_set(pll, i, NULL);
+	}
+}
+
+/*
+ * Same as pll_step() for the lanes set in 'mask'.
+ * The other lanes are computed and discarded, so the loop has no 
+ * branches.
+ */
+void pll_soa_step(struct clock_pll_soa * pll, struct clock_soa * clk, 
+				  uint64_t mask)
+{
+	int32_t m[CLOCK_SOA_MAX] __attribute__((aligned(32)));
+	int32_t d[CLOCK_SOA_MAX] __attribute__((aligned(32)));
+	int n = pll->n;
+	int i;
+
+	for (i = 0; i < n; ++i)
+		m[i] = -(int32_t)((mask >> i) & 1);
+
+	for (i = 0; i < n; ++i) {
+		int32_t ref;
+		int32_t err;
+		int32_t ierr;
+
+		ref = pll->ref[i] - __div_pow2(pll->ref[i], pll->kd_s[i]);
+		err = __div_pow2(pll->offs[i] - ref, pll->kp_s[i]);
+		ierr = pll->ierr[i] + __div_pow2(err, pll->ki_s[i]);
+
+		pll->ref[i] = __sel(m[i], ref, pll->ref[i]);
+		pll->offs[i] = __sel(m[i], pll->offs[i] - err, pll->offs[i]);
+		pll->ierr[i] = __sel(m[i], ierr, pll->ierr[i]);
+		d[i] = ierr + err;
+	}
+
+	for (i = 0; i < n; ++i) {
+		if (m[i])
+			pll->drift[i] = clock_soa_drift_comp(clk, i, d[i]);
+	}
+}
+
+/*
+ * Same as pll_phase_adjust() for the lanes set in 'mask'.
+ */
+void pll_soa_phase_adjust(struct clock_pll_soa * pll, struct clock_soa * clk,
+						  const int64_t offs[], uint64_t mask)
+{
+	int32_t m[CLOCK_SOA_MAX] __attribute__((aligned(32)));
+	int32_t v[CLOCK_SOA_MAX] __attribute__((aligned(32)));
+	int n = pll->n;
+	int i;
+
+	/* steps are rare, handle them apart */
+	for (i = 0; i < n; ++i) {
+		if (!((mask >> i) & 1))
+			continue;
+		if ((offs[i] >= PLL_OFFS_MAX) || (offs[i] <= -PLL_OFFS_MAX)) {
+			pll->offs[i] = 0;
+			pll->ref[i] = 0;
+			clock_soa_step(clk, i, offs[i]);
+			pll->step_cnt[i]++;
+			mask &= ~(1ULL << i);
+		}
+	}
+
+	for (i = 0; i < n; ++i) {
+		m[i] = -(int32_t)((mask >> i) & 1);
+		v[i] = CLK_Q31(offs[i]);
+	}
+
+	for (i = 0; i < n; ++i) {
+		int32_t x = v[i];
+#if ENABLE_PLL_LOW_PASS
+		int32_t y;
+
+		y = Q31_MUL(pll->b[i], x + pll->x1[i]) - 
+			Q31_MUL(pll->a[i], pll->y1[i]);
+		pll->x1[i] = __sel(m[i], v[i], pll->x1[i]);
+		pll->y1[i] = __sel(m[i], y, pll->y1[i]);
+		x = y;
+#endif
+		pll->offs[i] = __sel(m[i], x, pll->offs[i]);
+		pll->ref[i] = __sel(m[i], x, pll->ref[i]);
+	}
+}
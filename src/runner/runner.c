@@ -0,0 +1,569 @@
+/*
+   runner.c
+   Headless simulation scenario runner
+   Copyright(C) 2013 Robinson Mittmann.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+   Runs the server and the CPUs described by a scenario file in a
+   single process, with no console, until a simulation time or
+   event count limit is reached. Then the variable recorders are
+   flushed and a throughput report is printed.
+
+   Scenario file, one directive per line, '#' starts a comment:
+
+     speed max | <times>
+     time <seconds>          stop at this simulation time
+     events <count>          stop after this many events
+     seed <n>                seed for the ppm spread
+     executor <workers>      run the CPUs over a pool of threads
+     comm <name> [speed=<bps>] [bytes=<max>] [nodes=<max>]
+          [jitter=<sec>] [delay=<sec>] [node_delay=<sec>]
+          [txbuf] [dcd] [exp] [token[=<bits>]] [ack=<bits>]
+     cpu <count> <entry> [lib=<path.so>] [ppm=<offs>] [tc=<ppm>]
+          [spread=<ppm>] [period=<cycles>] [dst=<addr>]
+
+   'token' selects the server token passing MAC, passing the token
+   takes <bits> (default 39, an ARCnet ITT frame) and 'ack' adds the
+   handshake after each frame.
+
+   The CPU entry point is looked up in the shared library if one is
+   given, otherwise it must be one of the built-in firmwares:
+
+     idle   - attach to the first COMM and wait
+     beacon - attach to the first COMM and transmit a 16 bytes frame
+              every 'period' CPU cycles, to the 'dst' address or
+              to everyone (dst=0)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <assert.h>
+#include <inttypes.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#ifndef _WIN32
+#include <dlfcn.h>
+#endif
+
+#include "chime.h"
+
+#define VERSION_MAJOR 0
+#define VERSION_MINOR 1
+
+#define SCN_LINE_MAX 256
+#define SCN_COMM_MAX 16
+#define SCN_CPU_MAX 256
+
+struct scenario {
+	float speed;
+	double time_max;
+	uint64_t evt_max;
+	unsigned int seed;
+	int workers;
+	int comm_cnt;
+	int cpu_cnt;
+	char comm[SCN_COMM_MAX][32];
+};
+
+static struct scenario scn = {
+	.speed = 1000000, /* as fast as the server allows */
+	.time_max = 0,
+	.evt_max = 0,
+	.seed = 1,
+	.workers = 0,
+	.comm_cnt = 0,
+	.cpu_cnt = 0
+};
+
+static bool verbose = false;
+
+/****************************************************************************
+ * Built-in firmwares
+ ****************************************************************************/
+
+/* Options of the built-in firmwares, per CPU group. The table is 
+   indexed by CPU id, the server hands the ids out in join order 
+   starting at 1. */
+struct fw_param {
+	uint32_t period;
+	int dst;
+};
+
+static struct fw_param fw_param[SCN_CPU_MAX + 1];
+
+static void fw_rcv_isr(void)
+{
+	uint8_t buf[256];
+
+	chime_comm_read(0, buf, sizeof(buf));
+}
+
+static void fw_idle(void)
+{
+	if (scn.comm_cnt > 0)
+		chime_comm_attach(0, scn.comm[0], fw_rcv_isr, NULL, NULL);
+
+	for (;;)
+		chime_cpu_wait();
+}
+
+static void fw_beacon(void)
+{
+	struct fw_param * param = &fw_param[chime_cpu_id()];
+	uint8_t frm[16];
+
+	assert(scn.comm_cnt > 0);
+
+	chime_comm_attach(0, scn.comm[0], fw_rcv_isr, NULL, NULL);
+	memset(frm, chime_cpu_id(), sizeof(frm));
+
+	for (;;) {
+		chime_cpu_step(param->period);
+		chime_comm_write_to(0, param->dst, frm, sizeof(frm));
+	}
+}
+
+static const struct {
+	const char * name;
+	void (* entry)(void);
+} fw_builtin[] = {
+	{ "idle", fw_idle },
+	{ "beacon", fw_beacon },
+	{ NULL, NULL }
+};
+
+/****************************************************************************
+ * Scenario
+ ****************************************************************************/
+
+/* Match a "key=value" option. Flags without value match "key". */
+static bool opt_match(const char * tok, const char * key, const char ** val)
+{
+	size_t n = strlen(key);
+
+	if (strncmp(tok, key, n) != 0)
+		return false;
+
+	if (tok[n] == '=') {
+		*val = &tok[n + 1];
+		return true;
+	}
+
+	if (tok[n] == '\0') {
+		*val = NULL;
+		return true;
+	}
+
+	return false;
+}
+
+static void * fw_lookup(const char * name, const char * lib)
+{
+	int i;
+
+	if (lib != NULL) {
+#ifdef _WIN32
+		fprintf(stderr, "shared libraries are not supported!\n");
+		return NULL;
+#else
+		void * hdl;
+		void * sym;
+
+		if ((hdl = dlopen(lib, RTLD_NOW | RTLD_GLOBAL)) == NULL) {
+			fprintf(stderr, "dlopen(): %s\n", dlerror());
+			return NULL;
+		}
+
+		if ((sym = dlsym(hdl, name)) == NULL)
+			fprintf(stderr, "dlsym(): %s\n", dlerror());
+
+		return sym;
+#endif
+	}
+
+	for (i = 0; fw_builtin[i].name != NULL; ++i) {
+		if (strcmp(fw_builtin[i].name, name) == 0)
+			return fw_builtin[i].entry;
+	}
+
+	fprintf(stderr, "unknown firmware: \"%s\"\n", name);
+	return NULL;
+}
+
+static int scn_comm(char * name, char * opt)
+{
+	struct comm_attr attr = {
+		.wr_cyc_per_byte = 0,
+		.wr_cyc_overhead = 0,
+		.rd_cyc_per_byte = 0,
+		.rd_cyc_overhead = 0,
+		.bits_overhead = 6,
+		.bits_per_byte = 11,
+		.nodes_max = 63,
+		.bytes_max = 256,
+		.speed_bps = 2500000,
+		.max_jitter = 0,
+		.min_delay = 0,
+		.nod_delay = 0,
+		.hist_en = false,
+		.txbuf_en = false,
+		.dcd_en = false,
+		.exp_en = false,
+		.mac = COMM_MAC_RANDOM,
+		.tok_bits = 39,
+		.ack_bits = 0
+	};
+	const char * val;
+	char * tok;
+
+	for (tok = strtok(opt, " \t\n"); tok; tok = strtok(NULL, " \t\n")) {
+		if (opt_match(tok, "speed", &val) && val)
+			attr.speed_bps = strtof(val, NULL);
+		else if (opt_match(tok, "bytes", &val) && val)
+			attr.bytes_max = strtoul(val, NULL, 0);
+		else if (opt_match(tok, "nodes", &val) && val)
+			attr.nodes_max = strtoul(val, NULL, 0);
+		else if (opt_match(tok, "jitter", &val) && val)
+			attr.max_jitter = strtof(val, NULL);
+		else if (opt_match(tok, "delay", &val) && val)
+			attr.min_delay = strtof(val, NULL);
+		else if (opt_match(tok, "node_delay", &val) && val)
+			attr.nod_delay = strtof(val, NULL);
+		else if (opt_match(tok, "txbuf", &val))
+			attr.txbuf_en = true;
+		else if (opt_match(tok, "dcd", &val))
+			attr.dcd_en = true;
+		else if (opt_match(tok, "exp", &val))
+			attr.exp_en = true;
+		else if (opt_match(tok, "token", &val)) {
+			attr.mac = COMM_MAC_TOKEN;
+			if (val)
+				attr.tok_bits = strtoul(val, NULL, 0);
+		} else if (opt_match(tok, "ack", &val) && val)
+			attr.ack_bits = strtoul(val, NULL, 0);
+		else {
+			fprintf(stderr, "invalid COMM option: \"%s\"\n", tok);
+			return -1;
+		}
+	}
+
+	if (scn.comm_cnt == SCN_COMM_MAX) {
+		fprintf(stderr, "too many COMMs!\n");
+		return -1;
+	}
+
+	if (chime_comm_create(name, &attr) < 0) {
+		fprintf(stderr, "chime_comm_create(\"%s\") failed!\n", name);
+		return -1;
+	}
+
+	strncpy(scn.comm[scn.comm_cnt++], name, 31);
+
+	return 0;
+}
+
+static int scn_cpu(int cnt, char * entry, char * opt)
+{
+	struct fw_param param = {
+		.period = 10000,
+		.dst = COMM_ADDR_BCAST
+	};
+	const char * lib = NULL;
+	const char * val;
+	void (* on_reset)(void);
+	float spread = 0;
+	float ppm = 0;
+	float tc = 0;
+	char * tok;
+	int i;
+
+	for (tok = strtok(opt, " \t\n"); tok; tok = strtok(NULL, " \t\n")) {
+		if (opt_match(tok, "lib", &val) && val)
+			lib = val;
+		else if (opt_match(tok, "ppm", &val) && val)
+			ppm = strtof(val, NULL);
+		else if (opt_match(tok, "tc", &val) && val)
+			tc = strtof(val, NULL);
+		else if (opt_match(tok, "spread", &val) && val)
+			spread = strtof(val, NULL);
+		else if (opt_match(tok, "period", &val) && val)
+			param.period = strtoul(val, NULL, 0);
+		else if (opt_match(tok, "dst", &val) && val)
+			param.dst = strtoul(val, NULL, 0);
+		else {
+			fprintf(stderr, "invalid CPU option: \"%s\"\n", tok);
+			return -1;
+		}
+	}
+
+	if ((on_reset = (void (*)(void))fw_lookup(entry, lib)) == NULL)
+		return -1;
+
+	for (i = 0; i < cnt; ++i) {
+		float offs = ppm;
+
+		if (scn.cpu_cnt == SCN_CPU_MAX) {
+			fprintf(stderr, "too many CPUs!\n");
+			return -1;
+		}
+
+		fw_param[scn.cpu_cnt + 1] = param;
+
+		if (spread > 0)
+			offs += spread * (2.0 * rand() / RAND_MAX - 1.0);
+
+		if (chime_cpu_create(offs, tc, on_reset) < 0) {
+			fprintf(stderr, "chime_cpu_create() failed!\n");
+			return -1;
+		}
+
+		scn.cpu_cnt++;
+	}
+
+	return 0;
+}
+
+static int scn_load(const char * path)
+{
+	char line[SCN_LINE_MAX];
+	FILE * f;
+	int ln = 0;
+	int ret = 0;
+
+	if ((f = fopen(path, "r")) == NULL) {
+		fprintf(stderr, "fopen(\"%s\"): %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	while ((ret == 0) && (fgets(line, sizeof(line), f) != NULL)) {
+		char cmd[32];
+		char arg[64];
+		char * cp;
+		int n;
+
+		ln++;
+
+		if ((cp = strchr(line, '#')) != NULL)
+			*cp = '\0';
+
+		if (sscanf(line, "%31s %63s %n", cmd, arg, &n) < 2)
+			continue;
+
+		cp = &line[n];
+
+		if (strcmp(cmd, "speed") == 0) {
+			scn.speed = (strcmp(arg, "max") == 0) ? 1000000 :
+				strtof(arg, NULL);
+		} else if (strcmp(cmd, "time") == 0) {
+			scn.time_max = strtod(arg, NULL);
+		} else if (strcmp(cmd, "events") == 0) {
+			scn.evt_max = strtoull(arg, NULL, 0);
+		} else if (strcmp(cmd, "seed") == 0) {
+			scn.seed = strtoul(arg, NULL, 0);
+			srand(scn.seed);
+		} else if (strcmp(cmd, "executor") == 0) {
+			/* must be set before the first CPU is created */
+			if (chime_executor_set(strtol(arg, NULL, 0)) < 0)
+				ret = -1;
+		} else if (strcmp(cmd, "comm") == 0) {
+			ret = scn_comm(arg, cp);
+		} else if (strcmp(cmd, "cpu") == 0) {
+			char entry[64];
+
+			if (sscanf(cp, "%63s %n", entry, &n) < 1) {
+				ret = -1;
+			} else {
+				ret = scn_cpu(strtol(arg, NULL, 0), entry, &cp[n]);
+			}
+		} else {
+			ret = -1;
+		}
+
+		if (ret < 0)
+			fprintf(stderr, "%s:%d: invalid directive.\n", path, ln);
+	}
+
+	fclose(f);
+
+	return ret;
+}
+
+/****************************************************************************
+ * Main
+ ****************************************************************************/
+
+static double wall_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void trace_drain(void)
+{
+	struct trace_entry * trc;
+
+	while ((trc = chime_trace_get()) != NULL) {
+		if (verbose)
+			chime_trace_dump(trc);
+		chime_trace_free(trc);
+	}
+}
+
+static void show_usage(const char * prog)
+{
+	fprintf(stderr, "Usage: %s [-v] [-n NAME] [-t SEC] [-e EVENTS] "
+			"SCENARIO\n", prog);
+	fprintf(stderr, "  -v         dump the CPUs' trace messages\n");
+	fprintf(stderr, "  -n NAME    simulation name (default: runner)\n");
+	fprintf(stderr, "  -t SEC     stop at this simulation time\n");
+	fprintf(stderr, "  -e EVENTS  stop after this many events\n");
+	fprintf(stderr, "\n");
+}
+
+void system_cleanup(void)
+{
+	chime_client_stop();
+	chime_server_stop();
+}
+
+int main(int argc, char *argv[])
+{
+	const char * name = "runner";
+	struct chime_sim_stat stat;
+	struct rusage ru;
+	double time_max = 0;
+	uint64_t evt_max = 0;
+	double t0;
+	double wall;
+	int c;
+	int i;
+
+	while ((c = getopt(argc, argv, "vn:t:e:h")) > 0) {
+		switch (c) {
+		case 'v':
+			verbose = true;
+			break;
+		case 'n':
+			name = optarg;
+			break;
+		case 't':
+			time_max = strtod(optarg, NULL);
+			break;
+		case 'e':
+			evt_max = strtoull(optarg, NULL, 0);
+			break;
+		default:
+			show_usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (optind != argc - 1) {
+		show_usage(argv[0]);
+		return 1;
+	}
+
+	chime_app_init(system_cleanup);
+
+	if (chime_server_start(name) < 0) {
+		fprintf(stderr, "chime_server_start() failed!\n");
+		return 2;
+	}
+
+	if (chime_client_start(name) < 0) {
+		fprintf(stderr, "chime_client_start() failed!\n");
+		chime_server_stop();
+		return 2;
+	}
+
+	if (scn_load(argv[optind]) < 0) {
+		system_cleanup();
+		return 3;
+	}
+
+	/* command line limits override the scenario */
+	if (time_max > 0)
+		scn.time_max = time_max;
+	if (evt_max > 0)
+		scn.evt_max = evt_max;
+
+	if ((scn.time_max <= 0) && (scn.evt_max == 0)) {
+		fprintf(stderr, "no time or event limit!\n");
+		system_cleanup();
+		return 3;
+	}
+
+	/* the server holds the simulation when a limit is reached */
+	chime_server_stop_at(scn.time_max, scn.evt_max);
+	chime_server_speed_set(scn.speed);
+	chime_reset_all();
+
+	t0 = wall_time();
+
+	do {
+		chime_msleep(10);
+		trace_drain();
+		chime_server_stat(&stat);
+	} while (!stat.paused);
+
+	wall = wall_time() - t0;
+	trace_drain();
+
+	/* flush the variable recorders */
+	if (chime_server_var_dump() < 0)
+		fprintf(stderr, "variables dump failed!\n");
+
+	getrusage(RUSAGE_SELF, &ru);
+
+	printf("cpus=%d\n", scn.cpu_cnt);
+	printf("comms=%d\n", scn.comm_cnt);
+	printf("events=%" PRIu64 "\n", stat.evt_cnt);
+	printf("steps=%u\n", stat.step_cnt);
+	printf("sim_time=%.6f\n", stat.time);
+	printf("wall_time=%.6f\n", wall);
+	printf("events_per_sec=%.1f\n", stat.evt_cnt / wall);
+	printf("sim_per_wall=%.3f\n", stat.time / wall);
+	printf("peak_rss_kb=%ld\n", ru.ru_maxrss);
+	for (i = 0; i < scn.comm_cnt; ++i) {
+		struct chime_comm_stat cs;
+
+		if (chime_comm_stat(scn.comm[i], &cs) < 0)
+			continue;
+		printf("comm.%s.frames=%" PRIu64 "\n", scn.comm[i], cs.frames);
+		printf("comm.%s.bytes=%" PRIu64 "\n", scn.comm[i], cs.bytes);
+		printf("comm.%s.busy=%.6f\n", scn.comm[i], cs.busy);
+		printf("comm.%s.util=%.3f\n", scn.comm[i], cs.util);
+		printf("comm.%s.util_peak=%.3f\n", scn.comm[i], cs.util_peak);
+		printf("comm.%s.inflight_max=%u\n", scn.comm[i], cs.inflight_max);
+		printf("comm.%s.drops=%u\n", scn.comm[i], cs.drops);
+	}
+	fflush(stdout);
+
+	system_cleanup();
+
+	return 0;
+}
+
@@ -0,0 +1,355 @@
+/*
+   sim-benchmark.c
+   Simulator end-to-end scaling benchmark
+   Copyright(C) 2013 Robinson Mittmann.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+   For each CPU count of the sweep a child process starts a server and
+   the synthetic CPUs, runs the simulation for a fixed simulated time as
+   fast as possible and prints one CSV line:
+
+     cpus,sim_time,wall_time,events,events_per_sec,steps_per_sim_sec,
+     heap_avg,heap_peak,cpu_util
+
+   cpu_util is the process CPU time over the wall time of all the
+   host processors, in percent.
+
+   Each synthetic CPU runs periodic timers, burns cycles with
+   chime_cpu_step() and periodically broadcasts a frame on one of the
+   COMMs.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include "chime.h"
+
+#define SWEEP_MAX 32
+
+/* Synthetic firmware parameters, shared by all CPUs */
+static struct {
+	int comm_cnt;
+	int tmr_cnt;
+	uint32_t tmr_period; /* microseconds */
+	uint32_t step_cycles;
+	double wr_period; /* seconds */
+	int frm_len;
+} fw = {
+	.comm_cnt = 1,
+	.tmr_cnt = 1,
+	.tmr_period = 1000,
+	.step_cycles = 1000,
+	.wr_period = 0.010,
+	.frm_len = 16
+};
+
+static double sim_time = 2.0;
+static float sim_speed = 1000000;
+static const char * transport = NULL;
+
+/* ---------------------------------------------------------------------------
+   Synthetic firmware
+   -------------------------------------------------------------------------- */
+
+static void fw_tmr_isr(void)
+{
+}
+
+static void fw_rcv_isr(void)
+{
+	uint8_t buf[256];
+
+	chime_comm_read(0, buf, sizeof(buf));
+}
+
+static void fw_reset(void)
+{
+	uint8_t frm[256];
+	char name[32];
+	double next_wr;
+	int i;
+
+	sprintf(name, "BUS%d", chime_cpu_id() % fw.comm_cnt);
+	chime_comm_attach(0, name, fw_rcv_isr, NULL, NULL);
+
+	/* spread the timers phase across the CPUs */
+	for (i = 0; i < fw.tmr_cnt; ++i)
+		chime_tmr_init(i, fw_tmr_isr, fw.tmr_period +
+					   (chime_cpu_id() * 37) % fw.tmr_period,
+					   fw.tmr_period);
+
+	memset(frm, chime_cpu_id(), sizeof(frm));
+	next_wr = fw.wr_period * (chime_cpu_id() % 16) / 16;
+
+	for (;;) {
+		if (fw.step_cycles > 0)
+			chime_cpu_step(fw.step_cycles);
+		else
+			chime_cpu_wait();
+
+		if ((fw.wr_period > 0) && (chime_cpu_time() >= next_wr)) {
+			chime_comm_write(0, frm, fw.frm_len);
+			next_wr += fw.wr_period;
+		}
+	}
+}
+
+/* ---------------------------------------------------------------------------
+   Benchmark
+   -------------------------------------------------------------------------- */
+
+static double wall_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double cpu_time(void)
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+
+	return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 +
+		ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+}
+
+static void trace_drain(void)
+{
+	struct trace_entry * trc;
+
+	while ((trc = chime_trace_get()) != NULL)
+		chime_trace_free(trc);
+}
+
+static void cleanup(void)
+{
+	chime_client_stop();
+	chime_server_stop();
+}
+
+static int run(int cpus)
+{
+	struct comm_attr attr = {
+		.wr_cyc_per_byte = 0,
+		.wr_cyc_overhead = 0,
+		.rd_cyc_per_byte = 0,
+		.rd_cyc_overhead = 0,
+		.bits_overhead = 6,
+		.bits_per_byte = 11,
+		.nodes_max = 255,
+		.bytes_max = 256,
+		.speed_bps = 2500000,
+		.max_jitter = 0,
+		.min_delay = 0.0001,
+		.nod_delay = 0,
+		.hist_en = false,
+		.txbuf_en = false,
+		.dcd_en = false,
+		.exp_en = false
+	};
+	struct chime_sim_stat stat;
+	char name[32];
+	double wall;
+	double cpu;
+	int i;
+
+	if ((transport != NULL) && (chime_transport_set(transport) < 0))
+		return 1;
+
+	sprintf(name, "sim-bm.%d", getpid());
+	chime_app_init(cleanup);
+
+	if (chime_server_start(name) < 0) {
+		fprintf(stderr, "chime_server_start() failed!\n");
+		return 2;
+	}
+
+	if (chime_client_start(name) < 0) {
+		fprintf(stderr, "chime_client_start() failed!\n");
+		chime_server_stop();
+		return 2;
+	}
+
+	for (i = 0; i < fw.comm_cnt; ++i) {
+		sprintf(name, "BUS%d", i);
+		if (chime_comm_create(name, &attr) < 0) {
+			fprintf(stderr, "chime_comm_create() failed!\n");
+			cleanup();
+			return 3;
+		}
+	}
+
+	srand(1);
+	for (i = 0; i < cpus; ++i) {
+		float ppm = 100.0 * (2.0 * rand() / RAND_MAX - 1.0);
+
+		if (chime_cpu_create(ppm, 0, fw_reset) < 0) {
+			fprintf(stderr, "chime_cpu_create() failed!\n");
+			cleanup();
+			return 3;
+		}
+	}
+
+	chime_server_stop_at(sim_time, 0);
+	chime_server_speed_set(sim_speed);
+	chime_reset_all();
+
+	wall = wall_time();
+	cpu = cpu_time();
+
+	do {
+		chime_msleep(10);
+		trace_drain();
+		chime_server_stat(&stat);
+	} while (!stat.paused);
+
+	wall = wall_time() - wall;
+	cpu = cpu_time() - cpu;
+
+	printf("%d,%.3f,%.3f,%" PRIu64 ",%.1f,%.1f,%.2f,%u,%.1f\n",
+		   cpus, stat.time, wall, stat.evt_cnt, stat.evt_cnt / wall,
+		   (stat.time > 0) ? stat.step_cnt / stat.time : 0,
+		   stat.heap_avg, stat.heap_peak,
+		   100.0 * cpu / (wall * sysconf(_SC_NPROCESSORS_ONLN)));
+	fflush(stdout);
+
+	cleanup();
+
+	return 0;
+}
+
+static void show_usage(const char * prog)
+{
+	fprintf(stderr, "Usage: %s [OPTION...]\n", prog);
+	fprintf(stderr, "  -n LIST    CPU counts (default 2,4,8,16,32,64,128,255)\n");
+	fprintf(stderr, "  -T SEC     simulated time per run (default 2)\n");
+	fprintf(stderr, "  -S SPEED   simulation speed (default max)\n");
+	fprintf(stderr, "  -c COMMS   number of COMMs (default 1)\n");
+	fprintf(stderr, "  -t TIMERS  timers per CPU, 0..8 (default 1)\n");
+	fprintf(stderr, "  -p USEC    timer period (default 1000)\n");
+	fprintf(stderr, "  -s CYCLES  cycles per chime_cpu_step(), 0 to wait "
+			"(default 1000)\n");
+	fprintf(stderr, "  -w MSEC    broadcast period, 0 to disable "
+			"(default 10)\n");
+	fprintf(stderr, "  -l LEN     broadcast frame length (default 16)\n");
+	fprintf(stderr, "  -x NAME    event transport (mq, unix)\n");
+	fprintf(stderr, "\n");
+}
+
+int main(int argc, char *argv[])
+{
+	int sweep[SWEEP_MAX] = { 2, 4, 8, 16, 32, 64, 128, 255 };
+	int sweep_cnt = 8;
+	char * tok;
+	int status;
+	int pid;
+	int ret = 0;
+	int c;
+	int i;
+
+	while ((c = getopt(argc, argv, "n:T:S:c:t:p:s:w:l:x:h")) > 0) {
+		switch (c) {
+		case 'n':
+			sweep_cnt = 0;
+			for (tok = strtok(optarg, ","); tok && sweep_cnt < SWEEP_MAX;
+				 tok = strtok(NULL, ","))
+				sweep[sweep_cnt++] = strtoul(tok, NULL, 0);
+			break;
+		case 'T':
+			sim_time = strtod(optarg, NULL);
+			break;
+		case 'S':
+			sim_speed = (strcmp(optarg, "max") == 0) ? 1000000 :
+				strtof(optarg, NULL);
+			break;
+		case 'c':
+			fw.comm_cnt = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			fw.tmr_cnt = strtoul(optarg, NULL, 0);
+			break;
+		case 'p':
+			fw.tmr_period = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			fw.step_cycles = strtoul(optarg, NULL, 0);
+			break;
+		case 'w':
+			fw.wr_period = strtod(optarg, NULL) / 1000.0;
+			break;
+		case 'l':
+			fw.frm_len = strtoul(optarg, NULL, 0);
+			break;
+		case 'x':
+			transport = optarg;
+			break;
+		default:
+			show_usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if ((sim_time <= 0) || (fw.comm_cnt < 1) || (fw.tmr_cnt > 8) ||
+		(fw.tmr_period == 0) || (fw.frm_len < 1) || (fw.frm_len > 256)) {
+		show_usage(argv[0]);
+		return 1;
+	}
+
+	for (i = 0; i < sweep_cnt; ++i) {
+		if ((sweep[i] < 1) || (sweep[i] > 255)) {
+			fprintf(stderr, "invalid CPU count: %d\n", sweep[i]);
+			return 1;
+		}
+	}
+
+	printf("cpus,sim_time,wall_time,events,events_per_sec,"
+		   "steps_per_sim_sec,heap_avg,heap_peak,cpu_util\n");
+	fflush(stdout);
+
+	/* one process per run, the server and client state is global */
+	for (i = 0; i < sweep_cnt; ++i) {
+		if ((pid = fork()) < 0) {
+			fprintf(stderr, "fork() failed!\n");
+			return 2;
+		}
+
+		if (pid == 0)
+			exit(run(sweep[i]));
+
+		waitpid(pid, &status, 0);
+		if (!WIFEXITED(status) || (WEXITSTATUS(status) != 0)) {
+			fprintf(stderr, "run with %d CPUs failed!\n", sweep[i]);
+			ret = 2;
+		}
+	}
+
+	return ret;
+}
+
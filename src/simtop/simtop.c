@@ -0,0 +1,326 @@
+/*
+   simtop.c
+   Live monitor for a running simulation
+   Copyright(C) 2013 Robinson Mittmann.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+   Attaches to the live state page of a running server (see
+   chime_live_open()) and refreshes a top like dashboard. No requests
+   are sent to the server, the simulation is never paused.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <time.h>
+#include <stdarg.h>
+
+#include "chime.h"
+#include "console.h"
+
+#define VERSION_MAJOR 0
+#define VERSION_MINOR 1
+
+#define NODE_ROWS_MAX 64
+
+static struct {
+	const char * name;
+	unsigned int period_ms;
+	int node_rows;
+	int batch; /* plain text snapshots, no console */
+	volatile bool quit;
+	int lines; /* lines drawn in the last refresh */
+	/* previous sample */
+	bool valid;
+	uint64_t wall_ns;
+	uint64_t evt_cnt;
+	uint32_t step_cnt;
+	uint64_t frm_cnt[CHIME_LIVE_COMM_MAX];
+	uint32_t node_evt[CHIME_LIVE_NODE_MAX];
+} top = {
+	.name = "chronos",
+	.period_ms = 1000,
+	.node_rows = 10,
+	.batch = 0,
+};
+
+static struct chime_live live;
+
+static inline uint64_t clock_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* print a line, clearing what was left there by the last refresh */
+static void line(const char * fmt, ...)
+	__attribute__ ((format (printf, 1, 2)));
+
+static void line(const char * fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	vprintf(fmt, ap);
+	va_end(ap);
+
+	if (top.batch == 0)
+		printf(VT100_CLREOL);
+	printf("\n");
+	top.lines++;
+}
+
+static const char * state_nm(int state)
+{
+	switch (state) {
+	case CHIME_NODE_WAIT:
+		return "wait";
+	case CHIME_NODE_RUN:
+		return "run";
+	}
+	return "-";
+}
+
+static void top_draw(void)
+{
+	struct chime_live_node * lst[CHIME_LIVE_NODE_MAX];
+	uint64_t now = clock_ns();
+	double dt;
+	int lines;
+	int cnt;
+	int i;
+	int j;
+
+	if (chime_live_read(&live) < 0) {
+		/* the page was left half updated */
+		lines = top.lines;
+		top.lines = 0;
+		if (top.batch == 0)
+			printf(VT100_HOME);
+		line(" simtop %d.%d - server \"%s\" gone", VERSION_MAJOR,
+			 VERSION_MINOR, top.name);
+		if (top.batch == 0) {
+			for (i = top.lines; i < lines; ++i)
+				printf(VT100_CLREOL "\n");
+		} else {
+			printf("\n");
+		}
+		fflush(stdout);
+		top.valid = false;
+		return;
+	}
+
+	dt = top.valid ? (double)(now - top.wall_ns) / 1e9 : 0;
+
+	lines = top.lines;
+	top.lines = 0;
+
+	if (top.batch == 0)
+		printf(VT100_HOME);
+
+	/* Title */
+	if (top.batch == 0)
+		printf(VT100_ATTR_FG_YELLOW VT100_ATTR_BG_BLUE);
+	line(" simtop %d.%d - server \"%s\"", VERSION_MAJOR, VERSION_MINOR,
+		 top.name);
+	if (top.batch == 0)
+		printf(VT100_ATTR_OFF);
+
+	line(" time: %.6fs  speed: x%.3f (set x%.3f)", live.time,
+		 live.speed, live.speed_set);
+
+	if (live.paused) {
+		line(" PAUSED");
+	} else if (top.valid && (live.evt_cnt == top.evt_cnt)) {
+		line(" STALLED: no events since the last refresh");
+	} else if ((live.speed_set > 0) && (live.speed < live.speed_set * 0.9)) {
+		if (top.batch == 0)
+			printf(VT100_ATTR_FG_RED);
+		line(" SLUGGISH: %.0f%% of the requested speed, %u ticks lost",
+			 100.0 * live.speed / live.speed_set, live.tick_lost);
+		if (top.batch == 0)
+			printf(VT100_ATTR_OFF);
+	} else {
+		line(" running");
+	}
+
+	line(" events: %" PRIu64 " (%.0f/s)  steps: %u (%.0f/s)",
+		 live.evt_cnt, (dt > 0) ? (live.evt_cnt - top.evt_cnt) / dt : 0,
+		 live.step_cnt, (dt > 0) ? (live.step_cnt - top.step_cnt) / dt : 0);
+	line(" heap: %u (peak %u)  pool: %u/%u objects (%.1f%%)",
+		 live.heap_len, live.heap_peak, live.pool_alloc, live.pool_size,
+		 (live.pool_size > 0) ? 100.0 * live.pool_alloc / live.pool_size : 0);
+	line("%s", "");
+
+	/* COMMs */
+	line(" %-20s %7s %7s %10s %8s", "COMM", "util%", "peak%",
+		 "frames/s", "drops");
+	for (i = 0; i < live.comm_cnt; ++i) {
+		struct chime_live_comm * comm = &live.comm[i];
+		double fps;
+
+		fps = (dt > 0) ? (comm->frm_cnt - top.frm_cnt[i]) / dt : 0;
+		line(" %-20s %7.2f %7.2f %10.1f %8u", comm->name, comm->util,
+			 comm->util_peak, fps, comm->drop_cnt);
+		top.frm_cnt[i] = comm->frm_cnt;
+	}
+	line("%s", "");
+
+	/* sort the nodes by load, worst first */
+	cnt = 0;
+	for (i = 0; i < live.node_cnt; ++i) {
+		struct chime_live_node * node = &live.node[i];
+
+		for (j = cnt; (j > 0) && (lst[j - 1]->load < node->load); --j)
+			lst[j] = lst[j - 1];
+		lst[j] = node;
+		cnt++;
+	}
+
+	line(" %3s %-20s %5s %6s %12s %9s %10s", "ID", "CPU", "state",
+		 "temp", "time(s)", "events/s", "load(ms/s)");
+	for (i = 0; (i < cnt) && (i < top.node_rows); ++i) {
+		struct chime_live_node * node = lst[i];
+		double eps;
+
+		eps = (dt > 0) ? (node->evt_cnt - top.node_evt[node->id]) / dt : 0;
+		line(" %3d %-20s %5s %6.1f %12.3f %9.0f %10.4f", node->id,
+			 node->name, state_nm(node->state), node->temperature,
+			 node->time, eps, node->load * 1000);
+	}
+	for (i = 0; i < cnt; ++i)
+		top.node_evt[lst[i]->id] = lst[i]->evt_cnt;
+
+	line(" %d CPUs, %d COMMs", live.node_cnt, live.comm_cnt);
+
+	/* clear what is left from the last refresh */
+	if (top.batch == 0) {
+		for (i = top.lines; i < lines; ++i)
+			printf(VT100_CLREOL "\n");
+	} else {
+		printf("\n");
+	}
+	fflush(stdout);
+
+	top.wall_ns = now;
+	top.evt_cnt = live.evt_cnt;
+	top.step_cnt = live.step_cnt;
+	top.valid = true;
+}
+
+static void * top_task(void * arg)
+{
+	while (!top.quit) {
+		console_lock();
+		top_draw();
+		console_unlock();
+		usleep(top.period_ms * 1000);
+	}
+
+	return NULL;
+}
+
+static void show_usage(const char * prog)
+{
+	fprintf(stderr, "Usage: %s [-s NAME] [-d MS] [-n ROWS] [-b COUNT]\n",
+			prog);
+	fprintf(stderr, "  -s NAME     server name (default chronos)\n");
+	fprintf(stderr, "  -d MS       refresh period in milliseconds "
+			"(default 1000)\n");
+	fprintf(stderr, "  -n ROWS     slowest CPUs to show (default 10)\n");
+	fprintf(stderr, "  -b COUNT    print COUNT plain text snapshots and exit\n");
+	fprintf(stderr, "\n");
+}
+
+int main(int argc, char *argv[])
+{
+	pthread_t thread;
+	int c;
+	int i;
+
+	while ((c = getopt(argc, argv, "s:d:n:b:h")) > 0) {
+		switch (c) {
+		case 's':
+			top.name = optarg;
+			break;
+		case 'd':
+			top.period_ms = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			top.node_rows = strtoul(optarg, NULL, 0);
+			break;
+		case 'b':
+			top.batch = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			show_usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if ((top.period_ms < 100) || (top.node_rows < 1) ||
+		(top.node_rows > NODE_ROWS_MAX)) {
+		show_usage(argv[0]);
+		return 1;
+	}
+
+	if (chime_live_open(top.name) < 0) {
+		fprintf(stderr, "no server \"%s\" running!\n", top.name);
+		return 2;
+	}
+
+	if (top.batch > 0) {
+		for (i = 0; i < top.batch; ++i) {
+			if (i > 0)
+				usleep(top.period_ms * 1000);
+			top_draw();
+		}
+		chime_live_close();
+		return 0;
+	}
+
+	console_open();
+	clrscr();
+
+	if (pthread_create(&thread, NULL, top_task, NULL) != 0) {
+		fprintf(stderr, "pthread_create() failed!\n");
+		console_close();
+		chime_live_close();
+		return 3;
+	}
+
+	do {
+		c = readkey();
+	} while ((c >= 0) && (c != 'q'));
+
+	top.quit = true;
+	pthread_join(thread, NULL);
+
+	console_close();
+	chime_live_close();
+
+	return 0;
+}
+
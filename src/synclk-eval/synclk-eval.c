@@ -0,0 +1,951 @@
+/*
+   synclk-eval.c
+   Offline batch evaluator for the libsynclk filters and loops
+   Copyright(C) 2013 Robinson Mittmann.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+   Runs the libsynclk code without the simulator. Each instance models
+   one node: a local oscillator with a frequency error, the clock tick
+   timer and, depending on the loop:
+
+   - pll: the slave. Time packets arrive every poll interval and go
+     through filt_receive() and pll_phase_adjust(), pll_step() runs on
+     every second, as in slave.c. The packet timestamp error comes from
+     a synthetic generator (gaussian jitter plus spikes) or from a
+     recorded file.
+
+   - fll: the master. An ideal RTC is polled on every clock tick and
+     fll_step() runs on every RTC second edge, as in master.c.
+
+   The clock error against the true time is sampled on every second.
+   For each instance and coefficient set one CSV line is printed:
+
+     id,loop,coef,ppm,jitter,spike_p,seed,samples,lock_time,err_rms_us,
+     err_max_us,spikes,drops,steps
+
+   lock_time is the first second after which the error stays within
+   the tolerance until the end (-1 if it never does). err_rms_us and
+   err_max_us are taken over the last quarter of the run. spikes,
+   drops and steps are the filter and loop statistics.
+
+   The loop coefficients are swept with -K NAME=LIST, the cartesian
+   product of the lists gives the coefficient sets, listed as comments
+   before the header. coef is the index of the set.
+
+   libsynclk keeps the local clock in a global, so the instances run
+   one at a time in each of the worker processes. With more than one
+   coefficient set the PLL instances run instead all the sets at once,
+   one lane each of the structure of arrays clock and PLL, sharing the
+   oscillator and the packet noise. This needs power of two gains,
+   otherwise, or with -S, the sets run one at a time as well.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/wait.h>
+
+#include "synclk.h"
+
+#define LIST_MAX 32
+#define JOBS_MAX 64
+#define COEF_MAX CLOCK_SOA_MAX
+
+#define LOOP_PLL 0
+#define LOOP_FLL 1
+
+/* slave.c */
+#define REMOTE_PRECISION (FLOAT_CLK(0.005))
+#define SLAVE_CLOCK_FREQ_HZ 8
+
+/* master.c */
+#define RTC_NOMINAL_POLL_FREQ_HZ 8
+#define RTC_POLL_SHIFT_PPM 250
+#define RTC_POLL_FREQ_HZ  (RTC_NOMINAL_POLL_FREQ_HZ *  \
+						   (1.0 - 0.000001 * RTC_POLL_SHIFT_PPM))
+#define FLL_ERR_MAX FLOAT_CLK(2.0 / RTC_NOMINAL_POLL_FREQ_HZ)
+#define RTC_OFFS_MAX FLOAT_CLK(2.0 / RTC_NOMINAL_POLL_FREQ_HZ)
+
+static const char * const loop_nm[] = { "pll", "fll" };
+
+static struct {
+	int loop;
+	double sim_time; /* seconds */
+	double drift; /* ppm per hour */
+	double spike_mag; /* seconds */
+	double poll; /* PLL packet interval (seconds) */
+	double init_offs; /* seconds */
+	double delay; /* network delay (seconds) */
+	double tol; /* lock tolerance (seconds) */
+	int seeds;
+	int jobs;
+	bool soa; /* run the coefficient sets as PLL lanes */
+} cfg = {
+	.loop = LOOP_PLL,
+	.sim_time = 43200,
+	.drift = 0,
+	.spike_mag = 0.2,
+	.poll = SYNCLK_POLL,
+	.init_offs = 1.0,
+	.delay = 0.001,
+	.tol = 0.001,
+	.seeds = 1,
+	.jobs = 0,
+	.soa = true
+};
+
+/* loop coefficients, -K option names */
+enum {
+	K_A,
+	K_B,
+	K_KD,
+	K_KP,
+	K_KI,
+	K_EDGE,
+	K_WIN,
+	K_CNT
+};
+
+static const struct {
+	const char * nm;
+	uint8_t loop_msk;
+} k_def[K_CNT] = {
+	[K_A] = { "a", 1 << LOOP_PLL },
+	[K_B] = { "b", 1 << LOOP_PLL },
+	[K_KD] = { "kd", (1 << LOOP_PLL) | (1 << LOOP_FLL) },
+	[K_KP] = { "kp", (1 << LOOP_PLL) | (1 << LOOP_FLL) },
+	[K_KI] = { "ki", 1 << LOOP_PLL },
+	[K_EDGE] = { "edge", 1 << LOOP_FLL },
+	[K_WIN] = { "win", 1 << LOOP_FLL }
+};
+
+static struct {
+	double lst[LIST_MAX];
+	int cnt;
+} k_lst[K_CNT];
+
+struct eval_coef {
+	struct pll_coef pll;
+	struct fll_coef fll;
+};
+
+static struct eval_coef coef[COEF_MAX];
+static int coef_cnt = 1;
+
+/* one instance of the parameter study */
+struct eval_case {
+	int id;
+	int coef; /* coefficient set, -1 for all of them as lanes */
+	float ppm;
+	double jitter;
+	double spike_p;
+	unsigned int seed;
+};
+
+struct eval_result {
+	int id;
+	int coef;
+	uint64_t samples;
+	double lock_time;
+	double err_rms;
+	double err_max;
+	uint32_t spikes;
+	uint32_t drops;
+	uint32_t steps;
+};
+
+/* recorded packets: arrival time and timestamp error */
+static struct {
+	double * t;
+	double * v;
+	int cnt;
+} rec;
+
+/* ---------------------------------------------------------------------------
+   Local oscillator and simulator hooks
+   -------------------------------------------------------------------------- */
+
+static struct {
+	double t; /* true time (seconds) */
+	double rate; /* local seconds per second */
+	double tick_t; /* true time of the last timer tick */
+} osc;
+
+/* Local timer count since the last tick, in microseconds. */
+uint32_t chime_tmr_count(int tmr_id)
+{
+	return (osc.t - osc.tick_t) * osc.rate * 1000000;
+}
+
+/* No variable recording offline */
+int chime_var_open(const char * name)
+{
+	return -1;
+}
+
+bool chime_var_rec(int oid, double value)
+{
+	return false;
+}
+
+/* ---------------------------------------------------------------------------
+   Noise
+   -------------------------------------------------------------------------- */
+
+static inline double rand_uniform(uint64_t * s)
+{
+	/* xorshift64* */
+	*s ^= *s >> 12;
+	*s ^= *s << 25;
+	*s ^= *s >> 27;
+
+	return ((*s * 0x2545f4914f6cdd1dULL) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static inline double rand_gauss(uint64_t * s)
+{
+	double u1 = rand_uniform(s);
+	double u2 = rand_uniform(s);
+
+	return sqrt(-2.0 * log(u1 + 1e-300)) * cos(2 * M_PI * u2);
+}
+
+/* ---------------------------------------------------------------------------
+   Evaluation
+   -------------------------------------------------------------------------- */
+
+static inline double clk_err(void)
+{
+	uint64_t ref = osc.t * 4294967296.;
+
+	return CLK_DOUBLE(clock_realtime_get() - ref);
+}
+
+static void eval_run(struct eval_case * c, struct eval_result * r)
+{
+	struct clock_filt filt;
+	struct clock_pll pll;
+	struct clock_fll fll;
+	struct {
+		uint64_t ts;
+		int64_t period;
+		int8_t sec;
+	} rtc;
+	uint64_t remote_ts = 0;
+	uint64_t rnd = c->seed * 0x9e3779b97f4a7c15ULL + 1;
+	double ss_start = cfg.sim_time * 0.75;
+	double tick_hz;
+	double tick_dt;
+	double next_pkt;
+	double sum2 = 0;
+	double e;
+	int rec_idx = 0;
+	bool pps;
+	int n = 0;
+
+	memset(r, 0, sizeof(struct eval_result));
+	r->id = c->id;
+	r->coef = c->coef;
+	r->lock_time = -1;
+
+	tick_hz = (cfg.loop == LOOP_PLL) ? SLAVE_CLOCK_FREQ_HZ : RTC_POLL_FREQ_HZ;
+	/* the tick timer period is programmed in microseconds */
+	tick_dt = (double)(unsigned int)(1000000 / tick_hz) / 1000000;
+
+	osc.t = 0;
+	osc.tick_t = 0;
+	osc.rate = 1.0 + c->ppm * 1e-6;
+
+	clock_init(FLOAT_CLK(1.0 / tick_hz), 0);
+
+	if (cfg.loop == LOOP_PLL) {
+		filt_init(&filt, FLOAT_CLK(0.001));
+		pll_init(&pll);
+		pll_coef_set(&pll, &coef[c->coef].pll);
+		clock_step(FLOAT_CLK(cfg.init_offs));
+		filt_reset(&filt, FLOAT_CLK(cfg.delay), REMOTE_PRECISION);
+	} else {
+		rtc.sec = -1;
+		rtc.ts = 0;
+		rtc.period = FLOAT_CLK(1.0 / RTC_NOMINAL_POLL_FREQ_HZ);
+		fll_init(&fll, FLL_ERR_MAX);
+		fll_coef_set(&fll, &coef[c->coef].fll);
+	}
+
+	if (rec.cnt > 0)
+		next_pkt = rec.t[0];
+	else
+		next_pkt = cfg.poll;
+
+	for (;;) {
+		double next_tick = osc.tick_t + tick_dt / osc.rate;
+
+		if ((cfg.loop == LOOP_PLL) && (next_pkt < next_tick)) {
+			double noise;
+			uint64_t local_ts;
+			int64_t offs;
+			int64_t itvl;
+
+			if (next_pkt >= cfg.sim_time)
+				break;
+			osc.t = next_pkt;
+
+			if (rec.cnt > 0) {
+				noise = rec.v[rec_idx++];
+				next_pkt = (rec_idx < rec.cnt) ? rec.t[rec_idx] : INFINITY;
+			} else {
+				noise = c->jitter * rand_gauss(&rnd);
+				if ((c->spike_p > 0) && (rand_uniform(&rnd) < c->spike_p))
+					noise += (rand_uniform(&rnd) < 0.5) ?
+						-cfg.spike_mag : cfg.spike_mag;
+				next_pkt += cfg.poll;
+			}
+
+			/* the timestamp was taken when the packet was sent */
+			itvl = (int64_t)((uint64_t)((osc.t - cfg.delay + noise) *
+										4294967296.) - remote_ts);
+			remote_ts += itvl;
+			local_ts = clock_realtime_get();
+
+			offs = filt_receive(&filt, remote_ts, local_ts);
+			if (offs != CLK_OFFS_INVALID)
+				pll_phase_adjust(&pll, offs, itvl);
+			r->samples++;
+			continue;
+		}
+
+		if (next_tick >= cfg.sim_time)
+			break;
+		osc.t = osc.tick_t = next_tick;
+		if (cfg.drift != 0)
+			osc.rate = 1.0 + (c->ppm + cfg.drift * osc.t / 3600) * 1e-6;
+
+		r->samples++;
+		pps = clock_tick();
+
+		if (cfg.loop == LOOP_FLL) {
+			int64_t offs;
+			uint64_t rtc_ts;
+			int sec = (int)osc.t;
+
+			/* RTC poll, see rtc_poll() in master.c */
+			rtc.ts += rtc.period;
+			if (rtc.sec != (int8_t)(sec % 60)) {
+				rtc.sec = sec % 60;
+				rtc_ts = (uint64_t)sec << 32;
+				offs = (int64_t)(rtc_ts - rtc.ts);
+				if ((offs >= RTC_OFFS_MAX) || (offs <= -RTC_OFFS_MAX)) {
+					rtc.ts = rtc_ts;
+					fll_reset(&fll, rtc.ts);
+				} else {
+					rtc.ts += offs;
+					fll_step(&fll, rtc.ts, offs);
+				}
+			}
+		}
+
+		if (!pps)
+			continue;
+
+		if (cfg.loop == LOOP_PLL)
+			pll_step(&pll);
+
+		e = clk_err();
+
+		if (fabs(e) > cfg.tol)
+			r->lock_time = -1;
+		else if (r->lock_time < 0)
+			r->lock_time = osc.t;
+
+		if (osc.t >= ss_start) {
+			sum2 += e * e;
+			if (fabs(e) > r->err_max)
+				r->err_max = fabs(e);
+			n++;
+		}
+	}
+
+	r->err_rms = (n > 0) ? sqrt(sum2 / n) : 0;
+
+	if (cfg.loop == LOOP_PLL) {
+		r->spikes = filt.stat.spike;
+		r->drops = filt.stat.drop;
+		r->steps = filt.stat.step + pll.stat.step_cnt;
+	} else {
+		r->steps = fll.stat.step_cnt;
+	}
+}
+
+/* Same as eval_run() with the PLL, for all the coefficient sets 
+   at once. One result per set. */
+static void eval_run_soa(struct eval_case * c, struct eval_result r[])
+{
+	static struct clock_soa clk;
+	static struct clock_pll_soa pll;
+	static struct clock_filt filt[COEF_MAX];
+	int64_t offs[COEF_MAX];
+	double sum2[COEF_MAX];
+	int cnt[COEF_MAX];
+	uint64_t remote_ts = 0;
+	uint64_t rnd = c->seed * 0x9e3779b97f4a7c15ULL + 1;
+	double ss_start = cfg.sim_time * 0.75;
+	double tick_dt;
+	double next_pkt;
+	uint64_t samples = 0;
+	uint64_t valid;
+	uint64_t pps;
+	double e;
+	int rec_idx = 0;
+	int i;
+
+	/* the tick timer period is programmed in microseconds */
+	tick_dt = (double)(unsigned int)(1000000 / SLAVE_CLOCK_FREQ_HZ) / 1000000;
+
+	osc.t = 0;
+	osc.tick_t = 0;
+	osc.rate = 1.0 + c->ppm * 1e-6;
+
+	clock_soa_init(&clk, coef_cnt, FLOAT_CLK(1.0 / SLAVE_CLOCK_FREQ_HZ));
+	pll_soa_init(&pll, coef_cnt);
+
+	for (i = 0; i < coef_cnt; ++i) {
+		memset(&r[i], 0, sizeof(struct eval_result));
+		r[i].id = c->id;
+		r[i].coef = i;
+		r[i].lock_time = -1;
+		sum2[i] = 0;
+		cnt[i] = 0;
+		pll_soa_coef_set(&pll, i, &coef[i].pll);
+		filt_init(&filt[i], FLOAT_CLK(0.001));
+		clock_soa_step(&clk, i, FLOAT_CLK(cfg.init_offs));
+		filt_reset(&filt[i], FLOAT_CLK(cfg.delay), REMOTE_PRECISION);
+	}
+
+	if (rec.cnt > 0)
+		next_pkt = rec.t[0];
+	else
+		next_pkt = cfg.poll;
+
+	for (;;) {
+		double next_tick = osc.tick_t + tick_dt / osc.rate;
+
+		if (next_pkt < next_tick) {
+			double noise;
+			uint32_t tmr_cnt;
+			int64_t itvl;
+
+			if (next_pkt >= cfg.sim_time)
+				break;
+			osc.t = next_pkt;
+
+			if (rec.cnt > 0) {
+				noise = rec.v[rec_idx++];
+				next_pkt = (rec_idx < rec.cnt) ? rec.t[rec_idx] : INFINITY;
+			} else {
+				noise = c->jitter * rand_gauss(&rnd);
+				if ((c->spike_p > 0) && (rand_uniform(&rnd) < c->spike_p))
+					noise += (rand_uniform(&rnd) < 0.5) ?
+						-cfg.spike_mag : cfg.spike_mag;
+				next_pkt += cfg.poll;
+			}
+
+			itvl = (int64_t)((uint64_t)((osc.t - cfg.delay + noise) *
+										4294967296.) - remote_ts);
+			remote_ts += itvl;
+			tmr_cnt = chime_tmr_count(0);
+
+			valid = 0;
+			for (i = 0; i < coef_cnt; ++i) {
+				offs[i] = filt_receive(&filt[i], remote_ts, 
+									   clock_soa_realtime_get(&clk, i, 
+															  tmr_cnt));
+				if (offs[i] != CLK_OFFS_INVALID)
+					valid |= 1ULL << i;
+			}
+			pll_soa_phase_adjust(&pll, &clk, offs, valid);
+			samples++;
+			continue;
+		}
+
+		if (next_tick >= cfg.sim_time)
+			break;
+		osc.t = osc.tick_t = next_tick;
+		if (cfg.drift != 0)
+			osc.rate = 1.0 + (c->ppm + cfg.drift * osc.t / 3600) * 1e-6;
+
+		samples++;
+		if ((pps = clock_soa_tick(&clk)) == 0)
+			continue;
+
+		pll_soa_step(&pll, &clk, pps);
+
+		for (i = 0; i < coef_cnt; ++i) {
+			if (!((pps >> i) & 1))
+				continue;
+
+			e = CLK_DOUBLE(clock_soa_realtime_get(&clk, i, 0) - 
+						   (uint64_t)(osc.t * 4294967296.));
+
+			if (fabs(e) > cfg.tol)
+				r[i].lock_time = -1;
+			else if (r[i].lock_time < 0)
+				r[i].lock_time = osc.t;
+
+			if (osc.t >= ss_start) {
+				sum2[i] += e * e;
+				if (fabs(e) > r[i].err_max)
+					r[i].err_max = fabs(e);
+				cnt[i]++;
+			}
+		}
+	}
+
+	for (i = 0; i < coef_cnt; ++i) {
+		r[i].samples = samples;
+		r[i].err_rms = (cnt[i] > 0) ? sqrt(sum2[i] / cnt[i]) : 0;
+		r[i].spikes = filt[i].stat.spike;
+		r[i].drops = filt[i].stat.drop;
+		r[i].steps = filt[i].stat.step + pll.step_cnt[i];
+	}
+}
+
+static void eval_print(struct eval_case * c, struct eval_result * r)
+{
+	printf("%d,%s,%d,%.3f,%.6f,%.4f,%u,%" PRIu64 ",%.1f,%.3f,%.3f,%u,%u,%u\n",
+		   c->id, loop_nm[cfg.loop], r->coef, c->ppm, c->jitter, c->spike_p, 
+		   c->seed, r->samples, r->lock_time, r->err_rms * 1e6, r->err_max * 1e6,
+		   r->spikes, r->drops, r->steps);
+}
+
+/* ---------------------------------------------------------------------------
+   Recorded input
+   -------------------------------------------------------------------------- */
+
+static int rec_load(const char * path)
+{
+	char line[256];
+	int len = 0;
+	double t;
+	double v;
+	FILE * f;
+
+	if ((f = fopen(path, "r")) == NULL) {
+		fprintf(stderr, "fopen(\"%s\"): %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	while (fgets(line, sizeof(line), f) != NULL) {
+		if ((line[0] == '#') || (sscanf(line, "%lf %lf", &t, &v) != 2))
+			continue;
+		if (rec.cnt == len) {
+			len = (len == 0) ? 1024 : len * 2;
+			rec.t = realloc(rec.t, len * sizeof(double));
+			rec.v = realloc(rec.v, len * sizeof(double));
+		}
+		rec.t[rec.cnt] = t;
+		rec.v[rec.cnt] = v;
+		rec.cnt++;
+	}
+
+	fclose(f);
+
+	if (rec.cnt == 0) {
+		fprintf(stderr, "%s: no samples!\n", path);
+		return -1;
+	}
+
+	return rec.cnt;
+}
+
+/* ---------------------------------------------------------------------------
+   Main
+   -------------------------------------------------------------------------- */
+
+static double wall_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int list_parse(char * s, double lst[])
+{
+	char * tok;
+	int cnt = 0;
+
+	for (tok = strtok(s, ","); tok && cnt < LIST_MAX; tok = strtok(NULL, ","))
+		lst[cnt++] = strtod(tok, NULL);
+
+	return cnt;
+}
+
+/* Build the coefficient sets from the -K lists */
+static int coef_build(void)
+{
+	int idx[K_CNT];
+	double v[K_CNT];
+	int cnt = 1;
+	int k;
+	int i;
+
+	for (k = 0; k < K_CNT; ++k) {
+		if (k_lst[k].cnt == 0)
+			continue;
+		if (!(k_def[k].loop_msk & (1 << cfg.loop))) {
+			fprintf(stderr, "-K %s: not a %s coefficient\n", 
+					k_def[k].nm, loop_nm[cfg.loop]);
+			return -1;
+		}
+		cnt *= k_lst[k].cnt;
+		if (cnt > COEF_MAX) {
+			fprintf(stderr, "too many coefficient sets, max %d\n", COEF_MAX);
+			return -1;
+		}
+	}
+
+	memset(idx, 0, sizeof(idx));
+	for (i = 0; i < cnt; ++i) {
+		for (k = 0; k < K_CNT; ++k)
+			v[k] = k_lst[k].lst[idx[k]];
+
+		coef[i].pll = pll_coef_default;
+		coef[i].fll = fll_coef_default;
+		if (k_lst[K_A].cnt)
+			coef[i].pll.a = FLOAT_Q31(v[K_A]);
+		if (k_lst[K_B].cnt)
+			coef[i].pll.b = FLOAT_Q31(v[K_B]);
+		if (k_lst[K_KD].cnt)
+			coef[i].pll.kd = coef[i].fll.kd = v[K_KD];
+		if (k_lst[K_KP].cnt)
+			coef[i].pll.kp = coef[i].fll.kp = v[K_KP];
+		if (k_lst[K_KI].cnt)
+			coef[i].pll.ki = v[K_KI];
+		if (k_lst[K_EDGE].cnt)
+			coef[i].fll.edge_win = v[K_EDGE];
+		if (k_lst[K_WIN].cnt)
+			coef[i].fll.calc_win = v[K_WIN];
+
+		if ((coef[i].pll.kd <= 0) || (coef[i].pll.kp <= 0) || 
+			(coef[i].pll.ki <= 0) || (coef[i].fll.kd <= 0) || 
+			(coef[i].fll.kp <= 0) || (coef[i].fll.edge_win == 0)) {
+			fprintf(stderr, "coef %d: invalid gains\n", i);
+			return -1;
+		}
+
+		/* the lanes need power of two gains */
+		if ((coef[i].pll.kd & (coef[i].pll.kd - 1)) ||
+			(coef[i].pll.kp & (coef[i].pll.kp - 1)) ||
+			(coef[i].pll.ki & (coef[i].pll.ki - 1)))
+			cfg.soa = false;
+
+		/* next combination */
+		for (k = 0; k < K_CNT; ++k) {
+			if (k_lst[k].cnt == 0)
+				continue;
+			if (++idx[k] < k_lst[k].cnt)
+				break;
+			idx[k] = 0;
+		}
+	}
+
+	return cnt;
+}
+
+static void coef_print(void)
+{
+	int i;
+
+	for (i = 0; i < coef_cnt; ++i) {
+		if (cfg.loop == LOOP_PLL)
+			printf("# coef %d: a=%.6f b=%.6f kd=%d kp=%d ki=%d\n", i, 
+				   Q31_FLOAT(coef[i].pll.a), Q31_FLOAT(coef[i].pll.b), 
+				   coef[i].pll.kd, coef[i].pll.kp, coef[i].pll.ki);
+		else
+			printf("# coef %d: kd=%d kp=%d edge=%u win=%u\n", i, 
+				   coef[i].fll.kd, coef[i].fll.kp, coef[i].fll.edge_win, 
+				   coef[i].fll.calc_win);
+	}
+}
+
+static void worker(struct eval_case cs[], int cnt, int w, int fd)
+{
+	struct eval_result r[COEF_MAX];
+	int n;
+	int i;
+
+	for (i = w; i < cnt; i += cfg.jobs) {
+		if (cs[i].coef < 0) {
+			eval_run_soa(&cs[i], r);
+			n = coef_cnt;
+		} else {
+			eval_run(&cs[i], r);
+			n = 1;
+		}
+		if (write(fd, r, n * sizeof(r[0])) != n * sizeof(r[0]))
+			exit(2);
+	}
+
+	exit(0);
+}
+
+static void show_usage(const char * prog)
+{
+	fprintf(stderr, "Usage: %s [OPTION...]\n", prog);
+	fprintf(stderr, "  -l LOOP    pll (slave) or fll (master) (default pll)\n");
+	fprintf(stderr, "  -T SEC     simulated time per instance (default 43200)\n");
+	fprintf(stderr, "  -p LIST    oscillator error, ppm (default 100)\n");
+	fprintf(stderr, "  -d PPM     oscillator drift, ppm per hour (default 0)\n");
+	fprintf(stderr, "  -J LIST    timestamp jitter, std. deviation in seconds "
+			"(default 0.0005)\n");
+	fprintf(stderr, "  -s LIST    spike probability per packet (default 0)\n");
+	fprintf(stderr, "  -m SEC     spike magnitude (default 0.2)\n");
+	fprintf(stderr, "  -P SEC     packet interval (default %d)\n", SYNCLK_POLL);
+	fprintf(stderr, "  -o SEC     initial clock offset (default 1)\n");
+	fprintf(stderr, "  -e SEC     lock tolerance (default 0.001)\n");
+	fprintf(stderr, "  -n SEEDS   seeds per parameter set (default 1)\n");
+	fprintf(stderr, "  -f FILE    recorded packets, \"time error\" lines\n");
+	fprintf(stderr, "  -K NM=LIST loop coefficient sweep, pll: a, b, kd, kp, "
+			"ki; fll: kd, kp, edge, win\n");
+	fprintf(stderr, "  -S         run the PLL coefficient sets one at a time\n");
+	fprintf(stderr, "  -j JOBS    parallel jobs (default: online CPUs)\n");
+	fprintf(stderr, "\n");
+}
+
+int main(int argc, char *argv[])
+{
+	double ppm[LIST_MAX] = { 100 };
+	double jit[LIST_MAX] = { 0.0005 };
+	double spk[LIST_MAX] = { 0 };
+	int ppm_cnt = 1;
+	int jit_cnt = 1;
+	int spk_cnt = 1;
+	struct pollfd pfd[JOBS_MAX];
+	struct eval_case * cs;
+	struct eval_result r;
+	uint64_t samples = 0;
+	int pid[JOBS_MAX];
+	int per_case;
+	char * val;
+	int open_cnt;
+	int status;
+	int cnt;
+	double wall;
+	int ret = 0;
+	int fd[2];
+	int c;
+	int i;
+	int j;
+	int k;
+	int s;
+
+	while ((c = getopt(argc, argv, "l:T:p:d:J:s:m:P:o:e:n:f:j:K:Sh")) > 0) {
+		switch (c) {
+		case 'l':
+			if (strcmp(optarg, "pll") == 0)
+				cfg.loop = LOOP_PLL;
+			else if (strcmp(optarg, "fll") == 0)
+				cfg.loop = LOOP_FLL;
+			else {
+				show_usage(argv[0]);
+				return 1;
+			}
+			break;
+		case 'T':
+			cfg.sim_time = strtod(optarg, NULL);
+			break;
+		case 'p':
+			ppm_cnt = list_parse(optarg, ppm);
+			break;
+		case 'd':
+			cfg.drift = strtod(optarg, NULL);
+			break;
+		case 'J':
+			jit_cnt = list_parse(optarg, jit);
+			break;
+		case 's':
+			spk_cnt = list_parse(optarg, spk);
+			break;
+		case 'm':
+			cfg.spike_mag = strtod(optarg, NULL);
+			break;
+		case 'P':
+			cfg.poll = strtod(optarg, NULL);
+			break;
+		case 'o':
+			cfg.init_offs = strtod(optarg, NULL);
+			break;
+		case 'e':
+			cfg.tol = strtod(optarg, NULL);
+			break;
+		case 'n':
+			cfg.seeds = strtoul(optarg, NULL, 0);
+			break;
+		case 'f':
+			if (rec_load(optarg) < 0)
+				return 1;
+			break;
+		case 'j':
+			cfg.jobs = strtoul(optarg, NULL, 0);
+			break;
+		case 'K':
+			if ((val = strchr(optarg, '=')) == NULL) {
+				show_usage(argv[0]);
+				return 1;
+			}
+			*val++ = '\0';
+			for (k = 0; k < K_CNT; ++k) {
+				if (strcmp(optarg, k_def[k].nm) == 0)
+					break;
+			}
+			if (k == K_CNT) {
+				fprintf(stderr, "-K %s: unknown coefficient\n", optarg);
+				return 1;
+			}
+			k_lst[k].cnt = list_parse(val, k_lst[k].lst);
+			break;
+		case 'S':
+			cfg.soa = false;
+			break;
+		default:
+			show_usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if ((cfg.sim_time <= 0) || (cfg.poll <= 0) || (cfg.seeds < 1) ||
+		(ppm_cnt < 1) || (jit_cnt < 1) || (spk_cnt < 1)) {
+		show_usage(argv[0]);
+		return 1;
+	}
+
+	/* the network parameters are not used by the FLL, nor with a
+	   recorded input */
+	if ((cfg.loop == LOOP_FLL) || (rec.cnt > 0)) {
+		jit[0] = 0;
+		jit_cnt = 1;
+		spk[0] = 0;
+		spk_cnt = 1;
+	}
+
+	if ((coef_cnt = coef_build()) < 0)
+		return 1;
+
+	/* lanes only pay off with more than one set */
+	if ((cfg.loop != LOOP_PLL) || (coef_cnt == 1))
+		cfg.soa = false;
+	per_case = cfg.soa ? 1 : coef_cnt;
+
+	cnt = ppm_cnt * jit_cnt * spk_cnt * cfg.seeds * per_case;
+	cs = calloc(cnt, sizeof(struct eval_case));
+	for (i = 0, j = 0; j < ppm_cnt; ++j) {
+		for (k = 0; k < jit_cnt; ++k) {
+			for (c = 0; c < spk_cnt; ++c) {
+				for (s = 0; s < cfg.seeds * per_case; ++s, ++i) {
+					cs[i].id = i;
+					cs[i].coef = cfg.soa ? -1 : s % per_case;
+					cs[i].ppm = ppm[j];
+					cs[i].jitter = jit[k];
+					cs[i].spike_p = spk[c];
+					cs[i].seed = s / per_case + 1;
+				}
+			}
+		}
+	}
+
+	if (cfg.jobs <= 0)
+		cfg.jobs = sysconf(_SC_NPROCESSORS_ONLN);
+	if (cfg.jobs > JOBS_MAX)
+		cfg.jobs = JOBS_MAX;
+	if (cfg.jobs > cnt)
+		cfg.jobs = cnt;
+
+	coef_print();
+	printf("id,loop,coef,ppm,jitter,spike_p,seed,samples,lock_time,"
+		   "err_rms_us,err_max_us,spikes,drops,steps\n");
+	fflush(stdout);
+
+	wall = wall_time();
+
+	for (j = 0; j < cfg.jobs; ++j) {
+		if (pipe(fd) < 0) {
+			fprintf(stderr, "pipe(): %s\n", strerror(errno));
+			return 2;
+		}
+		if ((pid[j] = fork()) < 0) {
+			fprintf(stderr, "fork(): %s\n", strerror(errno));
+			return 2;
+		}
+		if (pid[j] == 0) {
+			close(fd[0]);
+			worker(cs, cnt, j, fd[1]);
+		}
+		close(fd[1]);
+		pfd[j].fd = fd[0];
+		pfd[j].events = POLLIN;
+	}
+
+	/* print the results as they come */
+	for (open_cnt = cfg.jobs; open_cnt > 0; ) {
+		if (poll(pfd, cfg.jobs, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			fprintf(stderr, "poll(): %s\n", strerror(errno));
+			return 2;
+		}
+		for (j = 0; j < cfg.jobs; ++j) {
+			if (pfd[j].revents == 0)
+				continue;
+			if (read(pfd[j].fd, &r, sizeof(r)) == sizeof(r)) {
+				eval_print(&cs[r.id], &r);
+				samples += r.samples;
+			} else {
+				close(pfd[j].fd);
+				pfd[j].fd = -1;
+				open_cnt--;
+			}
+		}
+	}
+	fflush(stdout);
+
+	for (j = 0; j < cfg.jobs; ++j) {
+		waitpid(pid[j], &status, 0);
+		if (!WIFEXITED(status) || (WEXITSTATUS(status) != 0))
+			ret = 2;
+	}
+
+	wall = wall_time() - wall;
+
+	printf("# %d instances, %d coefficient sets%s, %d jobs, %" PRIu64 
+		   " samples, %.3f s, %.0f samples/s\n", cnt / per_case, coef_cnt, 
+		   cfg.soa ? " (lanes)" : "", cfg.jobs, samples, wall, 
+		   samples / wall);
+
+	free(cs);
+
+	return ret;
+}
+
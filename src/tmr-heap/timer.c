@@ -197,25 +197,264 @@ void tmr_heap_init(struct timer * heap[])
 
 #define TIMER_SCHED_LENGHT 64
 
+/* Tickless mode: instead of a periodic tick the hardware timer is 
+   programmed to the next deadline in the heap, and stopped when the 
+   heap is empty. */
+#ifndef TIMER_SCHED_TICKLESS
+#define TIMER_SCHED_TICKLESS 1
+#endif
+
+/* hardware timer used by the scheduler */
+#define TIMER_SCHED_HW_TMR 7
+/* hardware timer ticks per scheduler clock */
+#define TIMER_SCHED_TICKS 1000
+
 struct tmr_sched {
 	volatile bool wakeup;
 	uint32_t clk;
 	uint32_t min_clk;
+#if TIMER_SCHED_TICKLESS
+	bool busy; /* processing timers, defer the hardware timer update */
+	bool hw_armed;
+	uint32_t hw_clk; /* deadline programmed in the hardware timer */
+	uint32_t tick_ref; /* CPU cycles at 'clk' */
+#endif
 	struct timer tmr[TIMER_SCHED_LENGHT];
 	struct timer * heap[TIMER_SCHED_LENGHT + 1];
 };
 
 struct tmr_sched sched;
 
+#if TIMER_SCHED_SERVER
+
+/* The server expires the timers and reloads the periodic ones, 
+   the ISR only records the expiration, the callbacks are called 
+   from timer_sched(). */
+
+static void __timer_isr(void * arg)
+{
+	struct timer * tmr = (struct timer *)arg;
+
+	/* a one shot timer is no longer running */
+	if (tmr->itval == 0)
+		tmr->pos = 0;
+
+	tmr->pend++;
+	/* wakeup worker thread */
+	sched.wakeup = true;
+}
+
+static void __timer_arm(struct timer * tmr)
+{
+	/* a zero timeout expires in the next cycle */
+	uint32_t timeout = (tmr->clk == 0) ? 1 : tmr->clk * TIMER_SCHED_TICKS;
+
+	/* drop the expirations of the previous setting */
+	tmr->pend = 0;
+	tmr->pos = 1;
+	chime_timer_arm(tmr->handle, timeout, tmr->itval * TIMER_SCHED_TICKS);
+}
+
+void timer_default_callback(void * param)
+{
+	DBG("...");
+}
+
+void timer_init(unsigned int tmr_id, void (* callback)(void *), void * param)
+{
+	struct timer * tmr;
+
+	if (tmr_id >= TIMER_SCHED_LENGHT) {
+		ERR("tmr_id >= TIMER_SCHED_LENGHT");
+		return;
+	}
+
+	tmr = &sched.tmr[tmr_id];
+
+	DBG("tmr_id=%d", tmr_id);
+
+	if (tmr->handle < 0) {
+		if ((tmr->handle = chime_timer_create(__timer_isr, tmr)) < 0) {
+			ERR("chime_timer_create() failed!");
+			return;
+		}
+	} else if (tmr->pos != 0) {
+		chime_timer_cancel(tmr->handle);
+	}
+
+	tmr->clk = 0;
+	tmr->itval = 0;
+	tmr->pos = 0;
+	tmr->pend = 0;
+	if (callback == NULL)
+		callback = timer_default_callback;
+	tmr->callback = callback;
+	tmr->param = param;
+}
+
+void timer_set(unsigned int tmr_id, uint32_t timeout, uint32_t period)
+{
+	struct timer * tmr;
+
+	if (tmr_id >= TIMER_SCHED_LENGHT) {
+		ERR("tmr_id >= TIMER_SCHED_LENGHT");
+		return;
+	}
+
+	tmr = &sched.tmr[tmr_id];
+	if (tmr->handle < 0) {
+		ERR("timer %d not initialized!", tmr_id);
+		return;
+	}
+
+	DBG("tmr_id=%d tmo=%d itv=%d", tmr_id, timeout, period);
+
+	/* the timeout is kept for timer_start() */
+	tmr->clk = timeout;
+	tmr->itval = period;
+	__timer_arm(tmr);
+}
+
+void timer_start(unsigned int tmr_id)
+{
+	struct timer * tmr;
+
+	if (tmr_id >= TIMER_SCHED_LENGHT) {
+		ERR("tmr_id >= TIMER_SCHED_LENGHT");
+		return;
+	}
+
+	tmr = &sched.tmr[tmr_id];
+
+	if ((tmr->handle >= 0) && (tmr->pos == 0))
+		__timer_arm(tmr);
+}
+
+void timer_stop(unsigned int tmr_id)
+{
+	struct timer * tmr;
+
+	assert(tmr_id < TIMER_SCHED_LENGHT);
+
+	tmr = &sched.tmr[tmr_id];
+
+	if (tmr->pos != 0) {
+		chime_timer_cancel(tmr->handle);
+		tmr->pos = 0;
+	}
+	/* a stopped timer doesn't call back */
+	tmr->pend = 0;
+}
+
+void timer_sched(void)
+{
+	struct timer * tmr;
+	unsigned int i;
+
+	if (!sched.wakeup)
+		return;
+
+	sched.wakeup = false;
+
+	/* one callback per expiration, in timer order */
+	for (i = 0; i < TIMER_SCHED_LENGHT; ++i) {
+		tmr = &sched.tmr[i];
+		while (tmr->pend != 0) {
+			tmr->pend--;
+			tmr->callback(tmr->param);
+		}
+	}
+}
+
+void timer_sched_init(void)
+{
+	unsigned int i;
+
+	/* the server timers are gone after a CPU reset */
+	for (i = 0; i < TIMER_SCHED_LENGHT; ++i) {
+		sched.tmr[i].pos = 0;
+		sched.tmr[i].clk = 0;
+		sched.tmr[i].itval = 0;
+		sched.tmr[i].pend = 0;
+		sched.tmr[i].callback = timer_default_callback;
+		sched.tmr[i].param = NULL;
+		sched.tmr[i].handle = -1;
+	}
+
+	tmr_heap_init(sched.heap);
+
+	sched.wakeup = false;
+	sched.clk = 0;
+	sched.min_clk = INT32_MAX;
+}
+
+#else /* TIMER_SCHED_SERVER */
+
+#if TIMER_SCHED_TICKLESS
+/* Bring the clock up to date with the CPU cycles counter */
+static void __sched_clk_update(void)
+{
+	uint32_t dt;
+
+	dt = (chime_cpu_cycles() - sched.tick_ref) / TIMER_SCHED_TICKS;
+	sched.clk += dt;
+	sched.tick_ref += dt * TIMER_SCHED_TICKS;
+}
+
+/* Program the hardware timer to the heap minimum */
+static void __sched_rearm(void)
+{
+	struct timer * tmr;
+	uint32_t ticks;
+	int32_t dt;
+
+	if (sched.busy)
+		return;
+
+	if ((tmr = tmr_heap_get_min(sched.heap)) == NULL) {
+		if (sched.hw_armed) {
+			DBG5("idle");
+			chime_tmr_stop(TIMER_SCHED_HW_TMR);
+			sched.hw_armed = false;
+		}
+		return;
+	}
+
+	if (sched.hw_armed && (tmr->clk == sched.hw_clk))
+		return;
+
+	__sched_clk_update();
+
+	if ((dt = (int32_t)(tmr->clk - sched.clk)) > 0)
+		ticks = dt * TIMER_SCHED_TICKS - 
+			(chime_cpu_cycles() - sched.tick_ref);
+	else
+		ticks = 1;
+
+	DBG5("tmo=%d ticks=%d", tmr->clk, ticks);
+
+	sched.hw_clk = tmr->clk;
+	sched.hw_armed = true;
+	chime_tmr_reset(TIMER_SCHED_HW_TMR, ticks, 0);
+}
+#endif
+
 void timer_sched_isr(void)
 {
+#if TIMER_SCHED_TICKLESS
+	/* one shot, only fires on a deadline */
+	__sched_clk_update();
+	sched.hw_armed = false;
+	sched.wakeup = true;
+#else
 	sched.clk++;
 
-	if ((sched.min_clk - sched.clk) < 0) {
+	if ((int32_t)(sched.min_clk - sched.clk) <= 0) {
 		DBG("wakeup...");
 		/* wakeup worker thread */
 		sched.wakeup = true;
 	}
+#endif
 }
 
 void timer_default_callback(void * param)
@@ -256,22 +495,31 @@ void timer_set(unsigned int tmr_id, uint32_t timeout, uint32_t period)
 
 	tmr = &sched.tmr[tmr_id];
 
+#if TIMER_SCHED_TICKLESS
+	__sched_clk_update();
+#endif
+
+	/* the deadline can move either way, remove it first */
+	if (tmr->pos != 0) {
+		if (tmr != sched.heap[tmr->pos]) {
+			ERR("tmr != sched.heap[tmr->pos]");
+		}
+		tmr_heap_delete(sched.heap, tmr->pos, sched.clk);
+	}
+
 	tmr->itval = period;
 	tmr->clk = sched.clk + timeout;
 
 	DBG("tmr_id=%d tmo=%d itv=%d clk=%d", tmr_id, timeout, period, tmr->clk);
 
-	if ((tmr->clk - sched.min_clk) < 0)
+	if ((int32_t)(tmr->clk - sched.min_clk) < 0)
 		sched.min_clk = tmr->clk;
 
-	if (tmr->pos == 0) {
-		tmr_heap_insert(sched.heap, tmr, sched.clk);
-	} else {
-		if (tmr != sched.heap[tmr->pos]) {
-			ERR("tmr != sched.heap[tmr->pos]");
-		}
-		tmr_heap_heapify(sched.heap, tmr->pos, sched.clk);
-	}
+	tmr_heap_insert(sched.heap, tmr, sched.clk);
+
+#if TIMER_SCHED_TICKLESS
+	__sched_rearm();
+#endif
 }
 
 void timer_start(unsigned int tmr_id)
@@ -288,9 +536,13 @@ void timer_start(unsigned int tmr_id)
 	if (tmr->pos == 0) {
 		tmr_heap_insert(sched.heap, tmr, sched.clk);
 
-		if ((tmr->clk - sched.min_clk) < 0)
+		if ((int32_t)(tmr->clk - sched.min_clk) < 0)
 			sched.min_clk = tmr->clk;
 	}
+
+#if TIMER_SCHED_TICKLESS
+	__sched_rearm();
+#endif
 }
 
 void timer_stop(unsigned int tmr_id)
@@ -303,6 +555,10 @@ void timer_stop(unsigned int tmr_id)
 
 	if (tmr->pos != 0)
 		tmr_heap_delete(sched.heap, tmr->pos, sched.clk);
+
+#if TIMER_SCHED_TICKLESS
+	__sched_rearm();
+#endif
 }
 
 void timer_sched(void)
@@ -314,14 +570,19 @@ void timer_sched(void)
 
 	sched.wakeup = false;
 
+#if TIMER_SCHED_TICKLESS
+	__sched_clk_update();
+	sched.busy = true;
+#endif
+
 	/* process timers */
 	while ((tmr = tmr_heap_get_min(sched.heap)) != NULL) {
-		if ((tmr->clk - sched.clk) < 0) {
+		if ((int32_t)(tmr->clk - sched.clk) <= 0) {
 			if (tmr->itval) {
 				/* reschedule a periodic clock */
 				tmr->clk = sched.clk + tmr->itval;
 				tmr_heap_heapify(sched.heap, 1, sched.clk);
-				if ((tmr->clk - sched.min_clk) < 0)
+				if ((int32_t)(tmr->clk - sched.min_clk) < 0)
 					sched.min_clk = tmr->clk;
 			} else {
 				/* remove a non periodic clock */
@@ -334,6 +595,11 @@ void timer_sched(void)
 			break;
 		}
 	}
+
+#if TIMER_SCHED_TICKLESS
+	sched.busy = false;
+	__sched_rearm();
+#endif
 }
 
 
@@ -345,6 +611,7 @@ void timer_sched_init(void)
 		sched.tmr[i].pos = 0;
 		sched.tmr[i].clk = 0;
 		sched.tmr[i].itval = 0;
+		sched.tmr[i].pend = 0;
 		sched.tmr[i].callback = timer_default_callback;
 		sched.tmr[i].param = NULL;
 	}
@@ -352,10 +619,23 @@ void timer_sched_init(void)
 	tmr_heap_init(sched.heap);
 
 	sched.wakeup = false;
-
-	chime_tmr_init(7, timer_sched_isr, 1000, 1000);
+	sched.clk = 0;
+	sched.min_clk = INT32_MAX;
+
+#if TIMER_SCHED_TICKLESS
+	sched.busy = false;
+	sched.hw_armed = false;
+	sched.tick_ref = chime_cpu_cycles();
+	/* armed on demand */
+	chime_tmr_init(TIMER_SCHED_HW_TMR, timer_sched_isr, 0, 0);
+#else
+	chime_tmr_init(TIMER_SCHED_HW_TMR, timer_sched_isr, 
+				   TIMER_SCHED_TICKS, TIMER_SCHED_TICKS);
+#endif
 }
 
+#endif /* TIMER_SCHED_SERVER */
+
 /****************************************************************************
   Heap Debug
  ****************************************************************************/
@@ -8,12 +8,23 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+/* Server mode: every timer is backed by a server managed timer 
+   (chime_timer_create()), the heap below is not used. In both modes the
+   callbacks are called from timer_sched(), never from interrupt 
+   context, so the main loop must call timer_sched() after every 
+   chime_cpu_wait(). */
+#ifndef TIMER_SCHED_SERVER
+#define TIMER_SCHED_SERVER 1
+#endif
+
 struct timer {
 	uint32_t clk;
 	uint32_t pos;
 	uint32_t itval;
 	void (* callback)(void *);
 	void * param;
+	int handle; /* server timer, server mode only */
+	volatile uint32_t pend; /* expirations not yet called back, server mode */
 };
 
 #ifdef __cplusplus
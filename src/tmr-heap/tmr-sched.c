@@ -90,8 +90,10 @@ void cpu0_reset(void)
 	timer_set(15, 41, 450);
 	timer_set(16, 1, 2);
 
+#if !TIMER_SCHED_SERVER
 	tmr_heap_dump(stdout);
 	tmr_heap_flush(stdout);
+#endif
 
 	for (;;) {
 		chime_cpu_wait();
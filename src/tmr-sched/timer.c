@@ -20,21 +20,94 @@
 
 #define TIMER_SCHED_LENGHT 64
 
+/* Tickless mode: instead of a periodic tick the hardware timer is 
+   programmed to the next timeout, and stopped when no timer is 
+   enabled. */
+#ifndef TIMER_SCHED_TICKLESS
+#define TIMER_SCHED_TICKLESS 1
+#endif
+
+/* hardware timer used by the scheduler */
+#define TIMER_SCHED_HW_TMR 7
+/* hardware timer ticks per scheduler clock */
+#define TIMER_SCHED_TICKS 1000
+
 struct tmr_sched {
 	volatile bool wakeup;
 	uint32_t clk;
 	uint32_t tmo_clk;
+#if TIMER_SCHED_TICKLESS
+	bool busy; /* processing timers, defer the hardware timer update */
+	bool hw_armed;
+	uint32_t hw_clk; /* timeout programmed in the hardware timer */
+	uint32_t tick_ref; /* CPU cycles at 'clk' */
+#endif
 	struct timer tmr[TIMER_SCHED_LENGHT];
 };
 
 struct tmr_sched sched;
 
+#if TIMER_SCHED_TICKLESS
+/* Bring the clock up to date with the CPU cycles counter */
+static void __sched_clk_update(void)
+{
+	uint32_t dt;
+
+	dt = (chime_cpu_cycles() - sched.tick_ref) / TIMER_SCHED_TICKS;
+	sched.clk += dt;
+	sched.tick_ref += dt * TIMER_SCHED_TICKS;
+}
+
+/* Program the hardware timer to the next timeout */
+static void __sched_rearm(void)
+{
+	uint32_t ticks;
+	int32_t dt;
+
+	if (sched.busy)
+		return;
+
+	if (sched.hw_armed && (sched.tmo_clk == sched.hw_clk))
+		return;
+
+	__sched_clk_update();
+
+	if ((dt = (int32_t)(sched.tmo_clk - sched.clk)) > 0)
+		ticks = dt * TIMER_SCHED_TICKS - 
+			(chime_cpu_cycles() - sched.tick_ref);
+	else
+		ticks = 1;
+
+	DBG5("tmo=%d ticks=%d", sched.tmo_clk, ticks);
+
+	sched.hw_clk = sched.tmo_clk;
+	sched.hw_armed = true;
+	chime_tmr_reset(TIMER_SCHED_HW_TMR, ticks, 0);
+}
+
+static void __sched_idle(void)
+{
+	if (sched.hw_armed) {
+		DBG5("idle");
+		chime_tmr_stop(TIMER_SCHED_HW_TMR);
+		sched.hw_armed = false;
+	}
+}
+#endif
+
 void timer_sched_isr(void)
 {
 	register uint32_t clk;
 
+#if TIMER_SCHED_TICKLESS
+	/* one shot, only fires on a timeout */
+	__sched_clk_update();
+	sched.hw_armed = false;
+	clk = sched.clk;
+#else
 	clk = sched.clk + 1;
 	sched.clk = clk;
+#endif
 
 	DBG5("<%d>", (int32_t)(sched.tmo_clk - clk));
 
@@ -45,6 +118,10 @@ void timer_sched_isr(void)
 		/* wakeup worker thread */
 		sched.wakeup = true;
 	}
+#if TIMER_SCHED_TICKLESS
+	else
+		__sched_rearm();
+#endif
 }
 
 void timer_default_callback(void * param)
@@ -101,6 +178,10 @@ void timer_set(unsigned int tmr_id, uint32_t timeout, uint32_t period)
 
 	DBG("tmr_id=%d tmo=%d itv=%d clk=%d", tmr_id, timeout, period, tmr->clk);
 
+#if TIMER_SCHED_TICKLESS
+	__sched_clk_update();
+#endif
+
 	clk = sched.clk + timeout;
 
 	tmr->clk = clk;
@@ -110,6 +191,10 @@ void timer_set(unsigned int tmr_id, uint32_t timeout, uint32_t period)
 	}
 
 	tmr->enabled = true;
+
+#if TIMER_SCHED_TICKLESS
+	__sched_rearm();
+#endif
 }
 
 void timer_start(unsigned int tmr_id)
@@ -123,6 +208,13 @@ void timer_start(unsigned int tmr_id)
 
 	tmr = &sched.tmr[tmr_id];
 	tmr->enabled = true;
+
+	if ((int32_t)(tmr->clk - sched.tmo_clk) < 0)
+		sched.tmo_clk = tmr->clk;
+
+#if TIMER_SCHED_TICKLESS
+	__sched_rearm();
+#endif
 }
 
 void timer_stop(unsigned int tmr_id)
@@ -147,6 +239,10 @@ void timer_sched(void)
 		return;
 
 	sched.wakeup = false;
+#if TIMER_SCHED_TICKLESS
+	__sched_clk_update();
+	sched.busy = true;
+#endif
 	ref_clk = sched.clk;
 
 	for (i = 0; i < TIMER_SCHED_LENGHT; ++i) {
@@ -183,6 +279,14 @@ void timer_sched(void)
 		DBG5("tmo=%d", ref_clk);
 		sched.tmo_clk = ref_clk;
 	}
+
+#if TIMER_SCHED_TICKLESS
+	sched.busy = false;
+	if ((dt_min == INT32_MAX) && ((int32_t)(sched.tmo_clk - ref_clk) >= 0))
+		__sched_idle(); /* nothing enabled */
+	else
+		__sched_rearm();
+#endif
 }
 
 void __timer_sched(void)
@@ -242,6 +346,15 @@ void timer_sched_init(void)
 	sched.clk = 0;
 	sched.tmo_clk = INT32_MAX;
 
-	chime_tmr_init(7, timer_sched_isr, 1000, 1000);
+#if TIMER_SCHED_TICKLESS
+	sched.busy = false;
+	sched.hw_armed = false;
+	sched.tick_ref = chime_cpu_cycles();
+	/* armed on demand */
+	chime_tmr_init(TIMER_SCHED_HW_TMR, timer_sched_isr, 0, 0);
+#else
+	chime_tmr_init(TIMER_SCHED_HW_TMR, timer_sched_isr, 
+				   TIMER_SCHED_TICKS, TIMER_SCHED_TICKS);
+#endif
 }
 